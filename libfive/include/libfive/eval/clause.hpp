@@ -8,6 +8,9 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+
 #include "libfive/tree/opcode.hpp"
 
 namespace libfive {
@@ -32,6 +35,20 @@ struct Clause
     Id const id;
     Id const a;
     Id const b;
+
+    /*  Tape-only opcodes with an immediate operand (see
+     *  Opcode::hasImmediate) store its bits in place of b;
+     *  these functions convert between the two. */
+    static float immediate(Id b) {
+        float f;
+        std::memcpy(&f, &b, sizeof(f));
+        return f;
+    }
+    static Id encodeImmediate(float f) {
+        Id b;
+        std::memcpy(&b, &f, sizeof(b));
+        return b;
+    }
 };
 
 }   // namespace libfive
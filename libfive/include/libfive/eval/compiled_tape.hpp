@@ -0,0 +1,91 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace libfive {
+
+/*  Forward declaration */
+class Tape;
+
+/*
+ *  A CompiledTape is a Tape that has been translated into native x86-64
+ *  (AVX) code for array evaluation.
+ *
+ *  The tape is split into segments, in evaluation order.  Each run of
+ *  supported clauses (arithmetic, min / max, sqrt, etc.) is compiled into
+ *  a single function, which loops over the result array in 8-wide blocks
+ *  and keeps recently-used results in SIMD registers.  Other clauses
+ *  (transcendental functions, oracles, etc.) are left to the interpreter,
+ *  as are tapes whose result arrays are too large to benefit.
+ *
+ *  Compiled code expects results to be stored in a row-major float array,
+ *  with one row of (stride) floats per result slot.
+ */
+class CompiledTape
+{
+public:
+    /*  Returns true if native code generation is supported on this build
+     *  and CPU, at the current SIMD level (see simd.hpp)  */
+    static bool available();
+
+    /*  Compiles the given tape.  If code generation is not available,
+     *  every clause is left to the interpreter. */
+    CompiledTape(const Tape& tape, size_t stride);
+    ~CompiledTape();
+
+    CompiledTape(const CompiledTape&)=delete;
+    CompiledTape& operator=(const CompiledTape&)=delete;
+
+    /*  Signature of compiled code:
+     *      data is the first element of the result array
+     *      blocks is the number of 8-float blocks to evaluate
+     *      masks is a table of constants used by generated code */
+    using Function = void (*)(float* data, uint64_t blocks,
+                              const float* masks);
+
+    /*  A run of clauses, as indices into the tape in evaluation order
+     *  (i.e. relative to Tape::rbegin).  If fn is null, then the
+     *  clauses must be evaluated by the interpreter.  */
+    struct Segment
+    {
+        Function fn;
+        size_t begin;
+        size_t end;
+    };
+
+    const std::vector<Segment>& segments() const { return segs; }
+
+    /*  Row stride (in floats) that this tape was compiled for */
+    size_t stride() const { return row_stride; }
+
+    /*  Runs a compiled segment on the given number of 8-float blocks */
+    void call(const Segment& s, float* data, size_t blocks) const;
+
+    /*  Returns the number of clauses that were compiled to native code */
+    size_t compiledCount() const { return compiled_count; }
+
+protected:
+    std::vector<Segment> segs;
+    size_t row_stride;
+    size_t compiled_count=0;
+
+    /*  Table of constants (masks and immediates) used by compiled code,
+     *  stored as the bits of 8-float blocks */
+    std::vector<uint32_t> consts;
+
+    /*  Executable memory holding every compiled segment */
+    void* code=nullptr;
+    size_t code_size=0;
+};
+
+}   // namespace libfive
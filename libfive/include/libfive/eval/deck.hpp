@@ -8,10 +8,13 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
+#include <unordered_map>
+
 #include <boost/bimap.hpp>
 
 #include "libfive/tree/tree.hpp"
 #include "libfive/eval/clause.hpp"
+#include "libfive/eval/tape.hpp"
 #include "libfive/oracle/oracle.hpp"
 
 namespace libfive {
@@ -22,7 +25,10 @@ namespace libfive {
  *  mapping.
  *
  *  When evaluating, you should have one Deck per thread, because
- *  Oracles are stored on a per-Deck basis.
+ *  Oracles and temporary storage for pushing are stored on a per-Deck basis.
+ *  However, everything that is derived from the Tree (the base tape,
+ *  constants, variables, and so on) lives in a read-only Deck::Shared,
+ *  which is built once and can be used by any number of Decks.
  *
  *  The deck contains a list of constants and variables which are used
  *  to construct Evaluators, and pointers to Oracles that are used during
@@ -31,21 +37,80 @@ namespace libfive {
 class Deck
 {
 public:
+    /*
+     *  The read-only part of a Deck, built from a Tree.
+     *
+     *  This is safe to share between threads, so multi-threaded renderers
+     *  should build one Shared and then construct a Deck per thread from it,
+     *  rather than flattening the same Tree once per thread.
+     */
+    struct Shared
+    {
+        Shared(const Tree& root);
+
+        Shared(const Shared&)=delete;
+        Shared& operator=(const Shared& other)=delete;
+
+        /*  Indices of X, Y, Z coordinates */
+        Clause::Id X, Y, Z;
+
+        /*  Constants, unpacked from the tree at construction */
+        std::vector<std::pair<Clause::Id, float>> constants;
+
+        /*  Map of variables (in terms of where they live in this Evaluator)
+         *  to their ids in their respective Tree (e.g. what you get when
+         *  calling Tree::var().id() */
+        boost::bimap<Clause::Id, Tree::Id> vars;
+
+        /*  See Deck::invariant  */
+        std::vector<Clause> invariant;
+
+        /*  ORACLE trees, in the order used by the ORACLE opcode.
+         *  Each Deck builds its own Oracle instances from these.  */
+        std::vector<Tree> oracles;
+
+        /*  See Deck::num_clauses and Deck::num_slots  */
+        size_t num_clauses;
+        size_t num_slots;
+
+        /*  This is the top-level tape.  It is never modified after
+         *  construction, so can be pushed from multiple threads.  */
+        std::shared_ptr<Tape> tape;
+
+        /*  inputs[id] marks clauses that aren't in the tape (X/Y/Z,
+         *  variables, constants, and invariant clauses), and slots[id] is their fixed result
+         *  slot (or 0 for clauses in the tape).  Constants are marked with
+         *  Tape::CONSTANT_INPUT, and values[id] holds their value. */
+        std::vector<uint8_t> inputs;
+        std::vector<Clause::Id> slots;
+        std::vector<float> values;
+    };
+
     Deck(const Tree& root);
+    Deck(std::shared_ptr<const Shared> shared);
 
     Deck(const Deck&)=delete;
     Deck& operator=(const Deck& other)=delete;
 
+    /*  Read-only data, which may be shared with other Decks */
+    const std::shared_ptr<const Shared> shared;
+
     /*  Indices of X, Y, Z coordinates */
-    Clause::Id X, Y, Z;
+    const Clause::Id X, Y, Z;
 
     /*  Constants, unpacked from the tree at construction */
-    std::vector<std::pair<Clause::Id, float>> constants;
+    const std::vector<std::pair<Clause::Id, float>>& constants;
 
     /*  Map of variables (in terms of where they live in this Evaluator) to
      *  their ids in their respective Tree (e.g. what you get when calling
      *  Tree::var().id() */
-    boost::bimap<Clause::Id, Tree::Id> vars;
+    const boost::bimap<Clause::Id, Tree::Id>& vars;
+
+    /*  Clauses which only depend on constants and variables, so have the
+     *  same value at every point.  These aren't in the tape; instead,
+     *  they're given fixed result slots (like variables), and evaluators
+     *  compute them (in this order) whenever a variable changes.  */
+    const std::vector<Clause>& invariant;
 
     /*  Oracles are also unpacked from the tree at construction, and
      *  stored in this flat list.  The ORACLE opcode takes an index into
@@ -54,18 +119,40 @@ public:
 
     /*  Stores the total number of clauses (including X/Y/Z, oracles,
      *  variables, and constants, which aren't explicitly in the tape).
+     *  This is the size of the clause id space used when pushing tapes. */
+    const size_t num_clauses;
+
+    /*  Stores the number of result slots needed to evaluate any tape
+     *  produced by this Deck.  Clause outputs are register-allocated
+     *  into slots 1 through (number of slots used by the base tape), and
+     *  X/Y/Z, variables, constants, and invariant clauses are given fixed
+     *  slots after them.
+     *
      *  This is used by Evaluators to decide how many memory slots to allocate
-     *  for results during Tape evaluation. */
-    size_t num_clauses;
+     *  for results during Tape evaluation (remember to add one, as the slot
+     *  with id = 0 is a placeholder). */
+    const size_t num_slots;
 
     /*  This is the top-level tape associated with this Deck. */
-    std::shared_ptr<Tape> tape;
+    const std::shared_ptr<Tape> tape;
 
-    /*  Moves this tape into the spares bin, so it can be reused later */
+    /*  Moves this tape into the spares bin, so it can be reused later.
+     *  Tapes which are still in use elsewhere (e.g. in the tape cache)
+     *  are left alone. */
     void claim(std::shared_ptr<Tape>&& tape) {
-        spares.push_back(tape);
+        if (tape.use_count() == 1) {
+            spares.push_back(tape);
+        }
     }
 
+    /*  Hit and miss counts for the cache of interval tapes  */
+    struct CacheStats
+    {
+        size_t hits=0;
+        size_t misses=0;
+    };
+    const CacheStats& cacheStats() const { return stats; }
+
     /*
      *  Binds all oracles to the contexts in the given tape
      */
@@ -77,13 +164,34 @@ public:
     void unbindOracles();
 
 protected:
-    /*  Temporary storage, used when pushing into a Tape  */
+    /*  Temporary storage, used when pushing into a Tape.  Between pushes,
+     *  disabled is all true and remap is all zero; each push only touches
+     *  (and then restores) the entries for clauses in its own tape.  */
     std::vector<uint8_t> disabled;
     std::vector<Clause::Id> remap;
 
+    /*  Temporary storage, used when register-allocating a pushed Tape */
+    Tape::Slots slots;
+
     /*  We can keep spare tapes around, to avoid reallocating their data */
     std::vector<std::shared_ptr<Tape>> spares;
 
+    /*
+     *  Looks for a cached tape with the same parent and clauses as the
+     *  given tape, returning it if found.  Otherwise, stores the tape in
+     *  the cache and returns it unchanged.
+     *
+     *  This is used for INTERVAL tapes, since neighboring cells often make
+     *  the same choices and can share a single (already-allocated) tape.
+     */
+    std::shared_ptr<Tape> intern(const std::shared_ptr<Tape>& tape);
+
+    /*  Cached tapes, keyed by Tape::hash().  The cache keeps its tapes
+     *  alive, so it's cleared once it holds MAX_CACHED_TAPES.  */
+    std::unordered_multimap<size_t, std::shared_ptr<Tape>> cache;
+    static constexpr size_t MAX_CACHED_TAPES = 4096;
+    CacheStats stats;
+
     friend class Tape;
 };
 
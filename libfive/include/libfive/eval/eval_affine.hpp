@@ -0,0 +1,105 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Eigen>
+
+#include "libfive/eval/eval_interval.hpp"
+
+namespace libfive {
+
+/*
+ *  The AffineEvaluator tightens interval evaluation with affine arithmetic.
+ *
+ *  Each clause's result is tracked as an affine form
+ *      center + tx * ex + ty * ey + tz * ez + err * e
+ *  where ex, ey, ez are noise symbols in [-1, 1] that stand for position
+ *  within the box along each axis, and e is a single symbol that absorbs
+ *  every other source of error (i.e. the AF1 flavor of affine arithmetic).
+ *  Because the input axes stay correlated through linear operations,
+ *  rotated and sheared shapes don't suffer from the dependency problem
+ *  of plain interval arithmetic.
+ *
+ *  Common nonlinear functions are approximated by linear functions plus
+ *  an error term;  everything else falls back to the interval result.
+ *  Every clause's interval is replaced by its intersection with the
+ *  affine form's range, so results (and pushed tapes) are never looser
+ *  than those from IntervalEvaluator.  Affine evaluation always uses the
+ *  BOOST backend for the underlying interval arithmetic.
+ */
+class AffineEvaluator : public IntervalEvaluator
+{
+public:
+    AffineEvaluator(const Tree& root);
+    AffineEvaluator(const Tree& root,
+                    const std::map<Tree::Id, float>& vars);
+    AffineEvaluator(std::shared_ptr<Deck> d);
+    AffineEvaluator(std::shared_ptr<Deck> d,
+                    const std::map<Tree::Id, float>& vars);
+
+    /*
+     *  Affine evaluation, returning an interval that bounds the result
+     */
+    Interval evalAffine(const Eigen::Vector3f& lower,
+                        const Eigen::Vector3f& upper);
+    Interval evalAffine(const Eigen::Vector3f& lower,
+                        const Eigen::Vector3f& upper,
+                        const std::shared_ptr<Tape>& tape);
+
+    /*
+     *  Evaluates with affine arithmetic, then returns the result and a
+     *  shortened tape (which is equivalent to intervalAndPush, but may
+     *  be able to prune more branches).
+     */
+    std::pair<Interval, std::shared_ptr<Tape>> affineAndPush(
+            const Eigen::Vector3f& lower,
+            const Eigen::Vector3f& upper);
+    std::pair<Interval, std::shared_ptr<Tape>> affineAndPush(
+            const Eigen::Vector3f& lower,
+            const Eigen::Vector3f& upper,
+            const std::shared_ptr<Tape>& tape);
+
+    /*  An affine form, with the meaning described above.  Values are
+     *  stored as doubles, and every operation adds a conservative bound
+     *  on its rounding error into err.  */
+    struct Form
+    {
+        double center;
+        Eigen::Vector3d terms;
+        double err;
+
+        /*  Returns the largest possible distance from the center */
+        double radius() const { return terms.cwiseAbs().sum() + err; }
+    };
+
+protected:
+    /*  Builds an affine form that covers the given interval, with all
+     *  of its range in the error term  */
+    static Form fromInterval(const Interval& i);
+
+    /*  Returns the form for the given slot, which is either the result of
+     *  a clause from the current walk or derived from the interval array
+     *  (for constants, variables, and invariant clauses)  */
+    Form form(Clause::Id id) const;
+
+    /*  Per-clause evaluation, used in tape walking */
+    void affine(Opcode::Opcode op, Clause::Id id,
+                Clause::Id a, Clause::Id b);
+
+    /*  f[clause] is the affine form for that clause, and is only valid
+     *  if stamp[clause] matches the current walk's generation.  These
+     *  arrays are allocated on first use.  */
+    std::vector<Form> f;
+    std::vector<uint32_t> stamp;
+    uint32_t generation=0;
+};
+
+}   // namespace libfive
@@ -24,7 +24,8 @@ public:
                    const std::map<Tree::Id, float>& vars);
     ArrayEvaluator(std::shared_ptr<Deck> t);
     ArrayEvaluator(std::shared_ptr<Deck> t,
-                   const std::map<Tree::Id, float>& vars);
+                   const std::map<Tree::Id, float>& vars,
+                   size_t width=N);
 
     /*
      *  Stores the given value in the result arrays
@@ -55,10 +56,33 @@ public:
         set(v, index);
     }
 
-    /*  This is the number of samples that we can process in one pass */
+    /*  This is the default number of samples that we can process in one
+     *  pass.  Evaluators can be built with a different width, e.g. narrow
+     *  ones for meshing (which only evaluates a handful of points at once)
+     *  or wide ones for rendering images. */
     static constexpr size_t N=LIBFIVE_EVAL_ARRAY_SIZE;
 
+    /*  Returns the number of samples that this evaluator can process in
+     *  one pass (chosen at construction)  */
+    size_t width() const { return batch_width; }
+
+    /*  Selects how tapes are evaluated in values()
+     *      INTERPRETER walks the tape, dispatching on each clause's opcode
+     *      JIT runs native code compiled from the tape (see CompiledTape),
+     *          falling back to the interpreter for unsupported clauses */
+    enum Backend { INTERPRETER, JIT };
+
+    /*  Changes the backend, returning false (and leaving the backend
+     *  unchanged) if the requested backend isn't available. */
+    bool setBackend(Backend b);
+    Backend getBackend() const { return backend; }
+
 protected:
+    Backend backend=INTERPRETER;
+
+    /*  See width()  */
+    const size_t batch_width;
+
     /*  Stored in values() and used in operator() to decide how much of the
      *  array we're addressing at once.  count_simd is rounded up to the
      *  nearest SIMD block size; count_actual is the actual count. */
@@ -68,11 +92,13 @@ protected:
     /*  Sets count_simd and count_actual based on count */
     void setCount(size_t count);
 
-    /*  v(clause, index) is a specific data point */
-    Eigen::Array<float, Eigen::Dynamic, N, Eigen::RowMajor> v;
+    /*  v(clause, index) is a specific data point.  There may be a few more
+     *  columns than width(), since evaluation is rounded up to whole
+     *  SIMD blocks (see setCount). */
+    Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> v;
 
     /*  ambig(index) returns whether a particular slot is ambiguous */
-    Eigen::Array<bool, 1, N> ambig;
+    Eigen::Array<bool, 1, Eigen::Dynamic> ambig;
 
     /*
      *  Per-clause evaluation, used in tape walking
@@ -80,6 +106,10 @@ protected:
     void operator()(Opcode::Opcode op, Clause::Id id,
                     Clause::Id a, Clause::Id b);
 
+    /*  Evaluates the Deck's invariant clauses, which must be done
+     *  whenever a variable changes  */
+    void updateInvariant();
+
 public:
     /*
      *  Multi-point evaluation (values must be stored with set)
@@ -112,6 +142,13 @@ public:
      */
     bool setVar(Tree::Id var, float value);
 
+    /*
+     *  Changes many variables at once, only re-evaluating clauses that
+     *  depend on variables (but not on X, Y, Z) a single time.
+     *  Returns true if any variable's value changes
+     */
+    bool updateVars(const std::map<Tree::Id, float>& vars);
+
     /*
      *  Returns a list of ambiguous items from indices 0 to i
      *
@@ -22,14 +22,15 @@ public:
                         const std::map<Tree::Id, float>& vars);
     DerivArrayEvaluator(std::shared_ptr<Deck> t);
     DerivArrayEvaluator(std::shared_ptr<Deck> t,
-                        const std::map<Tree::Id, float>& vars);
+                        const std::map<Tree::Id, float>& vars,
+                        size_t width=N);
 
 protected:
     /*  d(clause).col(index) is a set of partial derivatives [dx, dy, dz] */
-    Eigen::Array<Eigen::Array<float, 3, N>, Eigen::Dynamic, 1> d;
+    Eigen::Array<Eigen::Array<float, 3, Eigen::Dynamic>, Eigen::Dynamic, 1> d;
 
     /*  out(col) is a result [dx, dy, dz, w] */
-    Eigen::Array<float, 4, N> out;
+    Eigen::Array<float, 4, Eigen::Dynamic> out;
 
     /* When evaluating from a parent JacobianEvaluator, we want the
      * CONST_VARS opcode to clear the derivatives, which is special-cased
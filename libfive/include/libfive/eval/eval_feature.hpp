@@ -30,7 +30,8 @@ public:
     FeatureEvaluator(const Tree& root);
     FeatureEvaluator(std::shared_ptr<Deck> d);
     FeatureEvaluator(std::shared_ptr<Deck> d,
-                     const std::map<Tree::Id, float>& vars);
+                     const std::map<Tree::Id, float>& vars,
+                     size_t width=N);
 
     /*
      *  Checks to see if the given point is inside the solid body.
@@ -87,6 +88,12 @@ protected:
     void operator()(Opcode::Opcode op, Clause::Id id,
                     Clause::Id a, Clause::Id b);
 
+    /*
+     *  Evaluates values (in slot 0) and features for every clause
+     *  in the given tape.  Point values must already be stored with set.
+     */
+    void walk(const Tape& tape);
+
     /*  Raw feature data */
     Eigen::Array<boost::container::small_vector<Feature, 4>,
                  1, Eigen::Dynamic> f;
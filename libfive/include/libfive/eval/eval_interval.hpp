@@ -8,6 +8,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
+#include <vector>
+
 #include <Eigen/Eigen>
 
 #include "libfive/eval/base.hpp"
@@ -46,6 +48,51 @@ public:
             const Eigen::Vector3f& upper,
             const std::shared_ptr<Tape>& tape);
 
+    /*  Selects how eval() and intervalAndPush() do interval arithmetic
+     *      BOOST uses boost::numeric::interval, which switches the FPU
+     *          rounding mode for every clause
+     *      SIMD runs the batch kernels (see evalBatch) on a single box,
+     *          rounding outwards by an ulp instead; results may be slightly
+     *          wider, but always contain the BOOST result  */
+    enum Backend { BOOST, SIMD };
+    void setBackend(Backend b) { backend = b; }
+    Backend getBackend() const { return backend; }
+
+    /*
+     *  Batched interval evaluation
+     *
+     *  Evaluates many boxes (e.g. every child of an octree cell) in a
+     *  single walk of the tape, storing intermediate results as arrays of
+     *  lower and upper bounds so that common clauses run as SIMD kernels.
+     *
+     *  Results are slightly more conservative than eval(): rather than
+     *  changing the FPU rounding mode, the SIMD kernels round outwards
+     *  by at least one ulp.
+     */
+    std::vector<Interval> evalBatch(
+            const std::vector<Eigen::Vector3f>& lower,
+            const std::vector<Eigen::Vector3f>& upper);
+    std::vector<Interval> evalBatch(
+            const std::vector<Eigen::Vector3f>& lower,
+            const std::vector<Eigen::Vector3f>& upper,
+            const std::shared_ptr<Tape>& tape);
+
+    /*
+     *  Evaluates a batch of boxes, then returns the interval result
+     *  and a shortened tape for each box (in the same order).
+     */
+    std::vector<std::pair<Interval, std::shared_ptr<Tape>>>
+    intervalAndPushBatch(const std::vector<Eigen::Vector3f>& lower,
+                         const std::vector<Eigen::Vector3f>& upper,
+                         const std::shared_ptr<Tape>& tape);
+
+    /*
+     *  Returns a shortened tape for a single box from the most recent
+     *  call to evalBatch.
+     */
+    std::shared_ptr<Tape> pushBatch(const std::shared_ptr<Tape>& tape,
+                                    size_t index);
+
     /*
      *  Returns a shortened tape based on the most recent evaluation.
      *
@@ -64,7 +111,25 @@ public:
      */
     bool setVar(Tree::Id var, float value);
 
+    /*
+     *  Sets a variable to a range of values, so that evaluation (and
+     *  pushing) is valid for any value in that range.
+     *
+     *  If the variable isn't present in the tree, does nothing
+     *  Returns true if the variable's value changes
+     */
+    bool setVar(Tree::Id var, Interval value);
+
+    /*
+     *  Changes many variables at once, only re-evaluating clauses that
+     *  depend on variables (but not on X, Y, Z) a single time.
+     *  Returns true if any variable's value changes
+     */
+    bool updateVars(const std::map<Tree::Id, float>& vars);
+
 protected:
+    Backend backend=BOOST;
+
     /*  i[clause] is the interval result for that clause, */
     std::vector<Interval> i;
 
@@ -76,6 +141,50 @@ protected:
      */
     void operator()(Opcode::Opcode op, Clause::Id id,
                     Clause::Id a, Clause::Id b);
+
+    /*  Pushes into the tape based on the single-interval array i,
+     *  regardless of backend  */
+    std::shared_ptr<Tape> pushIntervals(const std::shared_ptr<Tape>& tape);
+
+    /*  Evaluates the Deck's invariant clauses, which must be done
+     *  whenever a variable changes  */
+    void updateInvariant();
+
+    /*  Evaluates a single non-oracle clause on the given intervals */
+    static Interval evalClause(Opcode::Opcode op,
+                               const Interval& a, const Interval& b);
+
+    /*
+     *  Batch results, with one row per slot and one column per box.
+     *  maybe_nan is stored as a separate boolean array.
+     */
+    using BatchArray = Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic,
+                                    Eigen::RowMajor>;
+    BatchArray batch_lower;
+    BatchArray batch_upper;
+    Eigen::Array<bool, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        batch_nan;
+
+    /*  Number of boxes in the most recent batch */
+    size_t batch_count=0;
+
+    /*  Number of columns into which constants and variables have been
+     *  broadcast (reset when variables change)  */
+    size_t batch_broadcast=0;
+
+    /*  Scratch space for batch results, so that kernels can write a
+     *  clause's result into the same slot as one of its inputs.  */
+    Eigen::Array<float, 1, Eigen::Dynamic> batch_lo, batch_hi;
+    Eigen::Array<bool, 1, Eigen::Dynamic> batch_maybe_nan;
+
+    /*  Loads count boxes into the batch arrays and walks the tape  */
+    void walkBatch(const Eigen::Vector3f* lower,
+                   const Eigen::Vector3f* upper, size_t count,
+                   const std::shared_ptr<Tape>& tape);
+
+    /*  Per-clause batch evaluation, used in tape walking */
+    void batch(Opcode::Opcode op, Clause::Id id,
+               Clause::Id a, Clause::Id b);
 };
 
 }   // namespace libfive
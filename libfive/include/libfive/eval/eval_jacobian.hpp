@@ -22,7 +22,8 @@ public:
                       const std::map<Tree::Id, float>& vars);
     JacobianEvaluator(std::shared_ptr<Deck> t);
     JacobianEvaluator(std::shared_ptr<Deck> t,
-                      const std::map<Tree::Id, float>& vars);
+                      const std::map<Tree::Id, float>& vars,
+                      size_t width=N);
 
     /*
      *  Returns the gradient with respect to all VAR nodes
@@ -9,11 +9,11 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #pragma once
 
 #include "libfive/eval/eval_jacobian.hpp"
-#include "libfive/eval/eval_interval.hpp"
+#include "libfive/eval/eval_affine.hpp"
 
 namespace libfive {
 
-class Evaluator : public JacobianEvaluator, public IntervalEvaluator
+class Evaluator : public JacobianEvaluator, public AffineEvaluator
 {
 public:
     Evaluator(const Tree& root) :
@@ -26,10 +26,11 @@ public:
         Evaluator(t, std::map<Tree::Id, float>()) {}
 
     Evaluator(std::shared_ptr<Deck> t,
-              const std::map<Tree::Id, float>& vars) :
+              const std::map<Tree::Id, float>& vars,
+              size_t width=N) :
         BaseEvaluator(t, vars),
-        JacobianEvaluator(t, vars),
-        IntervalEvaluator(t, vars) {}
+        JacobianEvaluator(t, vars, width),
+        AffineEvaluator(t, vars) {}
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -40,12 +41,8 @@ public:
      */
     bool updateVars(const std::map<libfive::Tree::Id, float>& vars)
     {
-        bool changed = false;
-        for (auto& v : vars) {
-            changed |= JacobianEvaluator::setVar(v.first, v.second);
-            changed |= IntervalEvaluator::setVar(v.first, v.second);
-        }
-        return changed;
+        const bool changed = JacobianEvaluator::updateVars(vars);
+        return IntervalEvaluator::updateVars(vars) || changed;
     }
 };
 
@@ -0,0 +1,92 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <cstddef>
+
+#include "libfive/tree/opcode.hpp"
+
+namespace libfive {
+namespace Simd {
+
+/*
+ *  The hot evaluator kernels (elementwise arithmetic in the array,
+ *  derivative, and interval evaluators) are compiled several times, once
+ *  per instruction set level, and the best level supported by the CPU is
+ *  picked at startup.  This means that a single binary runs at full speed
+ *  on AVX-512 machines without crashing on older ones.
+ *
+ *  The LIBFIVE_SIMD environment variable (or setLevel) can be used to
+ *  force a lower level, e.g. for benchmarking.
+ */
+enum Level {
+    BASELINE,   // The default instruction set for the platform
+    AVX2,       // AVX2 and FMA (x86-64 only)
+    AVX512,     // AVX-512F (x86-64 only)
+};
+
+/*  Returns the highest level supported by both this build and the CPU */
+Level detected();
+
+/*  Returns the level that is currently in use  */
+Level level();
+
+/*  Selects a level, returning false (and leaving the level unchanged)
+ *  if it isn't supported.  This isn't synchronized with evaluation, so
+ *  it should only be called when no evaluators are running.  */
+bool setLevel(Level level);
+
+/*  Converts between levels and their names ("baseline", "avx2", "avx512"),
+ *  which are the values accepted by the LIBFIVE_SIMD environment variable.
+ *  fromName returns false if the name isn't recognized. */
+const char* name(Level level);
+bool fromName(const char* name, Level& level);
+
+/*  Returns the number of floats in a SIMD register at the given level */
+size_t blockSize(Level level);
+
+/*
+ *  Table of kernels for a particular level.  Every kernel operates on n
+ *  points, reading and writing through raw pointers.  Outputs may be the
+ *  same as inputs, since each point is handled independently.
+ *
+ *  Kernels return false if they don't handle the given opcode, in which
+ *  case nothing is written.
+ */
+struct Kernels
+{
+    /*  Array evaluation:  out = op(a, b).  Opcodes with an immediate
+     *  take it from k, and b is unused.  */
+    bool (*array)(Opcode::Opcode op, float* out,
+                  const float* a, const float* b, float k, size_t n);
+
+    /*  Derivative evaluation, where derivatives are stored as interleaved
+     *  (x, y, z) triples and v is the clause's value (which must already
+     *  be evaluated).  */
+    bool (*deriv)(Opcode::Opcode op, float* od, const float* v,
+                  const float* av, const float* ad,
+                  const float* bv, const float* bd, float k, size_t n);
+
+    /*  Interval evaluation, with lower and upper bounds and maybe-NaN
+     *  flags stored in separate arrays.  Results are rounded outwards
+     *  without changing the FPU rounding mode.  */
+    bool (*interval)(Opcode::Opcode op, float* olo, float* ohi, bool* onan,
+                     const float* alo, const float* ahi, const bool* anan,
+                     const float* blo, const float* bhi, const bool* bnan,
+                     size_t n);
+};
+
+/*  Returns the kernels for the current level  */
+const Kernels& kernels();
+
+/*  Returns the kernels for a specific level, which must be supported */
+const Kernels& kernels(Level level);
+
+}   // namespace Simd
+}   // namespace libfive
@@ -10,6 +10,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include <Eigen/Eigen>
 
@@ -23,6 +24,7 @@ namespace libfive {
 /*  Foward declarations */
 template <unsigned N> class Region;
 class Deck;
+class CompiledTape;
 
 class Tape : public std::enable_shared_from_this<Tape>
 {
@@ -42,8 +44,10 @@ public:
 
     typedef std::shared_ptr<Tape> Handle;
 
-    /*  Returns tape length (used in unit tests to check for shrinkage) */
-    size_t size() const { return t.size(); }
+    /*  Returns the number of clauses that are evaluated (used in unit tests
+     *  to check for shrinkage).  This may be fewer than the clauses in the
+     *  Tree, since lowering folds constants and fuses common patterns. */
+    size_t size() const { return allocated.size(); }
 
     /*  Returns the assigned context from this tape */
     std::shared_ptr<OracleContext> getContext(unsigned i) const;
@@ -55,18 +59,44 @@ public:
      */
     bool isTerminal() const { return terminal; }
 
+    /*  Iterators over the register-allocated tape, in evaluation order.
+     *  Clause ids and arguments are result slots, rather than the
+     *  clause ids used when pushing. */
     std::vector<Clause>::const_reverse_iterator rbegin() const
-    { return t.crbegin(); }
+    { return allocated.crbegin(); }
 
     std::vector<Clause>::const_reverse_iterator rend() const
-    { return t.crend(); }
+    { return allocated.crend(); }
 
-    Clause::Id root() const { return i; }
+    /*  Returns the result slot of the tape's root  */
+    Clause::Id root() const { return root_slot; }
+
+    /*
+     *  Returns this tape compiled to native code, for array evaluation
+     *  with the given row stride (in floats).
+     *
+     *  The compiled tape is cached, so a tape that is evaluated many times
+     *  is only compiled once.  This is thread-safe, since the base tape
+     *  may be shared between Decks in different threads.
+     */
+    std::shared_ptr<const CompiledTape> compiled(size_t stride) const;
 
 protected:
     /*  The tape itself, as a vector of clauses  */
     std::vector<Clause> t;
 
+    /*  The same tape, lowered (see lower) and with clause ids replaced by
+     *  result slots.  Slots are reused once a clause's result is no longer
+     *  needed, so evaluators only need storage for the live width of the
+     *  tape. */
+    std::vector<Clause> allocated;
+    Clause::Id root_slot;
+
+    /*  index[k] is the position in allocated of the clause that computes
+     *  t[k].  This is only valid for clauses which aren't folded into
+     *  another clause when lowering, which includes every min and max. */
+    std::vector<uint32_t> index;
+
     /*  OracleContext handles used to speed up oracle evaluation
      *  by letting them push into the tree as well. */
     std::vector<std::shared_ptr<OracleContext>> contexts;
@@ -86,11 +116,16 @@ protected:
      *  to traverse up through the tape. */
     Handle parent;
 
+    /*  Cached native code for this tape (built on demand in compiled) */
+    mutable std::shared_ptr<const CompiledTape> jit;
+    mutable std::mutex jit_lock;
+
 public:
     /*
      *  Returns a new tape that is specialized with the given function.
      *
      *  fn must be a callable that tells us which side of each clause to keep
+     *  (it is only called for min and max clauses)
      *  t is a tape type
      *  r is the relevant region (or an empty region by default)
      */
@@ -99,6 +134,16 @@ public:
     Handle push(Deck& deck, KeepFunction fn, Type t);
     Handle push(Deck& deck, KeepFunction fn, Type t, const Region<3>& r);
 
+    /*
+     *  Templated version of push, which lets the keep function be inlined
+     *  (rather than called through a std::function for every clause).
+     *
+     *  This is defined in src/eval/tape.inl, so it's only available to
+     *  evaluators within libfive; other callers use the overloads above.
+     */
+    template <typename F>
+    Handle push(Deck& deck, const F& fn, Type t, const Region<3>& r);
+
     /*
      *  Walks up the tape list until p is within the tape's region, then
      *  returns a Handle that restores the original tape.
@@ -110,6 +155,71 @@ public:
     Handle getBase(const Eigen::Vector3f& p);
     Handle getBase(const Region<3>& r);
 
+    /*  Working memory for lowering and register allocation, indexed by
+     *  clause id.  slot[id] holds the fixed slots of inputs (X/Y/Z,
+     *  variables, and constants), and is overwritten for clauses in the
+     *  tape.  uses is all zero between calls to lower.  */
+    struct Slots
+    {
+        std::vector<Clause::Id> slot;
+        std::vector<uint32_t> last_use;
+        std::vector<Clause::Id> free;
+
+        std::vector<uint32_t> uses;
+        std::vector<uint32_t> pos;
+        std::vector<Clause> lowered;
+    };
+
+    /*  Value of Deck::Shared::inputs for constants, which can be folded
+     *  into their users as immediate operands (other inputs are 1)  */
+    static constexpr uint8_t CONSTANT_INPUT = 2;
+
+protected:
+    /*
+     *  Lowers the tape into s.lowered, which is the form that evaluators
+     *  actually run:
+     *      Arithmetic with a constant argument becomes an _IMM clause,
+     *      so that it doesn't need to read the constant's result slot.
+     *      Sums of squares (and their square roots) are fused into a
+     *      single clause, where the intermediate results aren't used
+     *      anywhere else.
+     *  Clause ids are unchanged, and values[id] holds the value of
+     *  constants (which are marked with CONSTANT_INPUT in inputs).
+     */
+    void lower(const std::vector<uint8_t>& inputs,
+               const std::vector<float>& values, Slots& s) const;
+
+    /*
+     *  Assigns a result slot to every clause in the lowered tape (in
+     *  s.lowered), using liveness
+     *  analysis in evaluation order, and storing results in s.slot.
+     *  inputs[id] marks clauses that aren't in the tape.
+     *
+     *  Arguments to min and max clauses (and the root) are kept alive
+     *  until the end of the tape, because push() and the getAmbiguous
+     *  family of functions read them after evaluation is complete.
+     *
+     *  Returns the number of slots used.
+     */
+    size_t assignSlots(const std::vector<uint8_t>& inputs, Slots& s);
+
+    /*  Populates allocated (plus root_slot and index) based on the lowered
+     *  tape and slots from assignSlots */
+    void writeSlots(const Slots& s);
+
+    /*
+     *  Restores deck.disabled and deck.remap to their resting state
+     *  (all true and all zero) after pushing this tape, touching only
+     *  the entries that push could have changed.
+     */
+    void resetPushState(Deck& deck) const;
+
+    /*  Hashes the parent, root, clauses, and oracle contexts.  Two tapes
+     *  pushed from the same parent with the same choices will have the
+     *  same hash (and compare equal with sameAs).  */
+    size_t hash() const;
+    bool sameAs(const Tape& other) const;
+
     friend class Deck;
 };
 
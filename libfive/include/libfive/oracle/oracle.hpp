@@ -33,7 +33,9 @@ public:
     /*
      *  Sets a particular position value, for use in any of the eval functions.
      *  This should be O(1) for best performance.
-     *  The oracle must accept 0 <= index < LIBFIVE_EVAL_ARRAY_SIZE.
+     *  The oracle must accept any index below the width of the evaluator
+     *  that is calling it (see ArrayEvaluator::width), which isn't known
+     *  ahead of time, so storage should grow as needed.
      */
     virtual void set(const Eigen::Vector3f& p, size_t index=0)=0;
 
@@ -74,8 +76,7 @@ public:
      */
     virtual void evalArray(
             Eigen::Block<Eigen::Array<float, Eigen::Dynamic,
-                                      LIBFIVE_EVAL_ARRAY_SIZE,
-                                      Eigen::RowMajor>,
+                                      Eigen::Dynamic, Eigen::RowMajor>,
                          1, Eigen::Dynamic> out)
     {
         for (unsigned i=0; i < out.cols(); ++i)
@@ -96,7 +97,7 @@ public:
      *  (with the same result block size).
      */
     virtual void checkAmbiguous(
-            Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
                          1, Eigen::Dynamic> out)=0;
 
     /*
@@ -122,7 +123,7 @@ public:
      *  (with the same output block size).
      */
     virtual void evalDerivArray(
-            Eigen::Block<Eigen::Array<float, 3, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<float, 3, Eigen::Dynamic>,
                          3, Eigen::Dynamic, true> out)
     {
         Eigen::Array<float, 3, Eigen::Dynamic> dummy(3, out.cols());
@@ -9,6 +9,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #pragma once
 
+#include <algorithm>
+
 #include <Eigen/Eigen>
 
 #include "libfive/oracle/oracle.hpp"
@@ -16,12 +18,22 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 namespace libfive {
 
+/*  N is the initial number of points, which grows if an evaluator
+ *  sets a point beyond it.  */
 template <int N=LIBFIVE_EVAL_ARRAY_SIZE>
 class OracleStorage : public Oracle
 {
 public:
+    // Points are zero-initialized, to prevent Valgrind warnings
+    OracleStorage() : points(decltype(points)::Zero(3, N)) {}
+
     void set(const Eigen::Vector3f& p, size_t index=0) override
     {
+        if (index >= static_cast<size_t>(points.cols()))
+        {
+            points.conservativeResizeLike(decltype(points)::Zero(
+                3, std::max<Eigen::Index>(index + 1, 2 * points.cols())));
+        }
         points.col(index) = p;
     }
 
@@ -57,7 +69,7 @@ public:
 
 protected:
     /* Local storage for set(Vector3f) */
-    Eigen::Array<float, 3, N> points;
+    Eigen::Array<float, 3, Eigen::Dynamic> points;
 
     /* Local storage for set(Interval) */
     Eigen::Vector3f lower;
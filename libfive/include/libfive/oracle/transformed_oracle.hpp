@@ -34,11 +34,11 @@ public:
 
     void evalArray(
         Eigen::Block<Eigen::Array<float, Eigen::Dynamic,
-                     LIBFIVE_EVAL_ARRAY_SIZE,Eigen::RowMajor>,
+                     Eigen::Dynamic, Eigen::RowMajor>,
                      1, Eigen::Dynamic> out) override;
 
     void checkAmbiguous(
-        Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+        Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
                      1, Eigen::Dynamic> out) override;
 
     void evalDerivs(
@@ -46,7 +46,7 @@ public:
                      3, 1, true> out, size_t index=0) override;
 
     void evalDerivArray(
-        Eigen::Block<Eigen::Array<float, 3, LIBFIVE_EVAL_ARRAY_SIZE>,
+        Eigen::Block<Eigen::Array<float, 3, Eigen::Dynamic>,
                      3, Eigen::Dynamic, true> out) override;
 
     void evalFeatures(
@@ -69,10 +69,14 @@ private:
         bool isTerminal() override;
     };
 
+    /*  Rebuilds the evaluators with the given width, which is needed when
+     *  the calling evaluator is wider than they are.  */
+    void widen(size_t width);
+
     const std::unique_ptr<Oracle> underlying;
-    Evaluator xEvaluator;
-    Evaluator yEvaluator;
-    Evaluator zEvaluator;
+    std::unique_ptr<Evaluator> xEvaluator;
+    std::unique_ptr<Evaluator> yEvaluator;
+    std::unique_ptr<Evaluator> zEvaluator;
 };
 
 
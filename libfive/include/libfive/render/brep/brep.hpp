@@ -15,6 +15,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <Eigen/StdVector>
 
 #include "libfive/render/brep/per_thread_brep.hpp"
+#include "libfive/render/brep/task_queue.hpp"
+#include "libfive/render/thread_pool.hpp"
 
 namespace libfive {
 
@@ -47,9 +49,10 @@ public:
      *
      *  If workers is 0, spins up one thread per child, otherwise spins
      *  up the requested number of threads to do the merge in parallel.
+     *  If pool is provided, then the threads are run as jobs in the pool.
      */
     void collect(const std::vector<PerThreadBRep<N>>& children,
-                 unsigned workers=0)
+                 unsigned workers=0, ThreadPool* pool=nullptr)
     {
         assert(verts.size() == 1);
         assert(branes.size() == 0);
@@ -69,13 +72,31 @@ public:
         verts.resize(num_verts);
         branes.resize(num_branes);
 
+        // Figure out where to position each child's branes in the
+        // collecting branes array, using a simple offset from the start.
+        std::vector<size_t> offsets(children.size());
+        for (unsigned j=1; j < children.size(); ++j) {
+            offsets[j] = offsets[j - 1] + children[j - 1].branes.size();
+        }
+
+        // Deal the children out between the workers, which steal from
+        // each other if they finish early (since children can be very
+        // different sizes).
+        TaskQueue<unsigned> tasks(workers);
+        for (unsigned j=0; j < children.size(); ++j) {
+            tasks.push(j % workers, j);
+        }
+
         std::vector<std::future<void>> futures;
         futures.resize(workers);
 
         for (unsigned i=0; i < workers; ++i) {
-            futures[i] = std::async(std::launch::async,
-                [i, workers, this, &children]() {
-                    for (unsigned j=i; j < children.size(); j += workers) {
+            futures[i] = ThreadPool::run(pool,
+                [i, this, &children, &offsets, &tasks]() {
+                    // No new tasks are pushed once we've started, so we're
+                    // done as soon as every worker's deque is empty.
+                    unsigned j;
+                    while (tasks.pop(i, j)) {
                         const auto& c = children[j];
 
                         // Unpack vertices, which all have unique indexes into
@@ -84,17 +105,9 @@ public:
                             verts.at(c.indices.at(k)) = c.verts.at(k);
                         }
 
-                        // Figure out where to position the branes in the
-                        // collecting branes array, using a simple offset
-                        // from the start.
-                        size_t offset = 0;
-                        for (unsigned k=0; k < j; ++k) {
-                            offset += children[k].branes.size();
-                        }
-
                         // Then save all of the branes
                         for (unsigned k=0; k < c.branes.size(); ++k) {
-                            branes[offset + k] = c.branes[k];
+                            branes[offsets[j] + k] = c.branes[k];
                         }
                     }
                 }
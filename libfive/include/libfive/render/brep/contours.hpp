@@ -19,6 +19,7 @@ namespace libfive {
 template <unsigned N> class PerThreadBRep;
 class Evaluator;
 struct BRepSettings;
+class ThreadPool;
 
 class Contours {
 public:
@@ -36,8 +37,10 @@ public:
 
     /*
      *  Merge together a set of contours, welding continuous paths
+     *  (workers and pool are passed through to BRep::collect)
      */
-    void collect(const std::vector<PerThreadBRep<2>>& children);
+    void collect(const std::vector<PerThreadBRep<2>>& children,
+                 unsigned workers=0, ThreadPool* pool=nullptr);
 
     /*  Contours in 2D space  */
     std::vector<std::vector<Eigen::Vector2f>> contours;
@@ -114,6 +114,15 @@ public:
                                        const std::shared_ptr<Tape>& tape,
                                        Pool& object_pool);
 
+    /*
+     *  As above, but using an interval result and pushed tape that were
+     *  already computed (e.g. in a batch with this tree's siblings).
+     */
+    std::shared_ptr<Tape> evalInterval(
+            Evaluator* eval, const std::shared_ptr<Tape>& tape,
+            Pool& object_pool,
+            std::pair<Interval, std::shared_ptr<Tape>> o);
+
     /*
      *  Evaluates and stores a result at every corner of the cell.
      *  Sets type to FILLED / EMPTY / AMBIGUOUS based on the corner values.
@@ -124,6 +133,21 @@ public:
                   Pool& spare_leafs,
                   const DCNeighbors<N>& neighbors);
 
+    /*
+     *  Equivalent to calling evalLeaf on each of the given trees (which
+     *  must share a tape), but gathers their corner evaluations and edge
+     *  searches into shared batches, to make better use of the evaluator.
+     *
+     *  Trees in the batch don't see each other as neighbors, so edges that
+     *  they share are searched (with identical results) by each of them.
+     */
+    static void evalLeaves(Evaluator* eval,
+                           const std::shared_ptr<Tape>& tape,
+                           Pool& object_pool,
+                           DCTree<N>* const* trees,
+                           const DCNeighbors<N>* neighbors,
+                           unsigned count);
+
     /*
      *  If all children are present, then collapse based on the error
      *  metrics from the combined QEF (or interval filled / empty state).
@@ -208,6 +232,7 @@ public:
     void releaseTo(Pool& object_pool);
 
     static constexpr bool hasSingletons() { return true; }
+    static constexpr bool hasLeafBatching() { return true; }
     static DCTree<N>* singletonEmpty() {
         static DCTree<N> empty(Interval::EMPTY);
         return &empty;
@@ -234,6 +259,14 @@ protected:
      */
     double findVertex(unsigned i=0);
 
+    /*
+     *  Builds the QEF matrices and mass point for the next vertex from the
+     *  intersections on the given edges (which must all be populated),
+     *  then solves for the vertex and increments the leaf's vertex count.
+     */
+    void placeVertex(const std::array<size_t, _edges(N)>& edges,
+                     unsigned edge_count);
+
     /*
      *  Writes the given intersection into the intersections list
      *  for the specified edge.  Allocates an interesections list
@@ -8,16 +8,15 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
-#include <stack>
-#include <boost/lockfree/stack.hpp>
-
 #include "libfive/render/brep/per_thread_brep.hpp"
 #include "libfive/render/brep/free_thread_handler.hpp"
 #include "libfive/render/brep/settings.hpp"
 #include "libfive/render/brep/mesh.hpp"
 #include "libfive/render/brep/root.hpp"
+#include "libfive/render/brep/task_queue.hpp"
 
 #include "libfive/render/axes.hpp"
+#include "libfive/render/thread_pool.hpp"
 #include "libfive/eval/interval.hpp"
 
 namespace libfive {
@@ -55,18 +54,20 @@ public:
       *
       *  The factory can be anything that spits out valid M objects,
       *  given a PerThreadBRep and worker index.
+      *
+      *  If a sink is provided, then the model is streamed into it as it
+      *  is generated, and the returned object is left empty.
       */
     template<typename M>
     static std::unique_ptr<typename M::Output> walk_(
             const Root<typename M::Input>& t,
             const BRepSettings& settings,
-            std::function<M(PerThreadBRep<N>&, int)> MesherFactory);
+            std::function<M(PerThreadBRep<N>&, int)> MesherFactory,
+            BRepSink<N>* sink=nullptr);
 
 protected:
     template<typename T, typename Mesher>
-    static void run(Mesher& m,
-                    boost::lockfree::stack<const T*,
-                                           boost::lockfree::fixed_sized<true>>& tasks,
+    static void run(Mesher& m, TaskQueue<const T*>& tasks, unsigned index,
                     const BRepSettings& settings,
                     std::atomic_bool& done);
 
@@ -250,18 +251,19 @@ template<typename M>
 std::unique_ptr<typename M::Output> Dual<N>::walk_(
             const Root<typename M::Input>& t,
             const BRepSettings& settings,
-            std::function<M(PerThreadBRep<N>&, int)> MesherFactory)
+            std::function<M(PerThreadBRep<N>&, int)> MesherFactory,
+            BRepSink<N>* sink)
 {
-    boost::lockfree::stack<
-        const typename M::Input*,
-        boost::lockfree::fixed_sized<true>> tasks(settings.workers);
-    tasks.push(t.get());
+    TaskQueue<const typename M::Input*> tasks(settings.workers);
+    tasks.push(0, t.get());
     t->resetPending();
 
-    std::atomic<uint32_t> global_index(1);
+    // If we're streaming into a sink, then it owns the vertex indices
+    std::atomic<uint32_t> local_index(1);
+    auto& global_index = sink ? sink->index : local_index;
     std::vector<PerThreadBRep<N>> breps;
     for (unsigned i=0; i < settings.workers; ++i) {
-        breps.emplace_back(PerThreadBRep<N>(global_index));
+        breps.emplace_back(PerThreadBRep<N>(global_index, sink));
     }
 
     if (settings.progress_handler) {
@@ -272,11 +274,11 @@ std::unique_ptr<typename M::Output> Dual<N>::walk_(
     futures.resize(settings.workers);
     std::atomic_bool done(false);
     for (unsigned i=0; i < settings.workers; ++i) {
-        futures[i] = std::async(std::launch::async,
+        futures[i] = ThreadPool::run(settings.pool,
             [&breps, &tasks, &MesherFactory, &settings, &done, i]()
             {
                 auto m = MesherFactory(breps[i], i);
-                Dual<N>::run(m, tasks, settings, done);
+                Dual<N>::run(m, tasks, i, settings, done);
             });
     }
 
@@ -294,47 +296,40 @@ std::unique_ptr<typename M::Output> Dual<N>::walk_(
     }
 
     auto out = std::make_unique<typename M::Output>();
-    out->collect(breps);
+    if (sink) {
+        for (auto& b : breps) {
+            b.flush();
+        }
+    } else {
+        out->collect(breps, 0, settings.pool);
+    }
     return out;
 }
 
 
 template <unsigned N>
 template <typename T, typename V>
-void Dual<N>::run(V& v,
-                  boost::lockfree::stack<const T*,
-                                         boost::lockfree::fixed_sized<true>>& tasks,
+void Dual<N>::run(V& v, TaskQueue<const T*>& tasks, unsigned index,
                   const BRepSettings& settings,
                   std::atomic_bool& done)
 
 {
-    // Tasks to be evaluated by this thread (populated when the
-    // MPMC stack is completely full).
-    std::stack<const T*, std::vector<const T*>> local;
-
     while (!done.load() && !settings.cancel.load())
     {
-        // Prioritize picking up a local task before going to
-        // the MPMC queue, to keep things in this thread for
-        // as long as possible.
+        // Pick up a task from this thread's own deque (to keep working
+        // on the same subtree for as long as possible), stealing from
+        // other threads if it's empty.
         const T* t;
-        if (local.size())
-        {
-            t = local.top();
-            local.pop();
-        }
-        else if (!tasks.pop(t))
-        {
-            t = nullptr;
-        }
 
-        // If we failed to get a task, keep looping
-        // (so that we terminate when either of the flags are set).
-        if (t == nullptr)
+        // If we failed to get a task, then sleep until one shows up
+        // and keep looping (so that we terminate when either of the
+        // flags are set).
+        if (!tasks.pop(index, t))
         {
             if (settings.free_thread_handler != nullptr) {
                 settings.free_thread_handler->offerWait();
             }
+            tasks.park();
             continue;
         }
 
@@ -343,10 +338,7 @@ void Dual<N>::run(V& v,
             // Recurse, calling the cell procedure for every child
             for (const auto& c_ : t->children)
             {
-                const auto c = c_.load();
-                if (!tasks.bounded_push(c)) {
-                    local.push(c);
-                }
+                tasks.push(index, c_.load());
             }
             continue;
         }
@@ -380,8 +372,10 @@ void Dual<N>::run(V& v,
     }
 
     // If we've broken out of the loop, then we should set the done flag
-    // so that other worker threads also terminate.
+    // (and wake up any sleeping threads) so that other worker threads
+    // also terminate.
     done.store(true);
+    tasks.halt();
 }
 
 }   // namespace libfive
@@ -110,6 +110,15 @@ public:
                                        const std::shared_ptr<Tape>& tape,
                                        Pool& object_pool);
 
+    /*
+     *  As above, but using an interval result and pushed tape that were
+     *  already computed (e.g. in a batch with this tree's siblings).
+     */
+    std::shared_ptr<Tape> evalInterval(
+            Evaluator* eval, const std::shared_ptr<Tape>& tape,
+            Pool& object_pool,
+            std::pair<Interval, std::shared_ptr<Tape>> o);
+
     /*
      *  Evaluates a minimum-size octree node.
      *  Sets type to FILLED / EMPTY / AMBIGUOUS based on the corner values.
@@ -213,6 +222,7 @@ public:
                     bool normalize);
 
     static bool hasSingletons() { return false; }
+    static constexpr bool hasLeafBatching() { return false; }
     static HybridTree<N>* singletonEmpty() { return nullptr; }
     static HybridTree<N>* singletonFilled() { return nullptr; }
     static bool isSingleton(const HybridTree<N>*) { return false; }
@@ -0,0 +1,117 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "libfive/tree/tree.hpp"
+#include "libfive/eval/clause.hpp"
+#include "libfive/render/brep/region.hpp"
+#include "libfive/render/brep/root.hpp"
+#include "libfive/render/brep/dc/dc_tree.hpp"
+
+namespace libfive {
+
+// Forward declarations
+class Evaluator;
+class Mesh;
+struct BRepSettings;
+
+/*
+ *  An IncrementalMesher keeps the octree from a dual contouring render,
+ *  so that the model can be re-meshed cheaply when free variables change
+ *  (e.g. while they are being dragged in a GUI).
+ *
+ *  When variables change, the old octree is walked with the changed
+ *  variables set to the range [old value, new value] in an interval
+ *  evaluator.  Cells where the specialized tape no longer depends on the
+ *  changed variables (or which are filled / empty across the whole range)
+ *  are proven to be unchanged and are kept; the remaining cells are
+ *  rebuilt and grafted into the tree, which is then walked to produce
+ *  a fresh Mesh.
+ */
+class IncrementalMesher
+{
+public:
+    /*
+     *  es must point to at least [settings.workers] evaluators (for the
+     *  settings used in render), which have been loaded with the given
+     *  variable values and share a single Deck::Shared.  The evaluators
+     *  are owned by the caller, and must outlive this object; their
+     *  variables are updated by render.
+     */
+    IncrementalMesher(Evaluator* es, const Region<3>& region,
+                      const std::map<Tree::Id, float>& vars);
+
+    /*
+     *  Renders a mesh with the given variable values (which may be a
+     *  subset of the variables in the model).
+     *
+     *  The first call (and any call where min_feature or max_err has
+     *  changed since the previous call) builds a full octree; later calls
+     *  only rebuild the parts of the octree that may have changed.
+     *
+     *  Only DUAL_CONTOURING is supported (settings.alg is ignored).
+     *  Returns nullptr if cancel is set to true partway through.
+     */
+    std::unique_ptr<Mesh> render(const std::map<Tree::Id, float>& vars,
+                                 const BRepSettings& settings);
+
+    /*
+     *  Returns the number of cells that were rebuilt in the most recent
+     *  call to render (or 1 if it built the whole tree from scratch).
+     */
+    size_t rebuilt() const { return rebuilt_count; }
+
+protected:
+    /*
+     *  Walks the tree, finding cells which may have been changed by the
+     *  given variables and storing their parent + child index in out.
+     *  eval must already have the changed variables set to intervals.
+     */
+    void findChanged(const DCTree<3>* parent, unsigned index,
+                     const DCTree<3>* t, const Region<3>& region,
+                     const std::shared_ptr<Tape>& tape,
+                     const std::vector<Clause::Id>& slots,
+                     std::vector<std::pair<const DCTree<3>*, unsigned>>& out);
+
+    /*  Clears vertex indices from the previous walk of the tree  */
+    static void resetIndices(const DCTree<3>* t);
+
+    Evaluator* const es;
+    const Region<3> region;
+
+    /*  Variable values that the tree was built with  */
+    std::map<Tree::Id, float> vars;
+
+    Root<DCTree<3>> root;
+
+    /*  Settings that the tree was built with  */
+    double min_feature=-1;
+    double max_err=-1;
+
+    /*  Tree size after the most recent full build, used to decide when
+     *  abandoned subtrees have piled up enough to rebuild from scratch */
+    int64_t full_size=0;
+
+    /*  Set if a render was cancelled partway through an update, which
+     *  leaves the tree in a mixed state  */
+    bool dirty=false;
+
+    size_t rebuilt_count=0;
+
+    /*  Affected cells at or below this level are rebuilt as a whole,
+     *  rather than searching them for smaller affected cells, so that
+     *  each rebuild is large enough to be worth spinning up workers. */
+    static constexpr int REBUILD_LEVEL = 2;
+};
+
+}   // namespace libfive
@@ -19,6 +19,7 @@ class Evaluator;
 struct BRepSettings;
 
 template <unsigned N> class Region;
+template <unsigned N> class BRepSink;
 
 class Mesh : public BRep<3> {
 public:
@@ -43,6 +44,23 @@ public:
             Evaluator* es, const Region<3>& r,
             const BRepSettings& settings);
 
+    /*
+     *  Renders straight to a binary STL or PLY file (chosen based on the
+     *  filename's extension), streaming triangles out as they are
+     *  generated rather than building a Mesh in memory.
+     *
+     *  If settings.tile_depth is non-zero, then the region is meshed one
+     *  brick at a time, which also bounds the size of the octree held
+     *  in memory.
+     *
+     *  Returns false if the file can't be written, the extension isn't
+     *  recognized, or cancel is set to true partway through.
+     */
+    static bool renderToFile(
+            const std::string& filename,
+            const Tree& t, const Region<3>& r,
+            const BRepSettings& settings);
+
     /*
      *  Writes the mesh to a file
      */
@@ -55,6 +73,23 @@ public:
                         const std::list<const Mesh*>& meshes);
 
 protected:
+    /*
+     *  Shared implementation for render and renderToFile.  If sink is
+     *  provided, then the model is streamed into it and the returned
+     *  Mesh is empty (but non-null, to indicate success).
+     */
+    static std::unique_ptr<Mesh> render(
+            Evaluator* es, const Region<3>& r,
+            const BRepSettings& settings, BRepSink<3>* sink);
+
+    /*
+     *  Streams a dual contouring mesh into the sink, one brick at a time
+     *  (see BRepSettings::tile_depth).  Returns false if cancelled.
+     */
+    static bool renderTiled(
+            Evaluator* es, const Region<3>& r,
+            const BRepSettings& settings, BRepSink<3>* sink);
+
 
     /*
      *  Inserts a line into the mesh as a zero-size triangle
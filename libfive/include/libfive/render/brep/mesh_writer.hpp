@@ -0,0 +1,116 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Eigen>
+
+#include "libfive/render/brep/per_thread_brep.hpp"
+
+namespace libfive {
+
+/*
+ *  A MeshWriter streams a triangle mesh to disk as it is generated,
+ *  without building a Mesh in memory first.
+ *
+ *  Binary STL triangles are written straight to the output file in large
+ *  buffered blocks, and the triangle count in the header is patched in by
+ *  finish().
+ *
+ *  Binary PLY files (with shared vertices) must list every vertex before
+ *  any faces, so faces are spooled to a temporary file, then copied to
+ *  the output (after the vertices) by finish().
+ *
+ *  In both cases, the only per-vertex state kept in memory is the vertex
+ *  position, which is needed to resolve STL triangles and to write the
+ *  PLY vertex list.
+ */
+class MeshWriter : public BRepSink<3>
+{
+public:
+    enum Format { STL, PLY };
+
+    /*
+     *  Opens the given file for writing.  Check isOpen() afterwards.
+     */
+    MeshWriter(const std::string& filename, Format format);
+    ~MeshWriter();
+
+    /*
+     *  Picks a format based on the filename's extension, returning
+     *  false if it is neither .stl nor .ply
+     */
+    static bool formatFor(const std::string& filename, Format* format);
+
+    bool isOpen() const;
+
+    void pushVertex(uint32_t index, const Eigen::Vector3f& v) override;
+    void pushBranes(const Eigen::Matrix<uint32_t, 3, 1>* bs,
+                    size_t count) override;
+
+    /*
+     *  Completes the file (writing headers and any spooled data).
+     *  Returns false if anything went wrong while writing.
+     */
+    bool finish();
+
+    /*  Size of a single binary STL triangle record, in bytes  */
+    static constexpr size_t STL_RECORD_SIZE = 50;
+
+    /*
+     *  Encodes a binary STL triangle record (with a zero normal) into the
+     *  given buffer, which must have room for STL_RECORD_SIZE bytes.
+     */
+    static void encodeSTL(char* buf, const Eigen::Vector3f& a,
+                          const Eigen::Vector3f& b, const Eigen::Vector3f& c);
+
+    /*
+     *  Writes the 80-byte STL header (which is human-readable and
+     *  otherwise ignored) to the given stream.
+     */
+    static void writeSTLHeader(std::ostream& out);
+
+protected:
+    /*  Returns the position of the vertex with the given index,
+     *  which must have already been passed to pushVertex.  */
+    const Eigen::Vector3f& vert(uint32_t index) const;
+
+    const Format format;
+    std::ofstream file;
+
+    /*  Vertex positions are stored in fixed-size chunks, which are
+     *  allocated on demand (so that pushVertex is lock-free and
+     *  never moves existing vertices).  */
+    static constexpr unsigned CHUNK_BITS = 16;
+    static constexpr uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+    std::vector<std::atomic<Eigen::Vector3f*>> chunks;
+
+    /*  One past the highest vertex index that has been pushed */
+    std::atomic<uint32_t> vertex_end;
+
+    /*  Guards file (for STL) and faces (for PLY) */
+    std::mutex mut;
+
+    /*  Number of triangles written so far */
+    uint64_t triangle_count;
+
+    /*  Temporary file which holds PLY faces until finish() */
+    std::FILE* faces;
+
+    bool ok;
+};
+
+}   // namespace libfive
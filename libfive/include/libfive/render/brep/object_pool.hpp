@@ -15,6 +15,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 namespace libfive {
 class ProgressHandler;
+class ThreadPool;
 
 /*
  *  This is a object pool container, to avoid allocation churn.
@@ -36,7 +37,7 @@ class ObjectPool
 {
 public:
     void claim(ObjectPool<>&) {}
-    void reset(unsigned, ProgressHandler*) {}
+    void reset(unsigned, ProgressHandler*, ThreadPool*) {}
     int64_t num_blocks() const { return 0; }
     ObjectPool<>& operator=(ObjectPool<>&&) { return *this; }
 };
@@ -76,9 +77,13 @@ public:
      *  get() must not be called after a pool is reset.
      *
      *  (this is the same as the destructor, but includes a progress callback)
+     *
+     *  If pool is provided, then the deallocation threads are run as jobs
+     *  in the pool rather than being launched separately.
      */
     void reset(unsigned workers=8,
-               ProgressHandler* progress_watcher=nullptr);
+               ProgressHandler* progress_watcher=nullptr,
+               ThreadPool* pool=nullptr);
 
 private:
     /*  Each fresh_block is a pointer to the start of the block,
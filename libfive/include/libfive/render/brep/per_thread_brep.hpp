@@ -9,31 +9,73 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #pragma once
 
 #include <atomic>
+#include <vector>
 
 #include <Eigen/Eigen>
 #include <Eigen/StdVector>
 
 namespace libfive {
 
+/*
+ *  A BRepSink receives vertices and branes as they are generated, rather
+ *  than having them accumulate in a set of PerThreadBReps.  This is used
+ *  to stream large models directly to disk.
+ *
+ *  Both functions are called from many threads at once, so implementations
+ *  must be thread-safe.
+ */
+template <unsigned N>
+class BRepSink
+{
+public:
+    BRepSink() : index(1) {}
+    virtual ~BRepSink() {}
+
+    /*  Called once for each vertex, with its globally unique index */
+    virtual void pushVertex(uint32_t index,
+                            const Eigen::Matrix<float, N, 1>& v) = 0;
+
+    /*  Called with batches of branes.  Every vertex used by a brane
+     *  has already been passed to pushVertex (possibly by another
+     *  thread). */
+    virtual void pushBranes(const Eigen::Matrix<uint32_t, N, 1>* bs,
+                            size_t count) = 0;
+
+    /*  Vertex indices are handed out by the sink (rather than by each
+     *  dual walk), so that several walks can stream into the same sink
+     *  without their indices colliding. */
+    std::atomic<uint32_t> index;
+};
+
 /*
  *  A PerThreadBRep is a thread-safe class used when to a BRep from multiple
  *  threads simultaneously.  Construct a set of PerThreadBReps (one per thread)
  *  with the same atomic counter, then collect them with BRep::collect to merge
  *  them into a single model.
+ *
+ *  If a sink is provided, then vertices are passed straight through to
+ *  it, and branes are passed along in batches (so the PerThreadBRep stays
+ *  small, and BRep::collect isn't used).  Call flush() once meshing is
+ *  done to pass along any leftover branes.
  */
 template <unsigned N>
 class PerThreadBRep
 {
 public:
-    PerThreadBRep(std::atomic<uint32_t>& c) : c(c)
+    PerThreadBRep(std::atomic<uint32_t>& c, BRepSink<N>* sink=nullptr)
+        : c(c), sink(sink)
     {
-        assert(c.load() == 1);
+        assert(sink || c.load() == 1);
     }
 
     uint32_t pushVertex(const Eigen::Matrix<float, N, 1>& v) {
         const auto out = c.fetch_add(1);
-        this->verts.push_back(v);
-        indices.push_back(out);
+        if (sink) {
+            sink->pushVertex(out, v);
+        } else {
+            this->verts.push_back(v);
+            indices.push_back(out);
+        }
         return out;
     }
     uint32_t pushVertex(const Eigen::Matrix<double, N, 1>& v) {
@@ -49,7 +91,22 @@ public:
     {
         const auto a_ = pushVertex(a);
         const auto b_ = pushVertex(b);
-        this->branes.push_back({a_, b_, a_});
+        pushBrane({a_, b_, a_});
+    }
+
+    void pushBrane(const Eigen::Matrix<uint32_t, N, 1>& b) {
+        branes.push_back(b);
+        if (sink && branes.size() >= SINK_BATCH_SIZE) {
+            flush();
+        }
+    }
+
+    /*  Passes any buffered branes along to the sink (if present) */
+    void flush() {
+        if (sink && branes.size()) {
+            sink->pushBranes(branes.data(), branes.size());
+            branes.clear();
+        }
     }
 
     std::vector<Eigen::Matrix<float, N, 1>,
@@ -60,6 +117,10 @@ public:
 
 protected:
     std::atomic<uint32_t>& c;
+    BRepSink<N>* sink;
+
+    /*  Number of branes to accumulate before passing them to the sink */
+    static constexpr size_t SINK_BATCH_SIZE = 4096;
 };
 
 }   // namespace libfive
@@ -8,6 +8,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
+#include <vector>
+
 #include "libfive/render/brep/object_pool.hpp"
 #include "libfive/render/brep/settings.hpp"
 #include "libfive/render/brep/progress.hpp"
@@ -27,6 +29,7 @@ public:
         other.ptr = nullptr;
         object_pool = std::move(other.object_pool);
         tree_count = other.tree_count;
+        grafts = std::move(other.grafts);
         return *this;
     }
 
@@ -36,10 +39,15 @@ public:
     {
         delete ptr;
         ptr = nullptr;
+        for (auto& g : grafts) {
+            delete g;
+        }
+        grafts.clear();
         if (settings.progress_handler) {
             settings.progress_handler->nextPhase(object_pool.num_blocks());
         }
-        object_pool.reset(settings.workers, settings.progress_handler);
+        object_pool.reset(settings.workers, settings.progress_handler,
+                          settings.pool);
     }
 
     const T* operator->() const { return ptr; }
@@ -52,6 +60,45 @@ public:
 
     int64_t size() const { return tree_count; }
 
+    /*
+     *  Replaces a cell of this tree with the tree from another Root, which
+     *  must cover exactly the same region, taking ownership of its trees.
+     *
+     *  The cell is specified by its parent and index (rather than by a
+     *  pointer to the cell itself, which may be a singleton).  If parent
+     *  is null, then the whole tree is replaced.
+     *
+     *  The replaced subtree is left in this Root's object pool, and is
+     *  only freed when the Root is reset.
+     */
+    void graft(const T* parent, unsigned index, Root&& other)
+    {
+        T* t = other.ptr;
+        other.ptr = nullptr;
+
+        // This Root owns every tree in the hierarchy, so it's allowed to
+        // edit them (even though they're only exposed as const pointers)
+        T* p = const_cast<T*>(parent);
+        t->parent = p;
+        t->parent_index = index;
+        if (p) {
+            p->children[index].store(t);
+            grafts.push_back(t);
+        } else {
+            delete ptr;
+            ptr = t;
+        }
+
+        // Tree roots aren't allocated from the object pool, so any roots
+        // that were grafted into the other tree are also taken over.
+        grafts.insert(grafts.end(), other.grafts.begin(), other.grafts.end());
+        other.grafts.clear();
+
+        object_pool.claim(other.object_pool);
+        tree_count += other.tree_count;
+        other.tree_count = 0;
+    }
+
 protected:
     T* ptr;
     typename T::Pool object_pool;
@@ -61,6 +108,10 @@ protected:
     // result to go negative (if one pool has claimed many trees from
     // another Pool, so it owns more trees than it has allocated).
     int64_t tree_count=0;
+
+    // Roots of other trees that have been grafted into this one, which
+    // are deleted when this Root is reset.
+    std::vector<T*> grafts;
 };
 
 }   // namespace libfive
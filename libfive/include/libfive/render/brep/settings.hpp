@@ -11,12 +11,15 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <atomic>
 #include <memory>
 
+#include "libfive/eval/eval_array_size.hpp"
+
 namespace libfive {
 
 // Forward declarations
 class ProgressHandler;
 class FreeThreadHandler;
 class VolTree;
+class ThreadPool;
 
 enum BRepAlgorithm {
     DUAL_CONTOURING,
@@ -40,6 +43,11 @@ public:
         progress_handler = nullptr;
         cancel.store(false);
         vol = nullptr;
+        pool = nullptr;
+        leaf_batching = true;
+        tile_depth = 0;
+        eval_width = LIBFIVE_EVAL_ARRAY_SIZE;
+        affine = false;
     }
 
     /*  The meshing region is subdivided until the smallest region edge
@@ -70,6 +78,36 @@ public:
     /*  Optional acceleration structure */
     const VolTree* vol;
 
+    /*  Optional long-lived thread pool.  If present, every stage of the
+     *  render runs its worker threads as jobs in this pool, rather than
+     *  launching new threads.  */
+    ThreadPool* pool;
+
+    /*  If true, the leaf cells of a subdivided cell are evaluated together
+     *  as a single batch (for tree types that support it), rather than
+     *  being dispatched one at a time.  */
+    bool leaf_batching;
+
+    /*  If non-zero, Mesh::renderToFile splits the region into a grid of
+     *  bricks (2^tile_depth along each axis), building and meshing one
+     *  brick's octree at a time, so that peak memory scales with the
+     *  brick size rather than the whole model.  Only used with
+     *  DUAL_CONTOURING; other algorithms render the region in one go.  */
+    unsigned tile_depth;
+
+    /*  Number of points that each evaluator processes in one pass, when
+     *  the renderer builds its own evaluators.  Meshing only evaluates
+     *  a few points at a time, so narrower evaluators (which keep less
+     *  data per clause) can be faster.  This must be at least 32.  */
+    size_t eval_width;
+
+    /*  If true, cells are classified with affine arithmetic (see
+     *  AffineEvaluator) rather than plain interval arithmetic.  This
+     *  costs more per cell, but subdivides fewer cells for rotated
+     *  or polynomial (non-distance-field) shapes;  the output is the
+     *  same either way.  */
+    bool affine;
+
     mutable std::atomic_bool cancel;
 };
 
@@ -135,6 +135,15 @@ public:
                                        const std::shared_ptr<Tape>& tape,
                                        Pool& object_pool);
 
+    /*
+     *  As above, but using an interval result and pushed tape that were
+     *  already computed (e.g. in a batch with this tree's siblings).
+     */
+    std::shared_ptr<Tape> evalInterval(
+            Evaluator* eval, const std::shared_ptr<Tape>& tape,
+            Pool& object_pool,
+            std::pair<Interval, std::shared_ptr<Tape>> o);
+
     /*
      *  Evaluates and stores a result at every corner of the cell.
      *  Sets type to FILLED / EMPTY / AMBIGUOUS based on the corner values.
@@ -190,6 +199,7 @@ public:
     typedef Eigen::Matrix<double, N, 1> Vec;
 
     static bool hasSingletons() { return false; }
+    static constexpr bool hasLeafBatching() { return false; }
     static SimplexTree<N>* singletonEmpty() { return nullptr; }
     static SimplexTree<N>* singletonFilled() { return nullptr; }
     static bool isSingleton(const SimplexTree<N>*) { return false; }
@@ -0,0 +1,137 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace libfive {
+
+/*
+ *  A TaskQueue is a work-stealing scheduler shared by a fixed set of
+ *  worker threads (indexed from 0 to workers - 1).
+ *
+ *  Each worker has its own deque:  it pushes and pops from the back
+ *  (so that it works depth-first on the subtree that it's currently
+ *  building), while other workers steal from the front (which tends
+ *  to hand them the largest remaining chunks of work).
+ *
+ *  Workers which run out of tasks should call park(), which puts them
+ *  to sleep until more work is pushed or the queue is halted, rather
+ *  than spinning.
+ */
+template <typename T>
+class TaskQueue
+{
+public:
+    explicit TaskQueue(unsigned workers)
+        : queues(workers), size(0), sleeping(0), halted(false)
+    {
+        // Nothing to do here
+    }
+
+    /*
+     *  Pushes a task onto the given worker's deque, waking up a parked
+     *  worker (if there is one) to come and steal it.
+     */
+    void push(unsigned worker, const T& t)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mut);
+            queues[worker].tasks.push_back(t);
+            size++;
+        }
+
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> lock(park_mut);
+            park_cv.notify_one();
+        }
+    }
+
+    /*
+     *  Pops a task from the given worker's deque, stealing from other
+     *  workers if it is empty.  Returns false if no task was found.
+     */
+    bool pop(unsigned worker, T& t)
+    {
+        const unsigned n = queues.size();
+        for (unsigned i=0; i < n; ++i)
+        {
+            auto& q = queues[(worker + i) % n];
+            std::lock_guard<std::mutex> lock(q.mut);
+            if (q.tasks.size())
+            {
+                if (i == 0) {
+                    t = q.tasks.back();
+                    q.tasks.pop_back();
+                } else {
+                    t = q.tasks.front();
+                    q.tasks.pop_front();
+                }
+                size--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     *  Blocks the calling thread until a task is available, the queue
+     *  is halted, or a short timeout expires (so that callers can check
+     *  their own cancellation flags).
+     */
+    void park()
+    {
+        std::unique_lock<std::mutex> lock(park_mut);
+        sleeping++;
+        if (!size.load() && !halted.load())
+        {
+            park_cv.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        sleeping--;
+    }
+
+    /*
+     *  Marks the queue as finished, waking up every parked worker.
+     */
+    void halt()
+    {
+        halted.store(true);
+        std::lock_guard<std::mutex> lock(park_mut);
+        park_cv.notify_all();
+    }
+
+    bool isHalted() const { return halted.load(); }
+
+protected:
+    struct Queue
+    {
+        std::mutex mut;
+        std::deque<T> tasks;
+    };
+    std::vector<Queue> queues;
+
+    /*  Total number of tasks across all of the queues  */
+    std::atomic<size_t> size;
+
+    /*  Number of workers currently in park()  */
+    std::atomic<unsigned> sleeping;
+
+    std::atomic_bool halted;
+
+    std::mutex park_mut;
+    std::condition_variable park_cv;
+};
+
+}   // namespace libfive
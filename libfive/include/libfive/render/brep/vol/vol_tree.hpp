@@ -52,6 +52,15 @@ public:
                                        const std::shared_ptr<Tape>& tape,
                                        Pool& object_pool);
 
+    /*
+     *  As above, but using an interval result and pushed tape that were
+     *  already computed (e.g. in a batch with this tree's siblings).
+     */
+    std::shared_ptr<Tape> evalInterval(
+            Evaluator* eval, const std::shared_ptr<Tape>& tape,
+            Pool& object_pool,
+            std::pair<Interval, std::shared_ptr<Tape>> o);
+
     void evalLeaf(Evaluator* eval,
                   const std::shared_ptr<Tape>& tape,
                   Pool& spare_leafs,
@@ -81,6 +90,7 @@ public:
     const VolTree* push(unsigned i, const Region<3>::Perp& perp) const;
 
     static bool hasSingletons() { return false; }
+    static constexpr bool hasLeafBatching() { return false; }
     static VolTree* singletonEmpty() { return nullptr; }
     static VolTree* singletonFilled() { return nullptr; }
     static bool isSingleton(const VolTree*) { return false; }
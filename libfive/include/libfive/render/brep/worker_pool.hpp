@@ -10,10 +10,10 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #pragma once
 
 #include <atomic>
-#include <boost/lockfree/stack.hpp>
-
 #include "libfive/render/brep/root.hpp"
+#include "libfive/render/brep/task_queue.hpp"
 #include "libfive/tree/tree.hpp"
+#include "libfive/eval/interval.hpp"
 
 namespace libfive {
 
@@ -52,12 +52,15 @@ protected:
         std::shared_ptr<Tape> tape;
         Neighbors parent_neighbors;
         const VolTree* vol;
-    };
 
-    using LockFreeStack =
-        boost::lockfree::stack<Task, boost::lockfree::fixed_sized<true>>;
+        /*  If the target's interval result was computed in a batch with
+         *  its siblings, it is stored here (and interval_tape is the
+         *  pushed tape); otherwise, interval_tape is null. */
+        Interval interval;
+        std::shared_ptr<Tape> interval_tape;
+    };
 
-    static void run(Evaluator* eval, LockFreeStack& tasks,
+    static void run(Evaluator* eval, TaskQueue<Task>& tasks, unsigned index,
                     Root<T>& root, std::mutex& root_lock,
                     const BRepSettings& settings,
                     std::atomic_bool& done);
@@ -16,6 +16,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 namespace libfive {
 
+class ThreadPool;
+
 class Heightmap
 {
 public:
@@ -25,17 +27,21 @@ public:
      *  Render a height-map image into an array of floats (representing depth)
      *  and the height-map's normals into a shaded image with R, G, B, A packed
      *  into int32_t pixels.
+     *
+     *  If pool is provided, then the rendering threads are run as jobs
+     *  in the pool rather than being launched separately.
      */
     static std::unique_ptr<Heightmap> render(
             const Tree& t, Voxels r,
-            const std::atomic_bool& abort, size_t threads=8);
+            const std::atomic_bool& abort, size_t threads=8,
+            ThreadPool* pool=nullptr);
 
     /*
      *  Render an image using pre-allocated evaluators
      */
     static std::unique_ptr<Heightmap> render(
             const std::vector<Evaluator*>& es, Voxels r,
-            const std::atomic_bool& abort);
+            const std::atomic_bool& abort, ThreadPool* pool=nullptr);
 
     /*
      *  Saves the depth component as a 16-bit single-channel PNG
@@ -53,6 +59,11 @@ public:
     Depth depth;
     Normal norm;
 
+    /*  Width of the evaluators built by render(const Tree&, ...).  Regions
+     *  with this many voxels or fewer are evaluated point-by-point in a
+     *  single pass, so wider evaluators do less interval arithmetic.  */
+    static constexpr size_t EVAL_WIDTH = 1024;
+
 protected:
     /*
      *  Recurses down into a rendering operation
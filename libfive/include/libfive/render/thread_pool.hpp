@@ -0,0 +1,76 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace libfive {
+
+/*
+ *  A ThreadPool is a long-lived set of threads which run jobs in the
+ *  order that they're submitted.  Sharing one pool between many render
+ *  calls (through BRepSettings::pool, or the pool argument to
+ *  Heightmap::render) avoids the cost of spinning up new threads for
+ *  every stage of every render, and lets concurrent renders share cores.
+ *
+ *  Jobs from one render may be interleaved with jobs from another render,
+ *  and a render may have fewer threads than it asked for (e.g. if the
+ *  pool is smaller than BRepSettings::workers); the renderers are
+ *  written to make progress with any number of threads.
+ *
+ *  A render must not be started from one of the pool's own threads,
+ *  since it would then block waiting on jobs queued behind itself.
+ */
+class ThreadPool
+{
+public:
+    /*
+     *  Constructs a pool with the given number of threads.  If threads
+     *  is 0, uses the platform-default number of threads.
+     */
+    explicit ThreadPool(unsigned threads=0);
+
+    /*
+     *  Finishes every queued job, then joins the pool's threads.
+     */
+    ~ThreadPool();
+
+    /*
+     *  Queues a job, returning a future that is ready once it has run.
+     */
+    std::future<void> run(std::function<void()> f);
+
+    /*
+     *  Runs a job on the given pool, or (if pool is null) on a fresh
+     *  thread with std::async.
+     */
+    static std::future<void> run(ThreadPool* pool, std::function<void()> f);
+
+    /*  Returns the number of threads in the pool */
+    unsigned size() const { return threads.size(); }
+
+protected:
+    /*  Main loop for the pool's threads */
+    void work();
+
+    std::vector<std::thread> threads;
+
+    std::mutex mut;
+    std::condition_variable cv;
+    std::queue<std::packaged_task<void()>> jobs;
+    bool done;
+};
+
+}   // namespace libfive
@@ -106,10 +106,44 @@ enum Opcode {
     OPCODES
 #undef OPCODE
     LAST_OP=33,
+
+    // Tape-only opcodes, which are produced when lowering a Tape for
+    // evaluation (see Tape::lower).  They never appear in a Tree, so they
+    // are numbered after LAST_OP and are never saved to files.
+    //
+    // Opcodes ending in _IMM take a float immediate in place of their
+    // second argument (see Clause::immediate).  The immediate is the rhs
+    // of the operation, except for RSUB and RDIV, where it is the lhs.
+    OP_ADD_IMM=64,
+    OP_SUB_IMM=65,
+    OP_RSUB_IMM=66,
+    OP_MUL_IMM=67,
+    OP_DIV_IMM=68,
+    OP_RDIV_IMM=69,
+    OP_MIN_IMM=70,
+    OP_MAX_IMM=71,
+
+    // Fused operations, which replace a small pattern of clauses
+    OP_SUM_SQUARES=72,      // a*a + b*b
+    OP_ADD_SQUARE=73,       // a + b*b
+    OP_HYPOT=74,            // sqrt(a*a + b*b)
+    OP_SQRT_ADD_SQUARE=75,  // sqrt(a + b*b)
 };
 
 size_t args(Opcode op);
 
+/*
+ *  Returns true if the (tape-only) opcode takes an immediate operand
+ */
+bool hasImmediate(Opcode op);
+
+/*
+ *  For an opcode with an immediate operand, returns the equivalent
+ *  two-argument opcode (e.g. OP_ADD for OP_ADD_IMM), setting swap if
+ *  the immediate is the lhs of that opcode (e.g. for OP_RSUB_IMM).
+ */
+Opcode withoutImmediate(Opcode op, bool& swap);
+
 /*
  *  Converts to the bare enum string (e.g. ATAN2)
  */
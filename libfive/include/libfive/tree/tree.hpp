@@ -12,6 +12,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <memory>
 #include <functional>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -0,0 +1,502 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#include "libfive/eval/compiled_tape.hpp"
+#include "libfive/eval/simd.hpp"
+#include "libfive/eval/tape.hpp"
+
+// Generated code is only run if the CPU supports AVX (see available),
+// so the compiler itself doesn't need to be targeting AVX.
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define LIBFIVE_JIT 1
+#include <sys/mman.h>
+#else
+#define LIBFIVE_JIT 0
+#endif
+
+namespace libfive {
+
+#if LIBFIVE_JIT
+namespace {
+
+/*  Constants used by generated code, which begin the table passed in as
+ *  the masks argument:  sign bits (for negation), everything-but-sign bits
+ *  (for abs), and 1.0f (for reciprocals), each repeated across an 8-float
+ *  block.  Immediate operands are appended to the table after these. */
+alignas(32) const uint32_t MASKS[24] = {
+    0x80000000, 0x80000000, 0x80000000, 0x80000000,
+    0x80000000, 0x80000000, 0x80000000, 0x80000000,
+    0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff,
+    0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff,
+    0x3f800000, 0x3f800000, 0x3f800000, 0x3f800000,
+    0x3f800000, 0x3f800000, 0x3f800000, 0x3f800000,
+};
+const int32_t SIGN_MASK = 0;
+const int32_t ABS_MASK = 32;
+const int32_t ONES = 64;
+
+/*  System V argument registers */
+const uint8_t RDI = 7;  // data
+const uint8_t RDX = 2;  // masks
+
+/*  AVX opcodes (VEX.256.0F map, no prefix) */
+const uint8_t VMOVUPS_LOAD = 0x10;
+const uint8_t VMOVUPS_STORE = 0x11;
+const uint8_t VSQRTPS = 0x51;
+const uint8_t VANDPS = 0x54;
+const uint8_t VXORPS = 0x57;
+const uint8_t VADDPS = 0x58;
+const uint8_t VMULPS = 0x59;
+const uint8_t VSUBPS = 0x5C;
+const uint8_t VMINPS = 0x5D;
+const uint8_t VDIVPS = 0x5E;
+const uint8_t VMAXPS = 0x5F;
+
+/*
+ *  Minimal assembler for the handful of instructions that we emit.
+ *
+ *  Only ymm0-7 are used, so every AVX instruction fits in the two-byte
+ *  VEX prefix, and memory operands are always [base + disp32].
+ */
+struct Assembler
+{
+    std::vector<uint8_t> code;
+
+    void emit(std::initializer_list<uint8_t> bs) {
+        code.insert(code.end(), bs);
+    }
+    void emit32(int32_t d) {
+        for (unsigned i=0; i < 4; ++i) {
+            code.push_back(static_cast<uint8_t>(d >> (i * 8)));
+        }
+    }
+    void vex(uint8_t src1) {
+        // R is always clear (inverted to 1), L = 1 (256-bit), pp = 00
+        emit({0xC5, static_cast<uint8_t>(
+                0x80 | ((~src1 & 0xF) << 3) | 0x04)});
+    }
+
+    /*  op dst, src1, src2 (with src1 = 0 for unused, which encodes 1111) */
+    void reg(uint8_t op, uint8_t dst, uint8_t src1, uint8_t src2) {
+        vex(src1);
+        emit({op, static_cast<uint8_t>(0xC0 | (dst << 3) | src2)});
+    }
+    /*  op dst, src1, [base + disp] */
+    void mem(uint8_t op, uint8_t dst, uint8_t src1,
+             uint8_t base, int32_t disp) {
+        vex(src1);
+        emit({op, static_cast<uint8_t>(0x80 | (dst << 3) | base)});
+        emit32(disp);
+    }
+
+    /*  Emits a rel32 jump with the given opcode bytes, returning the
+     *  position of the offset (for patching)  */
+    size_t jump(std::initializer_list<uint8_t> op, size_t target=0) {
+        emit(op);
+        const size_t pos = code.size();
+        emit32(static_cast<int32_t>(target - (pos + 4)));
+        return pos;
+    }
+    void patch(size_t pos, size_t target) {
+        const int32_t d = static_cast<int32_t>(target - (pos + 4));
+        std::memcpy(&code[pos], &d, 4);
+    }
+};
+
+/*
+ *  Tracks which result slots are cached in which registers,
+ *  so that recently-computed values aren't reloaded from memory.
+ */
+struct RegisterCache
+{
+    std::array<Clause::Id, 8> slot;
+    std::array<uint64_t, 8> age;
+    uint64_t time=0;
+
+    RegisterCache() { slot.fill(0); age.fill(0); }
+
+    int find(Clause::Id s) {
+        for (unsigned r=0; r < slot.size(); ++r) {
+            if (s && slot[r] == s) {
+                age[r] = ++time;
+                return r;
+            }
+        }
+        return -1;
+    }
+    void drop(Clause::Id s) {
+        for (auto& r : slot) {
+            if (r == s) {
+                r = 0;
+            }
+        }
+    }
+    /*  Picks an empty (or least-recently-used) register, avoiding the
+     *  registers that hold the given slots.  */
+    uint8_t pick(Clause::Id a, Clause::Id b) {
+        int best = -1;
+        for (unsigned r=0; r < slot.size(); ++r) {
+            if (slot[r] && (slot[r] == a || slot[r] == b)) {
+                continue;
+            } else if (!slot[r]) {
+                return r;
+            } else if (best == -1 || age[r] < age[best]) {
+                best = r;
+            }
+        }
+        assert(best != -1);
+        return best;
+    }
+    void store(uint8_t r, Clause::Id s) {
+        slot[r] = s;
+        age[r] = ++time;
+    }
+    /*  Picks a register for temporary values, which isn't the given output
+     *  register and doesn't hold the given slots, and clears it.  */
+    uint8_t scratch(uint8_t out, Clause::Id a, Clause::Id b) {
+        const auto prev = slot[out];
+        slot[out] = a;  // so that pick skips it
+        const uint8_t r = pick(a, b);
+        slot[out] = prev;
+        slot[r] = 0;
+        return r;
+    }
+};
+
+/*  Compiled runs are capped at this many clauses, to keep each loop body
+ *  small enough to stay in the instruction cache. */
+const size_t MAX_RUN = 32;
+
+/*  Each compiled run loops over blocks, touching one cache line from each
+ *  of its slots per iteration.  Since slots are a large power-of-two stride
+ *  apart, this thrashes the data cache once the result array gets large,
+ *  at which point the interpreter (which streams through whole rows) wins,
+ *  so we don't compile tapes with more than this many bytes of results. */
+const size_t MAX_FOOTPRINT = 256 * 1024;
+
+bool supported(Opcode::Opcode op)
+{
+    switch (op) {
+        case Opcode::OP_ADD:
+        case Opcode::OP_MUL:
+        case Opcode::OP_SUB:
+        case Opcode::OP_DIV:
+        case Opcode::OP_MIN:
+        case Opcode::OP_MAX:
+        case Opcode::OP_SQUARE:
+        case Opcode::OP_SQRT:
+        case Opcode::OP_NEG:
+        case Opcode::OP_ABS:
+        case Opcode::OP_RECIP:
+        case Opcode::CONST_VAR:
+        case Opcode::OP_ADD_IMM:
+        case Opcode::OP_SUB_IMM:
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_MUL_IMM:
+        case Opcode::OP_DIV_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM:
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_ADD_SQUARE:
+        case Opcode::OP_HYPOT:
+        case Opcode::OP_SQRT_ADD_SQUARE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*  Emits code for a single clause, using the register cache and
+ *  appending immediates to the constant table */
+void compileClause(const Clause& c, size_t stride, Assembler& a,
+                   RegisterCache& regs, std::vector<uint32_t>& consts)
+{
+    auto disp = [&](Clause::Id s) {
+        return static_cast<int32_t>(s * stride * sizeof(float));
+    };
+
+    // Anything cached for the output slot is about to be stale
+    const bool has_b = Opcode::args(c.op) == 2;
+    regs.drop(c.id);
+    const uint8_t out = regs.pick(c.a, has_b ? c.b : 0);
+    regs.slot[out] = 0;
+
+    // Broadcasts the clause's immediate into the constant table,
+    // returning its offset (in bytes)
+    auto imm = [&]() {
+        const int32_t offset = static_cast<int32_t>(consts.size() * 4);
+        consts.insert(consts.end(), 8, c.b);
+        return offset;
+    };
+
+    // Returns a register holding the given slot, loading it into
+    // the output register if it isn't already cached.
+    auto load = [&](Clause::Id s) -> uint8_t {
+        const int r = regs.find(s);
+        if (r >= 0) {
+            return r;
+        }
+        a.mem(VMOVUPS_LOAD, out, 0, RDI, disp(s));
+        return out;
+    };
+    // Emits op out, src1, s (using a memory operand if s isn't cached)
+    auto binary = [&](uint8_t op, uint8_t src1, Clause::Id s) {
+        const int r = regs.find(s);
+        if (r >= 0) {
+            a.reg(op, out, src1, r);
+        } else {
+            a.mem(op, out, src1, RDI, disp(s));
+        }
+    };
+
+    switch (c.op) {
+        case Opcode::OP_ADD:    binary(VADDPS, load(c.a), c.b); break;
+        case Opcode::OP_MUL:    binary(VMULPS, load(c.a), c.b); break;
+        case Opcode::OP_SUB:    binary(VSUBPS, load(c.a), c.b); break;
+        case Opcode::OP_DIV:    binary(VDIVPS, load(c.a), c.b); break;
+
+        // Arguments are swapped to match the NaN behavior of Eigen's
+        // cwiseMin / cwiseMax (which matches std::min / std::max)
+        case Opcode::OP_MIN:    binary(VMINPS, load(c.b), c.a); break;
+        case Opcode::OP_MAX:    binary(VMAXPS, load(c.b), c.a); break;
+
+        case Opcode::OP_SQUARE: {
+            const uint8_t r = load(c.a);
+            a.reg(VMULPS, out, r, r);
+            break;
+        }
+        case Opcode::OP_SQRT:   binary(VSQRTPS, 0, c.a); break;
+        case Opcode::OP_NEG:
+            a.mem(VXORPS, out, load(c.a), RDX, SIGN_MASK);
+            break;
+        case Opcode::OP_ABS:
+            a.mem(VANDPS, out, load(c.a), RDX, ABS_MASK);
+            break;
+        case Opcode::OP_RECIP:
+            a.mem(VMOVUPS_LOAD, out, 0, RDX, ONES);
+            binary(VDIVPS, out, c.a);
+            break;
+        case Opcode::CONST_VAR: binary(VMOVUPS_LOAD, 0, c.a); break;
+
+        case Opcode::OP_ADD_IMM:
+            a.mem(VADDPS, out, load(c.a), RDX, imm());
+            break;
+        case Opcode::OP_SUB_IMM:
+            a.mem(VSUBPS, out, load(c.a), RDX, imm());
+            break;
+        case Opcode::OP_MUL_IMM:
+            a.mem(VMULPS, out, load(c.a), RDX, imm());
+            break;
+        case Opcode::OP_DIV_IMM:
+            a.mem(VDIVPS, out, load(c.a), RDX, imm());
+            break;
+
+        // These put the immediate in the first operand, like OP_RECIP
+        // (and like OP_MIN / OP_MAX, where the immediate is b)
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM: {
+            const uint8_t op =
+                (c.op == Opcode::OP_RSUB_IMM) ? VSUBPS :
+                (c.op == Opcode::OP_RDIV_IMM) ? VDIVPS :
+                (c.op == Opcode::OP_MIN_IMM) ? VMINPS : VMAXPS;
+            a.mem(VMOVUPS_LOAD, out, 0, RDX, imm());
+            binary(op, out, c.a);
+            break;
+        }
+
+        // Fused clauses compute b * b in a scratch register, then
+        // combine it with a (or a * a) in the output register.
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_ADD_SQUARE:
+        case Opcode::OP_HYPOT:
+        case Opcode::OP_SQRT_ADD_SQUARE: {
+            const uint8_t tmp = regs.scratch(out, c.a, c.b);
+            int rb = regs.find(c.b);
+            if (rb < 0) {
+                a.mem(VMOVUPS_LOAD, tmp, 0, RDI, disp(c.b));
+                rb = tmp;
+            }
+            a.reg(VMULPS, tmp, rb, rb);
+
+            const uint8_t ra = load(c.a);
+            if (c.op == Opcode::OP_SUM_SQUARES || c.op == Opcode::OP_HYPOT) {
+                a.reg(VMULPS, out, ra, ra);
+                a.reg(VADDPS, out, out, tmp);
+            } else {
+                a.reg(VADDPS, out, ra, tmp);
+            }
+            if (c.op == Opcode::OP_HYPOT ||
+                c.op == Opcode::OP_SQRT_ADD_SQUARE)
+            {
+                a.reg(VSQRTPS, out, 0, out);
+            }
+            break;
+        }
+
+        default: assert(false);
+    }
+
+    a.mem(VMOVUPS_STORE, out, 0, RDI, disp(c.id));
+    regs.store(out, c.id);
+}
+
+/*  Compiles a run of clauses into a single looping function  */
+void compileSegment(std::vector<Clause>::const_reverse_iterator begin,
+                    std::vector<Clause>::const_reverse_iterator end,
+                    size_t stride, Assembler& a,
+                    std::vector<uint32_t>& consts)
+{
+    // test rsi, rsi; jz done
+    a.emit({0x48, 0x85, 0xF6});
+    const size_t skip = a.jump({0x0F, 0x84});
+
+    const size_t loop = a.code.size();
+    RegisterCache regs;
+    for (auto itr = begin; itr != end; ++itr) {
+        compileClause(*itr, stride, a, regs, consts);
+    }
+
+    // add rdi, 32; dec rsi; jnz loop
+    a.emit({0x48, 0x83, 0xC7, 0x20});
+    a.emit({0x48, 0xFF, 0xCE});
+    a.jump({0x0F, 0x85}, loop);
+
+    // vzeroupper; ret
+    a.patch(skip, a.code.size());
+    a.emit({0xC5, 0xF8, 0x77});
+    a.emit({0xC3});
+}
+
+}   // anonymous namespace
+#endif
+
+bool CompiledTape::available()
+{
+    // The JIT follows the SIMD level, so that forcing a lower level
+    // (e.g. for benchmarking) also turns it off.
+    return LIBFIVE_JIT && Simd::level() >= Simd::AVX2;
+}
+
+CompiledTape::CompiledTape(const Tape& tape, size_t stride)
+    : row_stride(stride)
+{
+    const size_t n = tape.rend() - tape.rbegin();
+
+#if LIBFIVE_JIT
+    // Every slot must be addressable with a 32-bit displacement
+    auto fits = [&](Clause::Id s) {
+        return s * stride * sizeof(float) <
+            static_cast<size_t>(std::numeric_limits<int32_t>::max());
+    };
+
+    // Split the tape into runs of compiled and interpreted clauses,
+    // storing code offsets in place of function pointers for now.
+    // (clauses with one argument may store an immediate in b)
+    auto b = [](const Clause& c) {
+        return Opcode::args(c.op) == 2 ? c.b : 0;
+    };
+    Clause::Id max_slot = 0;
+    for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr) {
+        max_slot = std::max({max_slot, itr->id, itr->a, b(*itr)});
+    }
+    const bool small = (max_slot + 1) * stride * sizeof(float)
+                       <= MAX_FOOTPRINT;
+
+    Assembler a;
+    std::vector<size_t> offsets;
+    consts.assign(std::begin(MASKS), std::end(MASKS));
+    size_t i = 0;
+    while (small && i < n) {
+        auto ok = [&](size_t k) {
+            const auto& c = *(tape.rbegin() + k);
+            return supported(c.op) && fits(c.id) && fits(c.a) && fits(b(c));
+        };
+        const bool compile = ok(i);
+        size_t j = i;
+        while (j < n && ok(j) == compile &&
+               (!compile || j - i < MAX_RUN))
+        {
+            ++j;
+        }
+        if (compile) {
+            offsets.push_back(a.code.size());
+            compileSegment(tape.rbegin() + i, tape.rbegin() + j,
+                           stride, a, consts);
+            compiled_count += j - i;
+        } else {
+            offsets.push_back(std::numeric_limits<size_t>::max());
+        }
+        segs.push_back({nullptr, i, j});
+        i = j;
+    }
+
+    // Copy the code into executable memory
+    if (a.code.size()) {
+        void* mem = mmap(nullptr, a.code.size(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem != MAP_FAILED) {
+            std::memcpy(mem, a.code.data(), a.code.size());
+            if (mprotect(mem, a.code.size(), PROT_READ | PROT_EXEC) == 0) {
+                code = mem;
+                code_size = a.code.size();
+            } else {
+                munmap(mem, a.code.size());
+            }
+        }
+    }
+
+    if (code) {
+        for (unsigned k=0; k < segs.size(); ++k) {
+            if (offsets[k] != std::numeric_limits<size_t>::max()) {
+                segs[k].fn = reinterpret_cast<Function>(
+                        static_cast<uint8_t*>(code) + offsets[k]);
+            }
+        }
+        return;
+    }
+#endif
+
+    // Fall back to interpreting the whole tape
+    segs.clear();
+    compiled_count = 0;
+    if (n) {
+        segs.push_back({nullptr, 0, n});
+    }
+}
+
+CompiledTape::~CompiledTape()
+{
+#if LIBFIVE_JIT
+    if (code) {
+        munmap(code, code_size);
+    }
+#endif
+}
+
+void CompiledTape::call(const Segment& s, float* data, size_t blocks) const
+{
+    assert(s.fn);
+#if LIBFIVE_JIT
+    s.fn(data, blocks, reinterpret_cast<const float*>(consts.data()));
+#else
+    (void)data;
+    (void)blocks;
+#endif
+}
+
+}   // namespace libfive
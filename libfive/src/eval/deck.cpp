@@ -8,6 +8,7 @@ License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #include <unordered_map>
+#include <unordered_set>
 
 #include "libfive/eval/deck.hpp"
 #include "libfive/eval/tape.hpp"
@@ -16,7 +17,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 namespace libfive {
 
-Deck::Deck(const Tree& root_) {
+Deck::Shared::Shared(const Tree& root_) {
     const auto root = root_.optimized();
     auto flat = root.walk();
 
@@ -29,17 +30,38 @@ Deck::Deck(const Tree& root_) {
     // It's reversed in this pass, then flipped when writing to tape->t below
     std::vector<Clause> rev;
     rev.reserve(flat.size());
+
+    // Clauses which only depend on constants and variables are the same
+    // at every point, so they're pulled out of the tape into invariant
+    // (which is in evaluation order, since flat is children-first).
+    std::unordered_set<Tree::Id> fixed;
     for (const auto& m : flat) {
         auto op = m->op();
+        const auto n = Opcode::args(op);
+        if (n >= 1 && op != Opcode::ORACLE &&
+            fixed.count(m->lhs().id()) &&
+            (n == 1 || fixed.count(m->rhs().id())))
+        {
+            invariant.push_back(
+                {op, id, clauses.at(m->lhs().id()),
+                 n >= 2 ? clauses.at(m->rhs().id()) : 0});
+            fixed.insert(m);
+            clauses[m] = id--;
+            continue;
+        }
         switch (op) {
             case Opcode::CONSTANT:
-                constants.push_back({id, m->value()}); break;
+                constants.push_back({id, m->value()});
+                fixed.insert(m);
+                break;
             case Opcode::VAR_FREE:
-                vars.left.insert({id, m}); break;
+                vars.left.insert({id, m});
+                fixed.insert(m);
+                break;
             case Opcode::ORACLE:
                 rev.push_back({Opcode::ORACLE, id,
                     static_cast<unsigned int>(oracles.size()), 0});
-                oracles.push_back(m->build_oracle());
+                oracles.push_back(Tree(m));
                 break;
             case Opcode::VAR_X:  // fallthrough
             case Opcode::VAR_Y:  // fallthrough
@@ -77,8 +99,9 @@ Deck::Deck(const Tree& root_) {
     num_clauses = clauses.size() - 1;
 
     // Allocate enough memory for all the clauses
-    disabled.resize(clauses.size());
-    remap.resize(clauses.size());
+    inputs.resize(clauses.size());
+    slots.resize(clauses.size());
+    values.resize(clauses.size());
 
     // Save X, Y, Z ids
     X = clauses.at(axes[0].id());
@@ -91,6 +114,108 @@ Deck::Deck(const Tree& root_) {
     // Store the index of the tree's root
     assert(clauses.at(root.id()) == 1);
     tape->i = clauses.at(root.id());
+
+    // Mark which clauses live outside of the tape
+    inputs[X] = true;
+    inputs[Y] = true;
+    inputs[Z] = true;
+    for (auto& c : constants) {
+        inputs[c.first] = Tape::CONSTANT_INPUT;
+        values[c.first] = c.second;
+    }
+    for (auto& v : vars.left) {
+        inputs[v.first] = true;
+    }
+    for (auto& c : invariant) {
+        inputs[c.id] = true;
+    }
+
+    // Lower and register-allocate the base tape, then give inputs fixed
+    // slots after the ones used by the tape.  Pushed tapes are never wider
+    // than the base tape, so they won't collide with these slots.
+    Tape::Slots s;
+    s.slot.resize(clauses.size());
+    s.last_use.resize(clauses.size());
+    s.uses.resize(clauses.size());
+    s.pos.resize(clauses.size());
+    tape->lower(inputs, values, s);
+    num_slots = tape->assignSlots(inputs, s);
+    for (Clause::Id i=1; i < inputs.size(); ++i) {
+        if (inputs[i]) {
+            slots[i] = ++num_slots;
+            s.slot[i] = slots[i];
+        }
+    }
+    tape->writeSlots(s);
+
+    // Convert inputs from clause ids to result slots, which is how
+    // evaluators address them.
+    X = slots[X];
+    Y = slots[Y];
+    Z = slots[Z];
+    for (auto& c : constants) {
+        c.first = slots[c.first];
+    }
+    std::vector<Clause> slot_invariant;
+    slot_invariant.reserve(invariant.size());
+    for (auto& c : invariant) {
+        slot_invariant.push_back({c.op, slots[c.id], slots[c.a], slots[c.b]});
+    }
+    invariant = std::move(slot_invariant);
+    boost::bimap<Clause::Id, Tree::Id> slot_vars;
+    for (auto& v : vars.left) {
+        slot_vars.left.insert({slots[v.first], v.second});
+    }
+    vars = std::move(slot_vars);
+}
+
+Deck::Deck(const Tree& root)
+    : Deck(std::make_shared<const Shared>(root))
+{
+    // Nothing to do here
+}
+
+Deck::Deck(std::shared_ptr<const Shared> shared)
+    : shared(shared), X(shared->X), Y(shared->Y), Z(shared->Z),
+      constants(shared->constants), vars(shared->vars),
+      invariant(shared->invariant),
+      num_clauses(shared->num_clauses), num_slots(shared->num_slots),
+      tape(shared->tape),
+      disabled(shared->num_clauses + 1, true),
+      remap(shared->num_clauses + 1, 0)
+{
+    // Build this Deck's own Oracle instances
+    for (auto& o : shared->oracles) {
+        oracles.push_back(o->build_oracle());
+    }
+
+    // Start with fixed slots for X/Y/Z, variables, and constants
+    slots.slot = shared->slots;
+    slots.last_use.resize(shared->num_clauses + 1);
+    slots.uses.resize(shared->num_clauses + 1);
+    slots.pos.resize(shared->num_clauses + 1);
+}
+
+std::shared_ptr<Tape> Deck::intern(const std::shared_ptr<Tape>& tape)
+{
+    const auto h = tape->hash();
+    auto range = cache.equal_range(h);
+    for (auto itr = range.first; itr != range.second; ++itr)
+    {
+        if (itr->second->sameAs(*tape))
+        {
+            stats.hits++;
+            return itr->second;
+        }
+    }
+
+    stats.misses++;
+    if (cache.size() >= MAX_CACHED_TAPES)
+    {
+        cache.clear();
+    }
+    cache.insert({h, tape});
+    return tape;
 }
 
 void Deck::bindOracles(const Tape& tape)
@@ -0,0 +1,630 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <cmath>
+
+#include "libfive/eval/eval_affine.hpp"
+#include "libfive/eval/deck.hpp"
+#include "libfive/eval/tape.hpp"
+
+namespace libfive {
+
+namespace {
+
+using Form = AffineEvaluator::Form;
+
+/*
+ *  Each operation below takes a handful of rounded steps in double
+ *  precision.  Rather than tracking them individually, every operation
+ *  adds ROUNDING times a bound on the magnitude of its intermediate
+ *  values into the error term, which is far more than the rounding
+ *  error of those steps (about 2^-53 each).
+ */
+constexpr double ROUNDING = 1e-14;
+
+double magnitude(const Form& a)
+{
+    return std::abs(a.center) + a.radius();
+}
+
+bool isBounded(const Form& a)
+{
+    return std::isfinite(a.center) && std::isfinite(a.radius());
+}
+
+Form constant(double c)
+{
+    return {c, Eigen::Vector3d::Zero(), 0};
+}
+
+Form add(const Form& a, const Form& b)
+{
+    return {a.center + b.center, a.terms + b.terms,
+            a.err + b.err + ROUNDING * (magnitude(a) + magnitude(b))};
+}
+
+Form scale(const Form& a, double k)
+{
+    return {a.center * k, a.terms * k,
+            std::abs(k) * (a.err + ROUNDING * magnitude(a))};
+}
+
+Form sub(const Form& a, const Form& b)
+{
+    return add(a, scale(b, -1));
+}
+
+/*  Returns the largest possible distance of a from its center, given
+ *  bounds on a's value (which may be tighter than its radius)  */
+double deviation(const Form& a, double lo, double hi)
+{
+    const double d = std::max(std::abs(lo - a.center), std::abs(hi - a.center));
+    return std::isfinite(d) ? std::min(d, a.radius()) : a.radius();
+}
+
+Form mul(const Form& a, const Form& b, double a_lo, double a_hi,
+         double b_lo, double b_hi)
+{
+    // The product of the two non-central parts is bounded by the product
+    // of their largest deviations, and goes into the error term
+    return {a.center * b.center,
+            a.terms * b.center + b.terms * a.center,
+            std::abs(a.center) * b.err + std::abs(b.center) * a.err +
+                deviation(a, a_lo, a_hi) * deviation(b, b_lo, b_hi) +
+                ROUNDING * magnitude(a) * magnitude(b)};
+}
+
+/*  Returns alpha * a + zeta, with an extra error of delta  */
+Form linear(const Form& a, double alpha, double zeta, double delta)
+{
+    return {alpha * a.center + zeta, a.terms * alpha,
+            std::abs(alpha) * a.err + delta +
+                ROUNDING * (std::abs(alpha) * magnitude(a) +
+                            std::abs(zeta) + delta)};
+}
+
+/*
+ *  Min-range approximation of a function f over [lo, hi], where the slope
+ *  alpha is chosen so that f(x) - alpha * x is monotonic in that range
+ *  (which means it's bounded by its values at lo and hi).
+ */
+Form minRange(const Form& a, double lo, double hi,
+              double f_lo, double f_hi, double alpha)
+{
+    const double d_lo = f_lo - alpha * lo;
+    const double d_hi = f_hi - alpha * hi;
+    const double slop = ROUNDING * (std::abs(f_lo) + std::abs(f_hi) +
+            std::abs(alpha) * std::max(std::abs(lo), std::abs(hi)));
+    return linear(a, alpha, (d_lo + d_hi) / 2,
+                  std::abs(d_hi - d_lo) / 2 + slop);
+}
+
+/*
+ *  Chebyshev approximation of a convex or concave function f over
+ *  [lo, hi].  The slope alpha is that of the secant through the endpoints,
+ *  and f(x) - alpha * x is bounded by its values at the endpoints and at
+ *  xi, where f'(xi) = alpha.  This is tighter than a min-range
+ *  approximation, but is only used on intervals that are wide enough for
+ *  the secant's slope to be accurate.
+ */
+Form chebyshev(const Form& a, double lo, double hi,
+               double f_lo, double f_hi, double alpha,
+               double xi, double f_xi)
+{
+    const double d_lo = f_lo - alpha * lo;
+    const double d_hi = f_hi - alpha * hi;
+    const double d_xi = f_xi - alpha * xi;
+    const double d_min = std::min(std::min(d_lo, d_hi), d_xi);
+    const double d_max = std::max(std::max(d_lo, d_hi), d_xi);
+    const double slop = ROUNDING * (std::abs(f_lo) + std::abs(f_hi) +
+            std::abs(f_xi) +
+            std::abs(alpha) * std::max(std::abs(lo), std::abs(hi)));
+    return linear(a, alpha, (d_min + d_max) / 2,
+                  (d_max - d_min) / 2 + slop);
+}
+
+/*  Returns true if [lo, hi] is wide enough for a Chebyshev approximation */
+bool isWide(double lo, double hi)
+{
+    return hi - lo > 1e-6 * (std::abs(lo) + std::abs(hi));
+}
+
+/*  Returns the range of an affine form, as a pair of doubles  */
+std::pair<double, double> range(const Form& a)
+{
+    const double r = a.radius();
+    return {a.center - r, a.center + r};
+}
+
+/*
+ *  The functions below approximate a nonlinear function of a, given
+ *  bounds on a's value (which may be tighter than the range of a itself).
+ *  They return false if the bounds are outside the region where the
+ *  approximation is valid.
+ */
+bool square(const Form& a, double lo, double hi, Form& out)
+{
+    if (!std::isfinite(lo) || !std::isfinite(hi))
+    {
+        return false;
+    }
+    // x^2 - alpha * x is smallest at alpha / 2, and this is valid for
+    // any slope, so we don't need to check the interval's width.
+    const double alpha = lo + hi;
+    out = chebyshev(a, lo, hi, lo * lo, hi * hi, alpha,
+                    alpha / 2, alpha * alpha / 4);
+    return true;
+}
+
+bool sqrt(const Form& a, double lo, double hi, Form& out)
+{
+    if (!(lo >= 0 && hi > 0 && std::isfinite(hi)))
+    {
+        return false;
+    }
+    const double s_lo = std::sqrt(lo);
+    const double s_hi = std::sqrt(hi);
+    if (isWide(lo, hi))
+    {
+        const double alpha = (s_hi - s_lo) / (hi - lo);
+        const double xi = std::min(std::max(1 / (4 * alpha * alpha), lo), hi);
+        out = chebyshev(a, lo, hi, s_lo, s_hi, alpha, xi, std::sqrt(xi));
+    }
+    else
+    {
+        // sqrt is concave, so its shallowest slope is at hi
+        out = minRange(a, lo, hi, s_lo, s_hi, 0.5 / s_hi);
+    }
+    return true;
+}
+
+bool recip(const Form& a, double lo, double hi, Form& out)
+{
+    if (!(lo > 0 || hi < 0) || !std::isfinite(lo) || !std::isfinite(hi))
+    {
+        return false;
+    }
+    else if (isWide(lo, hi))
+    {
+        // The secant's slope is -1 / (lo * hi), which is the slope of
+        // 1/x at the geometric mean of lo and hi
+        const double xi = std::copysign(std::sqrt(lo * hi), lo);
+        out = chebyshev(a, lo, hi, 1 / lo, 1 / hi, -1 / (lo * hi),
+                        xi, 1 / xi);
+    }
+    else
+    {
+        // The shallowest slope is at whichever bound is furthest from 0
+        const double m = (lo > 0) ? hi : lo;
+        out = minRange(a, lo, hi, 1 / lo, 1 / hi, -1 / (m * m));
+    }
+    return true;
+}
+
+bool exp(const Form& a, double lo, double hi, Form& out)
+{
+    const double e_lo = std::exp(lo);
+    const double e_hi = std::exp(hi);
+    if (!std::isfinite(lo) || !std::isfinite(e_hi))
+    {
+        return false;
+    }
+    const double alpha = (e_hi - e_lo) / (hi - lo);
+    if (isWide(lo, hi) && alpha > 0)
+    {
+        const double xi = std::min(std::max(std::log(alpha), lo), hi);
+        out = chebyshev(a, lo, hi, e_lo, e_hi, alpha, xi, std::exp(xi));
+    }
+    else
+    {
+        // exp is convex, so its shallowest slope is at lo
+        out = minRange(a, lo, hi, e_lo, e_hi, e_lo);
+    }
+    return true;
+}
+
+bool log(const Form& a, double lo, double hi, Form& out)
+{
+    if (!(lo > 0 && std::isfinite(hi)))
+    {
+        return false;
+    }
+    const double l_lo = std::log(lo);
+    const double l_hi = std::log(hi);
+    if (isWide(lo, hi))
+    {
+        const double alpha = (l_hi - l_lo) / (hi - lo);
+        const double xi = std::min(std::max(1 / alpha, lo), hi);
+        out = chebyshev(a, lo, hi, l_lo, l_hi, alpha, xi, std::log(xi));
+    }
+    else
+    {
+        // log is concave, so its shallowest slope is at hi
+        out = minRange(a, lo, hi, l_lo, l_hi, 1 / hi);
+    }
+    return true;
+}
+
+bool abs(const Form& a, double lo, double hi, Form& out)
+{
+    if (!std::isfinite(lo) || !std::isfinite(hi))
+    {
+        return false;
+    }
+    else if (lo >= 0)
+    {
+        out = a;
+    }
+    else if (hi <= 0)
+    {
+        out = scale(a, -1);
+    }
+    else
+    {
+        // Chebyshev approximation: the line through (lo, |lo|) and
+        // (hi, |hi|), shifted down by half of its distance from the origin
+        const double alpha = (hi + lo) / (hi - lo);
+        const double zeta = -lo * hi / (hi - lo);
+        out = linear(a, alpha, zeta,
+                     zeta + ROUNDING * (std::abs(lo) + std::abs(hi)));
+    }
+    return true;
+}
+
+/*  max(a, b) = (a + b + |a - b|) / 2, and min is the same with -|a - b| */
+bool minMax(const Form& a, const Form& b, bool is_max, Form& out)
+{
+    const auto d = sub(a, b);
+    const auto r = range(d);
+    if (r.first >= 0)
+    {
+        out = is_max ? a : b;
+    }
+    else if (r.second <= 0)
+    {
+        out = is_max ? b : a;
+    }
+    else if (abs(d, r.first, r.second, out))
+    {
+        out = scale(add(add(a, b), is_max ? out : scale(out, -1)), 0.5);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/*  Rounds a double outwards to the nearest float  */
+float roundDown(double d)
+{
+    const float f = static_cast<float>(d);
+    return (f > d) ? std::nextafter(f, -std::numeric_limits<float>::infinity())
+                   : f;
+}
+
+float roundUp(double d)
+{
+    const float f = static_cast<float>(d);
+    return (f < d) ? std::nextafter(f, std::numeric_limits<float>::infinity())
+                   : f;
+}
+
+}   // anonymous namespace
+
+AffineEvaluator::AffineEvaluator(const Tree& root)
+    : AffineEvaluator(std::make_shared<Deck>(root))
+{
+    // Nothing to do here
+}
+
+AffineEvaluator::AffineEvaluator(const Tree& root,
+                                 const std::map<Tree::Id, float>& vars)
+    : AffineEvaluator(std::make_shared<Deck>(root), vars)
+{
+    // Nothing to do here
+}
+
+AffineEvaluator::AffineEvaluator(std::shared_ptr<Deck> d)
+    : AffineEvaluator(d, std::map<Tree::Id, float>())
+{
+    // Nothing to do here
+}
+
+AffineEvaluator::AffineEvaluator(
+        std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars)
+    : BaseEvaluator(d, vars), IntervalEvaluator(d, vars)
+{
+    // Nothing to do here
+}
+
+AffineEvaluator::Form AffineEvaluator::fromInterval(const Interval& i)
+{
+    const double lo = i.lower();
+    const double hi = i.upper();
+    if (std::isfinite(lo) && std::isfinite(hi))
+    {
+        return {(lo + hi) / 2, Eigen::Vector3d::Zero(),
+                (hi - lo) / 2 + ROUNDING * (std::abs(lo) + std::abs(hi))};
+    }
+    else
+    {
+        return {0, Eigen::Vector3d::Zero(),
+                std::numeric_limits<double>::infinity()};
+    }
+}
+
+AffineEvaluator::Form AffineEvaluator::form(Clause::Id id) const
+{
+    return (stamp[id] == generation) ? f[id] : fromInterval(i[id]);
+}
+
+Interval AffineEvaluator::evalAffine(const Eigen::Vector3f& lower,
+                                     const Eigen::Vector3f& upper)
+{
+    return evalAffine(lower, upper, deck->tape);
+}
+
+Interval AffineEvaluator::evalAffine(const Eigen::Vector3f& lower,
+                                     const Eigen::Vector3f& upper,
+                                     const Tape::Handle& tape)
+{
+    assert(!lower.array().isNaN().any()); // A region's bounds should
+    assert(!upper.array().isNaN().any()); // never be NaN.
+
+    if (f.size() != i.size())
+    {
+        f.resize(i.size());
+        stamp.assign(i.size(), 0);
+        generation = 0;
+    }
+
+    // Bump the generation, which invalidates every affine form from the
+    // previous walk (clearing stamps in the rare case that it wraps)
+    if (++generation == 0)
+    {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        generation = 1;
+    }
+
+    const Clause::Id axes[3] = {deck->X, deck->Y, deck->Z};
+    for (unsigned a=0; a < 3; ++a)
+    {
+        const double lo = lower[a];
+        const double hi = upper[a];
+        const auto id = axes[a];
+        i[id] = {lower[a], upper[a]};
+        f[id] = {(lo + hi) / 2, Eigen::Vector3d::Zero(),
+                 ROUNDING * (std::abs(lo) + std::abs(hi))};
+        f[id].terms[a] = (hi - lo) / 2;
+        stamp[id] = generation;
+    }
+
+    for (auto& o : deck->oracles)
+    {
+        o->set(lower, upper);
+    }
+
+    deck->bindOracles(*tape);
+    for (auto itr = tape->rbegin(); itr != tape->rend(); ++itr) {
+        affine(itr->op, itr->id, itr->a, itr->b);
+    }
+    deck->unbindOracles();
+
+    return i[tape->root()];
+}
+
+std::pair<Interval, Tape::Handle> AffineEvaluator::affineAndPush(
+        const Eigen::Vector3f& lower,
+        const Eigen::Vector3f& upper)
+{
+    return affineAndPush(lower, upper, deck->tape);
+}
+
+std::pair<Interval, Tape::Handle> AffineEvaluator::affineAndPush(
+        const Eigen::Vector3f& lower,
+        const Eigen::Vector3f& upper,
+        const Tape::Handle& tape)
+{
+    auto out = evalAffine(lower, upper, tape);
+    return std::make_pair(out, pushIntervals(tape));
+}
+
+void AffineEvaluator::affine(Opcode::Opcode op, Clause::Id id,
+                             Clause::Id a_, Clause::Id b_)
+{
+    if (op == Opcode::ORACLE)
+    {
+        (*this)(op, id, a_, b_);
+        f[id] = fromInterval(i[id]);
+        stamp[id] = generation;
+        return;
+    }
+
+    // Load arguments (as both intervals and affine forms) before doing the
+    // interval evaluation, since the clause may store its result into the
+    // same slot as one of its arguments.
+    Form a = form(a_);
+    Interval ia = i[a_];
+    Form b = constant(0);
+    Interval ib(0.0f);
+    const Opcode::Opcode clause_op = op;
+    if (Opcode::hasImmediate(op))
+    {
+        bool swap;
+        op = Opcode::withoutImmediate(op, swap);
+        const float k = Clause::immediate(b_);
+        b = constant(k);
+        ib = Interval(k, k);
+        if (swap)
+        {
+            std::swap(a, b);
+            std::swap(ia, ib);
+        }
+    }
+    else if (Opcode::args(op) == 2)
+    {
+        b = form(b_);
+        ib = i[b_];
+    }
+    (*this)(clause_op, id, a_, b_);
+
+    // Nonlinear approximations are built over the arguments' intervals,
+    // which are at least as tight as the affine forms' ranges.
+    const double a_lo = ia.lower();
+    const double a_hi = ia.upper();
+    const double b_lo = ib.lower();
+    const double b_hi = ib.upper();
+
+    Form out = constant(0);
+    bool ok = true;
+    switch (op)
+    {
+        case Opcode::OP_ADD:
+            out = add(a, b);
+            break;
+        case Opcode::OP_SUB:
+            out = sub(a, b);
+            break;
+        case Opcode::OP_NEG:
+            out = scale(a, -1);
+            break;
+        case Opcode::OP_MUL:
+            out = mul(a, b, a_lo, a_hi, b_lo, b_hi);
+            break;
+        case Opcode::OP_DIV:
+            ok = recip(b, b_lo, b_hi, out);
+            if (ok)
+            {
+                out = mul(a, out, a_lo, a_hi, 1 / b_hi, 1 / b_lo);
+            }
+            break;
+        case Opcode::OP_MIN:
+        case Opcode::OP_MAX:
+            ok = minMax(a, b, op == Opcode::OP_MAX, out);
+            break;
+        case Opcode::OP_SQUARE:
+            ok = square(a, a_lo, a_hi, out);
+            break;
+        case Opcode::OP_SQRT:
+            ok = sqrt(a, a_lo, a_hi, out);
+            break;
+        case Opcode::OP_RECIP:
+            ok = recip(a, a_lo, a_hi, out);
+            break;
+        case Opcode::OP_ABS:
+            ok = abs(a, a_lo, a_hi, out);
+            break;
+        case Opcode::OP_EXP:
+            ok = exp(a, a_lo, a_hi, out);
+            break;
+        case Opcode::OP_LOG:
+            ok = log(a, a_lo, a_hi, out);
+            break;
+        case Opcode::CONST_VAR:
+            out = a;
+            break;
+
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_HYPOT:
+        {
+            Form sa, sb;
+            ok = square(a, a_lo, a_hi, sa) && square(b, b_lo, b_hi, sb);
+            if (ok)
+            {
+                out = add(sa, sb);
+            }
+            if (ok && op == Opcode::OP_HYPOT)
+            {
+                // A sum of squares is never negative, so the range of its
+                // affine form is clamped before taking the square root
+                const auto r = range(out);
+                ok = sqrt(out, std::max(r.first, 0.0), r.second, out);
+            }
+            break;
+        }
+        case Opcode::OP_ADD_SQUARE:
+        case Opcode::OP_SQRT_ADD_SQUARE:
+        {
+            Form sb;
+            ok = square(b, b_lo, b_hi, sb);
+            if (ok)
+            {
+                out = add(a, sb);
+            }
+            if (ok && op == Opcode::OP_SQRT_ADD_SQUARE)
+            {
+                const auto r = range(out);
+                ok = sqrt(out, r.first, r.second, out);
+            }
+            break;
+        }
+
+        // Everything else uses the interval result
+        case Opcode::OP_SIN:
+        case Opcode::OP_COS:
+        case Opcode::OP_TAN:
+        case Opcode::OP_ASIN:
+        case Opcode::OP_ACOS:
+        case Opcode::OP_ATAN:
+        case Opcode::OP_ATAN2:
+        case Opcode::OP_POW:
+        case Opcode::OP_NTH_ROOT:
+        case Opcode::OP_MOD:
+        case Opcode::OP_NANFILL:
+        case Opcode::OP_COMPARE:
+            ok = false;
+            break;
+
+        // Immediates were unpacked above, and oracles are handled
+        // before evaluating any affine forms
+        case Opcode::OP_ADD_IMM:
+        case Opcode::OP_SUB_IMM:
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_MUL_IMM:
+        case Opcode::OP_DIV_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM:
+        case Opcode::ORACLE:
+        case Opcode::INVALID:
+        case Opcode::CONSTANT:
+        case Opcode::VAR_X:
+        case Opcode::VAR_Y:
+        case Opcode::VAR_Z:
+        case Opcode::VAR_FREE:
+        case Opcode::LAST_OP:
+            assert(false);
+            ok = false;
+            break;
+    }
+
+    Interval& r = i[id];
+    if (ok && isBounded(out))
+    {
+        // Tighten the interval result with the affine form's range.  The
+        // comparisons are written so that intervals with NaN bounds are
+        // left alone.
+        const auto bounds = range(out);
+        const float lo = std::max(r.lower(), roundDown(bounds.first));
+        const float hi = std::min(r.upper(), roundUp(bounds.second));
+        if (lo <= hi && (lo > r.lower() || hi < r.upper()))
+        {
+            r = Interval(lo, hi, !r.isSafe());
+        }
+    }
+    else
+    {
+        out = fromInterval(r);
+    }
+    f[id] = out;
+    stamp[id] = generation;
+}
+
+}   // namespace libfive
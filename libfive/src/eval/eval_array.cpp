@@ -7,9 +7,15 @@ This Source Code Form is subject to the terms of the Mozilla Public
 License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
+#include <algorithm>
+
 #include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/simd.hpp"
 #include "libfive/eval/tape.hpp"
 #include "libfive/eval/deck.hpp"
+#include "libfive/eval/compiled_tape.hpp"
+
+#include "tape.inl"
 
 namespace libfive {
 
@@ -34,12 +40,27 @@ ArrayEvaluator::ArrayEvaluator(std::shared_ptr<Deck> d)
     // Nothing to do here
 }
 
+/*
+ *  Rounds the width up to a multiple of 16, which covers the widest SIMD
+ *  block (AVX-512) and the 8-wide chunks used by CompiledTape.
+ */
+static size_t paddedWidth(size_t width)
+{
+    return (width + 15) / 16 * 16;
+}
+
 ArrayEvaluator::ArrayEvaluator(
-        std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars)
-    : BaseEvaluator(d, vars), v(deck->num_clauses + 1, N), ambig(false)
+        std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars,
+        size_t width)
+    : BaseEvaluator(d, vars), batch_width(width),
+      v(deck->num_slots + 1, paddedWidth(width)),
+      ambig(1, paddedWidth(width))
 {
+    assert(width > 0);
+
     // Initialize the whole data array as zero, to prevent Valgrind warnings.
     v.array() = 0;
+    ambig = false;
 
     // Unpack variables into result array
     for (auto& var_ : deck->vars.right)
@@ -53,6 +74,19 @@ ArrayEvaluator::ArrayEvaluator(
     {
         v.row(c.first) = c.second;
     }
+
+    updateInvariant();
+}
+
+void ArrayEvaluator::updateInvariant()
+{
+    // Invariant clauses are evaluated across the whole array, so that
+    // every point sees their values.
+    setCount(width());
+    for (const auto& c : deck->invariant)
+    {
+        (*this)(c.op, c.id, c.a, c.b);
+    }
 }
 
 float ArrayEvaluator::value(const Eigen::Vector3f& pt) {
@@ -77,28 +111,27 @@ void ArrayEvaluator::setCount(size_t count)
 {
     count_actual = count;
 
+    // Eigen's block size is fixed at compile time, while the SIMD
+    // kernels' block size depends on which level is picked at runtime.
 #if defined EIGEN_VECTORIZE_AVX512
-    #define LIBFIVE_SIMD_SIZE 16
+    #define LIBFIVE_EIGEN_SIMD_SIZE 16
 #elif defined EIGEN_VECTORIZE_AVX
-    #define LIBFIVE_SIMD_SIZE 8
+    #define LIBFIVE_EIGEN_SIMD_SIZE 8
 #elif defined EIGEN_VECTORIZE_SSE
-    #define LIBFIVE_SIMD_SIZE 4
+    #define LIBFIVE_EIGEN_SIMD_SIZE 4
 #elif defined EIGEN_VECTORIZE
     #warning "EIGEN_VECTORIZE is set but no vectorization flag is found"
-    #define LIBFIVE_SIMD_SIZE 0
+    #define LIBFIVE_EIGEN_SIMD_SIZE 1
 #else
     #warning "No SIMD flags detected"
-    #define LIBFIVE_SIMD_SIZE 0
+    #define LIBFIVE_EIGEN_SIMD_SIZE 1
 #endif
-    // If we have SIMD instructions, then round the evaluation size up
-    // to the nearest block, to avoid issues where Eigen's SIMD and
-    // non-SIMD paths produce different results.
-    if (LIBFIVE_SIMD_SIZE) {
-        count_simd = ((count + LIBFIVE_SIMD_SIZE - 1) / LIBFIVE_SIMD_SIZE)
-                * LIBFIVE_SIMD_SIZE;
-    } else {
-        count_simd = count;
-    }
+    const size_t block = std::max<size_t>(LIBFIVE_EIGEN_SIMD_SIZE,
+            Simd::blockSize(Simd::level()));
+
+    // Round the evaluation size up to the nearest block, to avoid issues
+    // where the SIMD and non-SIMD paths produce different results.
+    count_simd = (count + block - 1) / block * block;
 }
 
 Eigen::Block<decltype(ArrayEvaluator::v), 1, Eigen::Dynamic>
@@ -107,8 +140,23 @@ ArrayEvaluator::values(size_t count, const Tape& tape)
     setCount(count);
 
     deck->bindOracles(tape);
-    for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr) {
-        (*this)(itr->op, itr->id, itr->a, itr->b);
+    if (backend == JIT && CompiledTape::available()) {
+        const auto c = tape.compiled(v.cols());
+        for (auto& s : c->segments()) {
+            if (s.fn) {
+                c->call(s, v.data(), (count_simd + 7) / 8);
+            } else {
+                for (auto itr = tape.rbegin() + s.begin;
+                     itr != tape.rbegin() + s.end; ++itr)
+                {
+                    (*this)(itr->op, itr->id, itr->a, itr->b);
+                }
+            }
+        }
+    } else {
+        for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr) {
+            (*this)(itr->op, itr->id, itr->a, itr->b);
+        }
     }
     deck->unbindOracles();
 
@@ -169,6 +217,18 @@ std::pair<float, Tape::Handle> ArrayEvaluator::valueAndPush(
 
 ////////////////////////////////////////////////////////////////////////////////
 
+bool ArrayEvaluator::setBackend(Backend b)
+{
+    if (b == JIT && !CompiledTape::available())
+    {
+        return false;
+    }
+    backend = b;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 bool ArrayEvaluator::setVar(Tree::Id var_, float value)
 {
     auto var = deck->vars.right.find(var_);
@@ -176,6 +236,10 @@ bool ArrayEvaluator::setVar(Tree::Id var_, float value)
     {
         bool changed = v(var->second, 0) != value;
         v.row(var->second) = value;
+        if (changed)
+        {
+            updateInvariant();
+        }
         return changed;
     }
     else
@@ -184,6 +248,26 @@ bool ArrayEvaluator::setVar(Tree::Id var_, float value)
     }
 }
 
+bool ArrayEvaluator::updateVars(const std::map<Tree::Id, float>& vars)
+{
+    bool changed = false;
+    for (auto& v_ : vars)
+    {
+        auto var = deck->vars.right.find(v_.first);
+        if (var != deck->vars.right.end() &&
+            v(var->second, 0) != v_.second)
+        {
+            v.row(var->second) = v_.second;
+            changed = true;
+        }
+    }
+    if (changed)
+    {
+        updateInvariant();
+    }
+    return changed;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 Eigen::Block<decltype(ArrayEvaluator::ambig), 1, Eigen::Dynamic>
@@ -209,6 +293,12 @@ ArrayEvaluator::getAmbiguous(size_t i, const Tape& tape)
                 (v.block(itr->a, 0, 1, i) ==
                  v.block(itr->b, 0, 1, i));
         }
+        else if (itr->op == Opcode::OP_MIN_IMM ||
+                 itr->op == Opcode::OP_MAX_IMM)
+        {
+            ambig.head(i) = ambig.head(i) ||
+                (v.block(itr->a, 0, 1, i) == Clause::immediate(itr->b));
+        }
     };
 
     return ambig.head(i);
@@ -222,35 +312,55 @@ void ArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 #define out v.block<1, Eigen::Dynamic>(id, 0, 1, count_simd)
 #define a v.row(a_).head(count_simd)
 #define b v.row(b_).head(count_simd)
+#define k Clause::immediate(b_)
     switch (op)
     {
         case Opcode::OP_ADD:
-            out = a + b;
-            break;
         case Opcode::OP_MUL:
-            out = a * b;
-            break;
         case Opcode::OP_MIN:
-            out = a.cwiseMin(b);
-            break;
         case Opcode::OP_MAX:
-            out = a.cwiseMax(b);
-            break;
         case Opcode::OP_SUB:
-            out = a - b;
-            break;
         case Opcode::OP_DIV:
-            out = a / b;
-            break;
+        case Opcode::OP_SQUARE:
+        case Opcode::OP_SQRT:
+        case Opcode::OP_NEG:
+        case Opcode::OP_ABS:
+        case Opcode::OP_RECIP:
+        case Opcode::CONST_VAR:
+        case Opcode::OP_ADD_IMM:
+        case Opcode::OP_SUB_IMM:
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_MUL_IMM:
+        case Opcode::OP_DIV_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM:
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_ADD_SQUARE:
+        case Opcode::OP_HYPOT:
+        case Opcode::OP_SQRT_ADD_SQUARE:
+        case Opcode::OP_SIN:
+        case Opcode::OP_COS:
+        case Opcode::OP_TAN:
+        case Opcode::OP_ASIN:
+        case Opcode::OP_ACOS:
+        case Opcode::OP_ATAN:
+        case Opcode::OP_LOG:
+        case Opcode::OP_EXP:
         case Opcode::OP_ATAN2:
-            for (auto i=0; i < a.size(); ++i)
-            {
-                out(i) = atan2f(a(i), b(i));
-            }
-            break;
         case Opcode::OP_POW:
-            out = a.pow(b);
+        case Opcode::OP_MOD:
+        case Opcode::OP_NANFILL:
+        case Opcode::OP_COMPARE:
+        {
+            // Elementwise arithmetic runs in the SIMD kernels, which are
+            // picked at runtime (see simd.hpp)
+            const bool ok = Simd::kernels().array(op, &v(id, 0), &v(a_, 0),
+                Opcode::args(op) == 2 ? &v(b_, 0) : nullptr, k, count_simd);
+            assert(ok);
+            (void)ok;
             break;
+        }
         case Opcode::OP_NTH_ROOT:
             for (auto i=0; i < a.size(); ++i)
             {
@@ -264,89 +374,6 @@ void ArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
                     out(i) = powf(a(i), 1.0f/b(i));
             }
             break;
-        case Opcode::OP_MOD:
-            // We choose to match Python's behavior:
-            //  If b is positive, then the result is in the range [ 0, b]
-            //  If b is negative, then the result is in the range [-b, 0]
-            //  If b is zero, then the result is NaN
-            for (auto i=0; i < a.size(); ++i)
-            {
-                float d = fabs(a(i) / b(i));
-                if ((a(i) < 0) ^ (b(i) < 0)) {
-                    d = -ceil(d);
-                } else {
-                    d = floor(d);
-                }
-                out(i) = a(i) - b(i) * d;
-
-                // Clamping for safety
-                if ((b(i) > 0 && out(i) > b(i)) ||
-                    (b(i) < 0 && out(i) < b(i)))
-                {
-                    out(i) = b(i);
-                }
-                if ((b(i) > 0.0f && out(i) < 0.0f) ||
-                    (b(i) < 0.0f && out(i) > 0.0f))
-                {
-                    out(i) = 0.0f;
-                }
-            }
-            break;
-        case Opcode::OP_NANFILL:
-            out = a.isNaN().select(b, a);
-            break;
-        case Opcode::OP_COMPARE:
-            for (auto i=0; i < a.size(); ++i)
-            {
-                if      (a(i) < b(i))   out(i) = -1;
-                else if (a(i) > b(i))   out(i) =  1;
-                else                    out(i) =  0;
-            }
-            break;
-
-        case Opcode::OP_SQUARE:
-            out = a * a;
-            break;
-        case Opcode::OP_SQRT:
-            out = sqrt(a);
-            break;
-        case Opcode::OP_NEG:
-            out = -a;
-            break;
-        case Opcode::OP_SIN:
-            out = sin(a);
-            break;
-        case Opcode::OP_COS:
-            out = cos(a);
-            break;
-        case Opcode::OP_TAN:
-            out = tan(a);
-            break;
-        case Opcode::OP_ASIN:
-            out = asin(a);
-            break;
-        case Opcode::OP_ACOS:
-            out = acos(a);
-            break;
-        case Opcode::OP_ATAN:
-            out = atan(a);
-            break;
-        case Opcode::OP_LOG:
-            out = log(a);
-            break;
-        case Opcode::OP_EXP:
-            out = exp(a);
-            break;
-        case Opcode::OP_ABS:
-            out = abs(a);
-            break;
-        case Opcode::OP_RECIP:
-            out = 1 / a;
-            break;
-
-        case Opcode::CONST_VAR:
-            out = a;
-            break;
 
         case Opcode::ORACLE:
             deck->oracles[a_]->evalArray(
@@ -364,6 +391,7 @@ void ArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 #undef out
 #undef a
 #undef b
+#undef k
 }
 
 }   // namespace libfive
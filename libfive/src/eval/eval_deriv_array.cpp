@@ -8,6 +8,7 @@ License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #include "libfive/eval/eval_deriv_array.hpp"
+#include "libfive/eval/simd.hpp"
 #include "libfive/eval/deck.hpp"
 #include "libfive/eval/tape.hpp"
 
@@ -33,14 +34,15 @@ DerivArrayEvaluator::DerivArrayEvaluator(std::shared_ptr<Deck> d)
 }
 
 DerivArrayEvaluator::DerivArrayEvaluator(
-        std::shared_ptr<Deck> deck, const std::map<Tree::Id, float>& vars)
-    : BaseEvaluator(deck, vars), ArrayEvaluator(deck, vars),
-      d(deck->num_clauses + 1, 1)
+        std::shared_ptr<Deck> deck, const std::map<Tree::Id, float>& vars,
+        size_t width)
+    : BaseEvaluator(deck, vars), ArrayEvaluator(deck, vars, width),
+      d(deck->num_slots + 1, 1), out(4, v.cols())
 {
     // Initialize all derivatives to zero
     for (Eigen::Index i=0; i < d.rows(); ++i)
     {
-        d(i) = 0;
+        d(i).setZero(3, v.cols());
     }
 
     // Load immutable derivatives for X, Y, Z
@@ -74,6 +76,14 @@ DerivArrayEvaluator::getAmbiguousDerivs(size_t i, const Tape& tape)
                   (d(itr->a).leftCols(i) != d(itr->b).leftCols(i))
                     .colwise().sum());
         }
+        else if (itr->op == Opcode::OP_MIN_IMM ||
+                 itr->op == Opcode::OP_MAX_IMM)
+        {
+            // Immediates have zero derivatives
+            ambig.head(i) = ambig.head(i) ||
+                ((v.block(itr->a, 0, 1, i) == Clause::immediate(itr->b)) &&
+                  (d(itr->a).leftCols(i) != 0).colwise().sum());
+        }
     }
 
     return ambig.head(i);
@@ -101,17 +111,20 @@ DerivArrayEvaluator::derivs(size_t count)
 Eigen::Block<decltype(DerivArrayEvaluator::out), 4, Eigen::Dynamic>
 DerivArrayEvaluator::derivs(size_t count, const Tape& tape)
 {
-    // Perform value evaluation, copying results into the 4th row of out
-    out.row(3).head(count) = values(count, tape);
+    setCount(count);
 
-    // Perform derivative evaluation, copying results into the out array
+    // Perform value and derivative evaluation in a single pass, since
+    // result slots are reused once a clause's value is no longer needed
+    // (so the derivative pass can't run after the whole value pass).
     deck->bindOracles(tape);
     for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr) {
+        ArrayEvaluator::operator()(itr->op, itr->id, itr->a, itr->b);
         (*this)(itr->op, itr->id, itr->a, itr->b);
     }
     deck->unbindOracles();
 
-    // Return a block of valid results from the out array
+    // Copy values into the 4th row of out and derivatives into the rest
+    out.row(3).head(count) = v.block(tape.root(), 0, 1, count);
     out.topLeftCorner(3, count) = d(tape.root()).leftCols(count);
     return out.block<4, Eigen::Dynamic>(0, 0, 4, count);
 }
@@ -128,41 +141,54 @@ void DerivArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 #define bv v.row(b_).head(count_simd)
 #define bd d(b_).leftCols(count_simd)
 
+#define k Clause::immediate(b_)
+
     switch (op) {
         case Opcode::OP_ADD:
-            od = ad + bd;
-            break;
         case Opcode::OP_MUL:
-            // Product rule
-            od = bd.rowwise()*av + ad.rowwise()*bv;
-            break;
         case Opcode::OP_MIN:
-            for (Eigen::Index i=0; i < od.rows(); ++i)
-                od.row(i) = (av < bv).select(ad.row(i), bd.row(i));
-            break;
         case Opcode::OP_MAX:
-            for (Eigen::Index i=0; i < od.rows(); ++i)
-                od.row(i) = (av < bv).select(bd.row(i), ad.row(i));
-            break;
         case Opcode::OP_SUB:
-            od = ad - bd;
-            break;
         case Opcode::OP_DIV:
-            od = (ad.rowwise()*bv - bd.rowwise()*av).rowwise() /
-                 bv.pow(2);
-            break;
+        case Opcode::OP_SQUARE:
+        case Opcode::OP_SQRT:
+        case Opcode::OP_NEG:
+        case Opcode::OP_ABS:
+        case Opcode::OP_RECIP:
+        case Opcode::OP_ADD_IMM:
+        case Opcode::OP_SUB_IMM:
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_MUL_IMM:
+        case Opcode::OP_DIV_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM:
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_ADD_SQUARE:
+        case Opcode::OP_HYPOT:
+        case Opcode::OP_SQRT_ADD_SQUARE:
+        case Opcode::OP_SIN:
+        case Opcode::OP_COS:
+        case Opcode::OP_TAN:
+        case Opcode::OP_ASIN:
+        case Opcode::OP_ACOS:
+        case Opcode::OP_ATAN:
+        case Opcode::OP_LOG:
+        case Opcode::OP_EXP:
         case Opcode::OP_ATAN2:
-            od = (ad.rowwise()*bv - bd.rowwise()*av).rowwise() /
-                 (av.pow(2) + bv.pow(2));
-            break;
         case Opcode::OP_POW:
-            // The full form of the derivative is
-            // od = m * (bv * ad + av * log(av) * bd))
-            // However, log(av) is often NaN and bd is always zero,
-            // (since it must be CONST), so we skip that part.
-            od = ad.rowwise() * (bv * av.pow(bv - 1));
+        {
+            // Elementwise derivatives run in the SIMD kernels, which are
+            // picked at runtime (see simd.hpp)
+            const bool two = Opcode::args(op) == 2;
+            const bool ok = Simd::kernels().deriv(op,
+                d(id).data(), &v(id, 0), &v(a_, 0), d(a_).data(),
+                two ? &v(b_, 0) : nullptr, two ? d(b_).data() : nullptr,
+                k, count_simd);
+            assert(ok);
+            (void)ok;
             break;
-
+        }
         case Opcode::OP_NTH_ROOT:
             for (Eigen::Index i=0; i < od.cols(); ++i)
                 od.col(i) = (ad.col(i) == 0)
@@ -180,50 +206,6 @@ void DerivArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
                 od.row(i).setZero();
             break;
 
-        case Opcode::OP_SQUARE:
-            od = ad.rowwise() * av * 2;
-            break;
-        case Opcode::OP_SQRT:
-            for (Eigen::Index i=0; i < od.rows(); ++i)
-                od.row(i) = (av < 0 || ad.row(i) == 0).select(
-                    Eigen::Array<float, 1, Eigen::Dynamic>::Zero(1, count_simd),
-                    ad.row(i) / (2 * ov));
-            break;
-        case Opcode::OP_NEG:
-            od = -ad;
-            break;
-        case Opcode::OP_SIN:
-            od = ad.rowwise() * cos(av);
-            break;
-        case Opcode::OP_COS:
-            od = ad.rowwise() * -sin(av);
-            break;
-        case Opcode::OP_TAN:
-            od = ad.rowwise() * pow(1/cos(av), 2);
-            break;
-        case Opcode::OP_ASIN:
-            od = ad.rowwise() / sqrt(1 - pow(av, 2));
-            break;
-        case Opcode::OP_ACOS:
-            od = ad.rowwise() / -sqrt(1 - pow(av, 2));
-            break;
-        case Opcode::OP_ATAN:
-            od = ad.rowwise() / (pow(av, 2) + 1);
-            break;
-        case Opcode::OP_LOG:
-            od = ad.rowwise() / av;
-            break;
-        case Opcode::OP_EXP:
-            od = ad.rowwise() * exp(av);
-            break;
-        case Opcode::OP_ABS:
-            for (Eigen::Index i=0; i < od.rows(); ++i)
-                od.row(i) = (av > 0).select(ad.row(i), -ad.row(i));
-            break;
-        case Opcode::OP_RECIP:
-            od = ad.rowwise() / -av.pow(2);
-            break;
-
         case Opcode::CONST_VAR:
             if (clear_vars) {
                 od = 0.0;
@@ -253,6 +235,8 @@ void DerivArrayEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 #undef bv
 #undef bd
 
+#undef k
+
 }
 
 }   // namespace libfive
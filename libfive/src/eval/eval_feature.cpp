@@ -26,9 +26,10 @@ FeatureEvaluator::FeatureEvaluator(std::shared_ptr<Deck> d)
 }
 
 FeatureEvaluator::FeatureEvaluator(
-        std::shared_ptr<Deck> t, const std::map<Tree::Id, float>& vars)
-    : BaseEvaluator(t, vars), DerivArrayEvaluator(t, vars),
-      f(1, deck->num_clauses + 1), filled(1, deck->num_clauses + 1)
+        std::shared_ptr<Deck> t, const std::map<Tree::Id, float>& vars,
+        size_t width)
+    : BaseEvaluator(t, vars), DerivArrayEvaluator(t, vars, width),
+      f(1, deck->num_slots + 1), filled(1, deck->num_slots + 1)
 {
     // Load the default derivatives
     f(deck->X).push_back(Feature(Eigen::Vector3f(1, 0, 0)));
@@ -46,6 +47,12 @@ FeatureEvaluator::FeatureEvaluator(
     {
         f(c.first).push_back(Feature(Eigen::Vector3f::Zero()));
     }
+
+    // Same for invariant clauses, which don't depend on X, Y, Z
+    for (auto& c : deck->invariant)
+    {
+        f(c.id).push_back(Feature(Eigen::Vector3f::Zero()));
+    }
 }
 
 bool FeatureEvaluator::isInside(const Eigen::Vector3f& p)
@@ -78,12 +85,9 @@ bool FeatureEvaluator::isInside(const Eigen::Vector3f& p,
 
     // First, we evaluate and extract all of the features, saving
     // time by re-using the shortened tape from valueAndPush
-    for (auto itr = handle.second->rbegin();
-         itr != handle.second->rend();
-         ++itr)
-    {
-        (*this)(itr->op, itr->id, itr->a, itr->b);
-    }
+    deck->bindOracles(*handle.second);
+    walk(*handle.second);
+    deck->unbindOracles();
     auto fs = f(handle.second->root());
 
     // If this is a freshly allocated tape, then release it to the Deck
@@ -131,9 +135,7 @@ const boost::container::small_vector<Feature, 4>&
 
     // Evaluate feature-wise
     deck->bindOracles(*handle.second);
-    for (auto itr = handle.second->rbegin(); itr != handle.second->rend(); ++itr) {
-        (*this)(itr->op, itr->id, itr->a, itr->b);
-    }
+    walk(*handle.second);
     deck->unbindOracles();
 
     const auto root = handle.second->root();
@@ -168,17 +170,38 @@ std::list<Eigen::Vector3f> FeatureEvaluator::features(
     return out;
 }
 
+void FeatureEvaluator::walk(const Tape& tape)
+{
+    for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr)
+    {
+        // The shortened tape may use different result slots than the tape
+        // that was evaluated in valueAndPush, so we recalculate each
+        // clause's value (in slot 0) before finding its features.
+        setCount(1);
+        ArrayEvaluator::operator()(itr->op, itr->id, itr->a, itr->b);
+        filled(itr->id) = 1;
+
+        (*this)(itr->op, itr->id, itr->a, itr->b);
+    }
+}
+
 void FeatureEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
                                   Clause::Id a, Clause::Id b)
 {
+    // Min and max with an immediate use the same logic as min and max,
+    // where b is a constant (with a single all-zero derivative).
+    const bool imm = (op == Opcode::OP_MIN_IMM || op == Opcode::OP_MAX_IMM);
+    static const boost::container::small_vector<Feature, 4> imm_features =
+        {Feature(Eigen::Vector3f::Zero())};
+
 #define of f(id)
 
 #define av v(a, 0)
 #define _ads f(a)
 #define ad _ad.deriv
 
-#define bv v(b, 0)
-#define _bds f(b)
+#define bv (imm ? Clause::immediate(b) : v(b, 0))
+#define _bds (imm ? imm_features : f(b))
 #define bd _bd.deriv
 
 #define LOOP2 \
@@ -187,8 +210,8 @@ void FeatureEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 
     of.clear();
 
-    if (op == Opcode::OP_MIN) {
-        if (av < bv || a == b) {
+    if (op == Opcode::OP_MIN || op == Opcode::OP_MIN_IMM) {
+        if (av < bv || (a == b && !imm)) {
             of = _ads;
         } else if (av > bv) {
             of = _bds;
@@ -225,8 +248,8 @@ void FeatureEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
                 }
             }
         }
-    } else if (op == Opcode::OP_MAX) {
-        if (av < bv || a == b) {
+    } else if (op == Opcode::OP_MAX || op == Opcode::OP_MAX_IMM) {
+        if (av < bv || (a == b && !imm)) {
             of = _bds;
         } else if (av > bv) {
             of = _ads;
@@ -287,7 +310,7 @@ void FeatureEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
 
         for (auto& _ad : _ads) {
             d(a).col(count++) = _ad.deriv;
-            if (count == N) {
+            if (count == width()) {
                 run();
             }
         }
@@ -318,7 +341,7 @@ void FeatureEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
             for (auto& _bd : _bds) {
                 d(a).col(count) = _ad.deriv;
                 d(b).col(count) = _bd.deriv;
-                if (++count == N) {
+                if (++count == width()) {
                     run();
                 }
             }
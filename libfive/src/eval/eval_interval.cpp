@@ -7,13 +7,68 @@ This Source Code Form is subject to the terms of the Mozilla Public
 License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
+#include <cmath>
+
 #include "libfive/eval/eval_interval.hpp"
+#include "libfive/eval/simd.hpp"
 #include "libfive/eval/deck.hpp"
 #include "libfive/eval/tape.hpp"
 #include "libfive/render/brep/region.hpp"
 
+#include "tape.inl"
+
 namespace libfive {
 
+namespace {
+
+/*
+ *  Decides which branches of a min or max clause to keep, given accessors
+ *  for the lower and upper bounds of each slot.  This is shared between
+ *  single and batched interval evaluation.
+ */
+template <typename L, typename U>
+Tape::Keep keepBranches(Opcode::Opcode op, Clause::Id a, Clause::Id b,
+                        L lower, U upper)
+{
+    // For min and max operations, we may only need to keep one branch
+    // active if it is decisively above or below the other branch.
+    if (op == Opcode::OP_MAX)
+    {
+        if (a == b)
+        {
+            return Tape::KEEP_A;
+        }
+        else if (lower(a) > upper(b))
+        {
+            return Tape::KEEP_A;
+        }
+        else if (lower(b) > upper(a))
+        {
+            return Tape::KEEP_B;
+        }
+        return Tape::KEEP_BOTH;
+    }
+    else if (op == Opcode::OP_MIN)
+    {
+        if (a == b)
+        {
+            return Tape::KEEP_A;
+        }
+        else if (lower(a) > upper(b))
+        {
+            return Tape::KEEP_B;
+        }
+        else if (lower(b) > upper(a))
+        {
+            return Tape::KEEP_A;
+        }
+        return Tape::KEEP_BOTH;
+    }
+    return Tape::KEEP_ALWAYS;
+}
+
+}   // anonymous namespace
+
 IntervalEvaluator::IntervalEvaluator(const Tree& root)
     : IntervalEvaluator(std::make_shared<Deck>(root))
 {
@@ -37,7 +92,7 @@ IntervalEvaluator::IntervalEvaluator(
         std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars)
     : BaseEvaluator(d, vars)
 {
-    i.resize(d->num_clauses + 1);
+    i.resize(d->num_slots + 1);
 
     // Unpack variables into result array
     for (auto& v : d->vars.right)
@@ -51,6 +106,17 @@ IntervalEvaluator::IntervalEvaluator(
     {
         store(c.second, c.first);
     }
+
+    updateInvariant();
+}
+
+void IntervalEvaluator::updateInvariant()
+{
+    for (const auto& c : deck->invariant)
+    {
+        (*this)(c.op, c.id, c.a, c.b);
+    }
+    batch_broadcast = 0;
 }
 
 
@@ -73,6 +139,14 @@ Interval IntervalEvaluator::eval(
     assert(!lower.array().isNaN().any()); // A region's bounds should
     assert(!upper.array().isNaN().any()); // never be NaN.
 
+    if (backend == SIMD)
+    {
+        walkBatch(&lower, &upper, 1, tape);
+        const auto root = tape->root();
+        return Interval(batch_lower(root, 0), batch_upper(root, 0),
+                        batch_nan(root, 0));
+    }
+
     i[deck->X] = {lower.x(), upper.x()};
     i[deck->Y] = {lower.y(), upper.y()};
     i[deck->Z] = {lower.z(), upper.z()};
@@ -116,7 +190,11 @@ Tape::Handle IntervalEvaluator::push()
 Tape::Handle IntervalEvaluator::push(const Tape::Handle& tape)
 {
     assert(tape.get() != nullptr);
+    return (backend == SIMD) ? pushBatch(tape, 0) : pushIntervals(tape);
+}
 
+Tape::Handle IntervalEvaluator::pushIntervals(const Tape::Handle& tape)
+{
     const Region<3> R(Eigen::Vector3d(i[deck->X].lower(),
                                       i[deck->Y].lower(),
                                       i[deck->Z].lower()),
@@ -127,41 +205,144 @@ Tape::Handle IntervalEvaluator::push(const Tape::Handle& tape)
         [&](Opcode::Opcode op, Clause::Id /* id */,
             Clause::Id a, Clause::Id b)
     {
-        // For min and max operations, we may only need to keep one branch
-        // active if it is decisively above or below the other branch.
-        if (op == Opcode::OP_MAX)
+        return keepBranches(op, a, b,
+            [&](Clause::Id c) { return i[c].lower(); },
+            [&](Clause::Id c) { return i[c].upper(); });
+    },
+    Tape::INTERVAL, R);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<Interval> IntervalEvaluator::evalBatch(
+        const std::vector<Eigen::Vector3f>& lower,
+        const std::vector<Eigen::Vector3f>& upper)
+{
+    return evalBatch(lower, upper, deck->tape);
+}
+
+std::vector<Interval> IntervalEvaluator::evalBatch(
+        const std::vector<Eigen::Vector3f>& lower,
+        const std::vector<Eigen::Vector3f>& upper,
+        const Tape::Handle& tape)
+{
+    assert(lower.size() == upper.size());
+    walkBatch(lower.data(), upper.data(), lower.size(), tape);
+
+    const auto root = tape->root();
+    std::vector<Interval> out;
+    out.reserve(batch_count);
+    for (unsigned k=0; k < batch_count; ++k)
+    {
+        out.push_back(Interval(batch_lower(root, k), batch_upper(root, k),
+                               batch_nan(root, k)));
+    }
+    return out;
+}
+
+void IntervalEvaluator::walkBatch(const Eigen::Vector3f* lower,
+                                  const Eigen::Vector3f* upper, size_t count,
+                                  const Tape::Handle& tape)
+{
+    batch_count = count;
+
+    if (static_cast<size_t>(batch_lower.cols()) < batch_count)
+    {
+        // Three extra rows are used as scratch space in batch()
+        batch_lower = BatchArray::Zero(i.size() + 3, batch_count);
+        batch_upper = BatchArray::Zero(i.size() + 3, batch_count);
+        batch_nan.setConstant(i.size() + 3, batch_count, false);
+        batch_lo.resize(batch_count);
+        batch_hi.resize(batch_count);
+        batch_maybe_nan.resize(batch_count);
+    }
+
+    // Broadcast constants and variables (which are kept up to date
+    // in the single-interval array) across the batch.  This only needs
+    // to happen when the batch grows or a variable changes, which keeps
+    // single-box evaluation with the SIMD backend proportional to the
+    // size of the tape rather than the Deck.
+    if (batch_broadcast < batch_count)
+    {
+        auto broadcast = [&](Clause::Id c) {
+            batch_lower.row(c).head(batch_count).setConstant(i[c].lower());
+            batch_upper.row(c).head(batch_count).setConstant(i[c].upper());
+            batch_nan.row(c).head(batch_count).setConstant(!i[c].isSafe());
+        };
+        for (auto& c : deck->constants)
         {
-            if (a == b)
-            {
-                return Tape::KEEP_A;
-            }
-            else if (i[a].lower() > i[b].upper())
-            {
-                return Tape::KEEP_A;
-            }
-            else if (i[b].lower() > i[a].upper())
-            {
-                return Tape::KEEP_B;
-            }
-            return Tape::KEEP_BOTH;
+            broadcast(c.first);
         }
-        else if (op == Opcode::OP_MIN)
+        for (auto& v : deck->vars.left)
         {
-            if (a == b)
-            {
-                return Tape::KEEP_A;
-            }
-            else if (i[a].lower() > i[b].upper())
-            {
-                return Tape::KEEP_B;
-            }
-            else if (i[b].lower() > i[a].upper())
-            {
-                return Tape::KEEP_A;
-            }
-            return Tape::KEEP_BOTH;
+            broadcast(v.first);
         }
-        return Tape::KEEP_ALWAYS;
+        for (auto& c : deck->invariant)
+        {
+            broadcast(c.id);
+        }
+        batch_broadcast = batch_count;
+    }
+
+    for (unsigned k=0; k < batch_count; ++k)
+    {
+        assert(!lower[k].array().isNaN().any());
+        assert(!upper[k].array().isNaN().any());
+        batch_lower(deck->X, k) = lower[k].x();
+        batch_lower(deck->Y, k) = lower[k].y();
+        batch_lower(deck->Z, k) = lower[k].z();
+        batch_upper(deck->X, k) = upper[k].x();
+        batch_upper(deck->Y, k) = upper[k].y();
+        batch_upper(deck->Z, k) = upper[k].z();
+    }
+    for (auto c : {deck->X, deck->Y, deck->Z})
+    {
+        batch_nan.row(c).head(batch_count).setConstant(false);
+    }
+
+    deck->bindOracles(*tape);
+    for (auto itr = tape->rbegin(); itr != tape->rend(); ++itr) {
+        batch(itr->op, itr->id, itr->a, itr->b);
+    }
+    deck->unbindOracles();
+}
+
+std::vector<std::pair<Interval, Tape::Handle>>
+IntervalEvaluator::intervalAndPushBatch(
+        const std::vector<Eigen::Vector3f>& lower,
+        const std::vector<Eigen::Vector3f>& upper,
+        const Tape::Handle& tape)
+{
+    auto is = evalBatch(lower, upper, tape);
+
+    std::vector<std::pair<Interval, Tape::Handle>> out;
+    out.reserve(is.size());
+    for (unsigned k=0; k < is.size(); ++k)
+    {
+        out.push_back(std::make_pair(is[k], pushBatch(tape, k)));
+    }
+    return out;
+}
+
+Tape::Handle IntervalEvaluator::pushBatch(const Tape::Handle& tape,
+                                          size_t index)
+{
+    assert(tape.get() != nullptr);
+    assert(index < batch_count);
+
+    const Region<3> R(Eigen::Vector3d(batch_lower(deck->X, index),
+                                      batch_lower(deck->Y, index),
+                                      batch_lower(deck->Z, index)),
+                      Eigen::Vector3d(batch_upper(deck->X, index),
+                                      batch_upper(deck->Y, index),
+                                      batch_upper(deck->Z, index)));
+    return tape->push(*deck,
+        [&](Opcode::Opcode op, Clause::Id /* id */,
+            Clause::Id a, Clause::Id b)
+    {
+        return keepBranches(op, a, b,
+            [&](Clause::Id c) { return batch_lower(c, index); },
+            [&](Clause::Id c) { return batch_upper(c, index); });
     },
     Tape::INTERVAL, R);
 }
@@ -176,6 +357,10 @@ bool IntervalEvaluator::setVar(Tree::Id var, float value)
         const bool changed = (i[v->second].lower() != value) ||
                              (i[v->second].upper() != value);
         store(value, v->second);
+        if (changed)
+        {
+            updateInvariant();
+        }
         return changed;
     }
     else
@@ -184,101 +369,150 @@ bool IntervalEvaluator::setVar(Tree::Id var, float value)
     }
 }
 
+bool IntervalEvaluator::setVar(Tree::Id var, Interval value)
+{
+    auto v = deck->vars.right.find(var);
+    if (v != deck->vars.right.end())
+    {
+        const bool changed = (i[v->second].lower() != value.lower()) ||
+                             (i[v->second].upper() != value.upper());
+        i[v->second] = value;
+        batch_broadcast = 0;    // in case only maybe_nan changed
+        if (changed)
+        {
+            updateInvariant();
+        }
+        return changed;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool IntervalEvaluator::updateVars(const std::map<Tree::Id, float>& vars)
+{
+    bool changed = false;
+    for (auto& var : vars)
+    {
+        auto v = deck->vars.right.find(var.first);
+        if (v != deck->vars.right.end() &&
+            (i[v->second].lower() != var.second ||
+             i[v->second].upper() != var.second))
+        {
+            store(var.second, v->second);
+            changed = true;
+        }
+    }
+    if (changed)
+    {
+        updateInvariant();
+    }
+    return changed;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void IntervalEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
-                                   Clause::Id a_, Clause::Id b_)
+                                   Clause::Id a, Clause::Id b)
 {
-#define out i[id]
-#define a i[a_]
-#define b i[b_]
+    if (op == Opcode::ORACLE)
+    {
+        deck->oracles[a]->evalInterval(i[id]);
+    }
+    else if (Opcode::hasImmediate(op))
+    {
+        // Immediates are evaluated as the equivalent two-argument clause
+        bool swap;
+        const auto base = Opcode::withoutImmediate(op, swap);
+        const float f = Clause::immediate(b);
+        const Interval k(f, f);
+        i[id] = swap ? evalClause(base, k, i[a]) : evalClause(base, i[a], k);
+    }
+    else
+    {
+        i[id] = evalClause(op, i[a], i[b]);
+    }
+}
 
+Interval IntervalEvaluator::evalClause(Opcode::Opcode op,
+                                       const Interval& a, const Interval& b)
+{
     switch (op) {
         case Opcode::OP_ADD:
-            out = a + b;
-            break;
+            return a + b;
         case Opcode::OP_MUL:
-            out = a * b;
-            break;
+            return a * b;
         case Opcode::OP_MIN:
-            out = Interval::min(a, b);
-            break;
+            return Interval::min(a, b);
         case Opcode::OP_MAX:
-            out = Interval::max(a, b);
-            break;
+            return Interval::max(a, b);
         case Opcode::OP_SUB:
-            out = a - b;
-            break;
+            return a - b;
         case Opcode::OP_DIV:
-            out = a / b;
-            break;
+            return a / b;
         case Opcode::OP_ATAN2:
-            out = Interval::atan2(a, b);
-            break;
+            return Interval::atan2(a, b);
         case Opcode::OP_POW:
-            out = Interval::pow(a, b);
-            break;
+            return Interval::pow(a, b);
         case Opcode::OP_NTH_ROOT:
-            out = Interval::nth_root(a, b);
-            break;
+            return Interval::nth_root(a, b);
         case Opcode::OP_MOD:
-            out = Interval::mod(a, b);
-            return;
+            return Interval::mod(a, b);
         case Opcode::OP_NANFILL:
-            out = Interval::nanfill(a, b);
-            break;
+            return Interval::nanfill(a, b);
         case Opcode::OP_COMPARE:
-            out = Interval::compare(a, b);
-            break;
+            return Interval::compare(a, b);
 
         case Opcode::OP_SQUARE:
-            out = Interval::square(a);
-            break;
+            return Interval::square(a);
         case Opcode::OP_SQRT:
-            out = Interval::sqrt(a);
-            break;
+            return Interval::sqrt(a);
         case Opcode::OP_NEG:
-            out = -a;
-            break;
+            return -a;
         case Opcode::OP_SIN:
-            out = Interval::sin(a);
-            break;
+            return Interval::sin(a);
         case Opcode::OP_COS:
-            out = Interval::cos(a);
-            break;
+            return Interval::cos(a);
         case Opcode::OP_TAN:
-            out = Interval::tan(a);
-            break;
+            return Interval::tan(a);
         case Opcode::OP_ASIN:
-            out = Interval::asin(a);
-            break;
+            return Interval::asin(a);
         case Opcode::OP_ACOS:
-            out = Interval::acos(a);
-            break;
+            return Interval::acos(a);
         case Opcode::OP_ATAN:
-            out = Interval::atan(a);
-            break;
+            return Interval::atan(a);
         case Opcode::OP_EXP:
-            out = Interval::exp(a);
-            break;
+            return Interval::exp(a);
         case Opcode::OP_LOG:
-            out = Interval::log(a);
-            break;
+            return Interval::log(a);
         case Opcode::OP_ABS:
-            out = Interval::abs(a);
-            break;
+            return Interval::abs(a);
         case Opcode::OP_RECIP:
-            out = Interval::recip(a);
-            break;
+            return Interval::recip(a);
 
         case Opcode::CONST_VAR:
-            out = a;
-            break;
-
+            return a;
+
+        case Opcode::OP_SUM_SQUARES:
+            return Interval::square(a) + Interval::square(b);
+        case Opcode::OP_ADD_SQUARE:
+            return a + Interval::square(b);
+        case Opcode::OP_HYPOT:
+            return Interval::sqrt(Interval::square(a) + Interval::square(b));
+        case Opcode::OP_SQRT_ADD_SQUARE:
+            return Interval::sqrt(a + Interval::square(b));
+
+        // Immediates are unpacked by the caller
+        case Opcode::OP_ADD_IMM:
+        case Opcode::OP_SUB_IMM:
+        case Opcode::OP_RSUB_IMM:
+        case Opcode::OP_MUL_IMM:
+        case Opcode::OP_DIV_IMM:
+        case Opcode::OP_RDIV_IMM:
+        case Opcode::OP_MIN_IMM:
+        case Opcode::OP_MAX_IMM:
         case Opcode::ORACLE:
-            deck->oracles[a_]->evalInterval(out);
-            break;
-
         case Opcode::INVALID:
         case Opcode::CONSTANT:
         case Opcode::VAR_X:
@@ -287,10 +521,120 @@ void IntervalEvaluator::operator()(Opcode::Opcode op, Clause::Id id,
         case Opcode::VAR_FREE:
         case Opcode::LAST_OP: assert(false);
     }
+    return Interval();
+}
+
+void IntervalEvaluator::batch(Opcode::Opcode op, Clause::Id id,
+                              Clause::Id a_, Clause::Id b_)
+{
+    const size_t n = batch_count;
+
+    // The last three rows of the batch arrays are spare, and are used to
+    // evaluate lowered clauses in terms of the kernels below:  immediates
+    // are broadcast into a row, and fused clauses are split back up, with
+    // intermediate results stored in the other two rows.
+    const Clause::Id spare = batch_lower.rows() - 3;
+    if (Opcode::hasImmediate(op))
+    {
+        bool swap;
+        const auto base = Opcode::withoutImmediate(op, swap);
+        const float f = Clause::immediate(b_);
+        batch_lower.row(spare).head(n).setConstant(f);
+        batch_upper.row(spare).head(n).setConstant(f);
+        batch_nan.row(spare).head(n).setConstant(std::isnan(f));
+        return swap ? batch(base, id, spare, a_) : batch(base, id, a_, spare);
+    }
+    switch (op) {
+        case Opcode::OP_ADD_SQUARE:
+            batch(Opcode::OP_SQUARE, spare + 1, b_, 0);
+            return batch(Opcode::OP_ADD, id, a_, spare + 1);
+        case Opcode::OP_SQRT_ADD_SQUARE:
+            batch(Opcode::OP_SQUARE, spare + 1, b_, 0);
+            batch(Opcode::OP_ADD, spare + 1, a_, spare + 1);
+            return batch(Opcode::OP_SQRT, id, spare + 1, 0);
+        case Opcode::OP_SUM_SQUARES:
+        case Opcode::OP_HYPOT:
+            batch(Opcode::OP_SQUARE, spare + 1, a_, 0);
+            batch(Opcode::OP_SQUARE, spare + 2, b_, 0);
+            if (op == Opcode::OP_SUM_SQUARES)
+            {
+                return batch(Opcode::OP_ADD, id, spare + 1, spare + 2);
+            }
+            batch(Opcode::OP_ADD, spare + 1, spare + 1, spare + 2);
+            return batch(Opcode::OP_SQRT, id, spare + 1, 0);
+        default:
+            break;
+    }
+
+    // Other results are accumulated in scratch arrays, then copied into
+    // the output row, because the output slot may be shared with an input.
+    auto& lo = batch_lo;
+    auto& hi = batch_hi;
+    auto& nan = batch_maybe_nan;
+
+    switch (op) {
+        // Elementwise arithmetic runs in the SIMD kernels, which are picked
+        // at runtime (see simd.hpp).  These can write straight into the
+        // output row, since they read each box's inputs before writing.
+        case Opcode::OP_ADD:
+        case Opcode::OP_SUB:
+        case Opcode::OP_MUL:
+        case Opcode::OP_DIV:
+        case Opcode::OP_MIN:
+        case Opcode::OP_MAX:
+        case Opcode::OP_NEG:
+        case Opcode::OP_ABS:
+        case Opcode::OP_SQUARE:
+        case Opcode::OP_SQRT:
+        case Opcode::OP_RECIP:
+        case Opcode::CONST_VAR:
+        {
+            const auto b = (Opcode::args(op) == 2) ? b_ : a_;
+            const bool ok = Simd::kernels().interval(op,
+                &batch_lower(id, 0), &batch_upper(id, 0), &batch_nan(id, 0),
+                &batch_lower(a_, 0), &batch_upper(a_, 0), &batch_nan(a_, 0),
+                &batch_lower(b, 0), &batch_upper(b, 0), &batch_nan(b, 0),
+                n);
+            assert(ok);
+            (void)ok;
+            return;
+        }
+
+        case Opcode::ORACLE:
+            for (unsigned k=0; k < n; ++k)
+            {
+                deck->oracles[a_]->set(
+                    {batch_lower(deck->X, k), batch_lower(deck->Y, k),
+                     batch_lower(deck->Z, k)},
+                    {batch_upper(deck->X, k), batch_upper(deck->Y, k),
+                     batch_upper(deck->Z, k)});
+                Interval out;
+                deck->oracles[a_]->evalInterval(out);
+                lo(k) = out.lower();
+                hi(k) = out.upper();
+                nan(k) = !out.isSafe();
+            }
+            break;
+
+        // Everything else falls back to scalar interval arithmetic
+        default:
+            for (unsigned k=0; k < n; ++k)
+            {
+                const auto out = evalClause(op,
+                    Interval(batch_lower(a_, k), batch_upper(a_, k),
+                             batch_nan(a_, k)),
+                    Interval(batch_lower(b_, k), batch_upper(b_, k),
+                             batch_nan(b_, k)));
+                lo(k) = out.lower();
+                hi(k) = out.upper();
+                nan(k) = !out.isSafe();
+            }
+            break;
+    }
 
-#undef out
-#undef a
-#undef b
+    batch_lower.row(id).head(n) = lo.head(n);
+    batch_upper.row(id).head(n) = hi.head(n);
+    batch_nan.row(id).head(n) = nan.head(n);
 }
 
 }   // namespace libfive
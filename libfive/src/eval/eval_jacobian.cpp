@@ -33,8 +33,9 @@ JacobianEvaluator::JacobianEvaluator(std::shared_ptr<Deck> d)
 }
 
 JacobianEvaluator::JacobianEvaluator(
-        std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars)
-    : BaseEvaluator(d, vars), FeatureEvaluator(d, vars),
+        std::shared_ptr<Deck> d, const std::map<Tree::Id, float>& vars,
+        size_t width)
+    : BaseEvaluator(d, vars), FeatureEvaluator(d, vars, width),
       j(deck->vars.size())
 {
     // Nothing to do here
@@ -62,10 +63,17 @@ std::map<Tree::Id, float> JacobianEvaluator::gradient(
     unsigned count = 0;
 
     // remap[i] tells us which variable is at ds(i % 3, i / 3)
-    std::array<unsigned, 3 * N> remap;
+    std::vector<unsigned> remap(3 * width());
 
     auto run = [&]() {
         if (count) {
+            // Invariant clauses aren't in the tape (and normally have
+            // zero derivatives), so we propagate variables' derivatives
+            // through them here.
+            setCount((count + 2) / 3);
+            for (const auto& c : deck->invariant) {
+                DerivArrayEvaluator::operator()(c.op, c.id, c.a, c.b);
+            }
             auto ds = derivs((count + 2) / 3, tape);
             for (unsigned i=0; i < count; ++i) {
                 j[remap[i]] = ds(i % 3, i / 3);
@@ -87,7 +95,7 @@ std::map<Tree::Id, float> JacobianEvaluator::gradient(
     for (auto& v : deck->vars.left) {
         d(v.first)(count % 3, count / 3) = 1.0;
         remap[count++] = index++;
-        if (count == N * 3) {
+        if (count == width() * 3) {
             run();
         }
     }
@@ -0,0 +1,151 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "libfive/eval/simd.hpp"
+
+namespace libfive {
+namespace Simd {
+
+/*  Kernel tables, defined in simd/kernels_*.cpp.  The AVX2 and AVX-512
+ *  tables are only built when LIBFIVE_SIMD_DISPATCH is set by CMake. */
+namespace baseline { extern const Kernels table; }
+#if LIBFIVE_SIMD_DISPATCH
+namespace avx2 { extern const Kernels table; }
+namespace avx512 { extern const Kernels table; }
+#endif
+
+Level detected()
+{
+#if LIBFIVE_SIMD_DISPATCH
+    static const Level d = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return AVX512;
+        }
+        else if (__builtin_cpu_supports("avx2") &&
+                 __builtin_cpu_supports("fma"))
+        {
+            return AVX2;
+        }
+        return BASELINE;
+    }();
+    return d;
+#else
+    return BASELINE;
+#endif
+}
+
+/*  Picks the initial level, using the LIBFIVE_SIMD environment variable
+ *  if it's set to a supported level.  */
+static Level initialLevel()
+{
+    const char* env = std::getenv("LIBFIVE_SIMD");
+    Level out;
+    if (env == nullptr || *env == 0)
+    {
+        return detected();
+    }
+    else if (!fromName(env, out))
+    {
+        std::cerr << "Simd::level: unknown LIBFIVE_SIMD level \""
+                  << env << "\"" << std::endl;
+        return detected();
+    }
+    else if (out > detected())
+    {
+        std::cerr << "Simd::level: LIBFIVE_SIMD level \"" << env
+                  << "\" is not supported" << std::endl;
+        return detected();
+    }
+    return out;
+}
+
+static std::atomic<Level>& current()
+{
+    static std::atomic<Level> c(initialLevel());
+    return c;
+}
+
+Level level()
+{
+    return current().load();
+}
+
+bool setLevel(Level level)
+{
+    if (level > detected())
+    {
+        return false;
+    }
+    current().store(level);
+    return true;
+}
+
+const char* name(Level level)
+{
+    switch (level)
+    {
+        case BASELINE:  return "baseline";
+        case AVX2:      return "avx2";
+        case AVX512:    return "avx512";
+    }
+    return "";
+}
+
+bool fromName(const char* n, Level& level)
+{
+    for (auto l : {BASELINE, AVX2, AVX512})
+    {
+        if (!strcmp(n, name(l)))
+        {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t blockSize(Level level)
+{
+    switch (level)
+    {
+        case BASELINE:  return 4;
+        case AVX2:      return 8;
+        case AVX512:    return 16;
+    }
+    return 1;
+}
+
+const Kernels& kernels()
+{
+    return kernels(level());
+}
+
+const Kernels& kernels(Level level)
+{
+#if LIBFIVE_SIMD_DISPATCH
+    switch (level)
+    {
+        case AVX512:    return avx512::table;
+        case AVX2:      return avx2::table;
+        case BASELINE:  break;
+    }
+#else
+    (void)level;
+#endif
+    return baseline::table;
+}
+
+}   // namespace Simd
+}   // namespace libfive
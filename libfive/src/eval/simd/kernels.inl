@@ -0,0 +1,529 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+/*
+ *  This file is compiled once per SIMD level, with LIBFIVE_SIMD_LEVEL
+ *  defined as the level's namespace (see kernels_*.cpp).
+ *
+ *  Each translation unit is built with different instruction set flags,
+ *  so it must not instantiate anything with external linkage (e.g. Eigen
+ *  expressions or std::min):  the linker would merge those definitions
+ *  across levels and could pick the AVX-512 copy on an older CPU.  The
+ *  kernels are therefore plain loops over raw pointers, using compiler
+ *  builtins for sqrt and abs and our own implementations of other math
+ *  functions (see math.inl), and everything but the table has internal
+ *  linkage.
+ */
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <math.h>
+
+#include "libfive/eval/simd.hpp"
+
+#ifndef LIBFIVE_SIMD_LEVEL
+#error "LIBFIVE_SIMD_LEVEL must be defined"
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LIBFIVE_SQRT(x) __builtin_sqrtf(x)
+#define LIBFIVE_FABS(x) __builtin_fabsf(x)
+#define LIBFIVE_ISFINITE(x) __builtin_isfinite(x)
+#define LIBFIVE_ISNAN(x) __builtin_isnan(x)
+#else
+#define LIBFIVE_SQRT(x) sqrtf(x)
+#define LIBFIVE_FABS(x) fabsf(x)
+#define LIBFIVE_ISFINITE(x) isfinite(x)
+#define LIBFIVE_ISNAN(x) isnan(x)
+#endif
+
+namespace libfive {
+namespace Simd {
+namespace LIBFIVE_SIMD_LEVEL {
+
+namespace {
+
+constexpr float EPSILON = std::numeric_limits<float>::epsilon();
+constexpr float DENORM_MIN = std::numeric_limits<float>::denorm_min();
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+/*  These match std::min and std::max (returning a if either is NaN),
+ *  which is also what Eigen's cwiseMin and cwiseMax do.  */
+inline float min_(float a, float b) { return (b < a) ? b : a; }
+inline float max_(float a, float b) { return (a < b) ? b : a; }
+
+/*  Rounds outwards by at least one ulp (scaling by FLT_EPSILON covers
+ *  normal numbers; denorm_min covers subnormals), passing through zeros,
+ *  infinities, and NaNs unchanged.  */
+inline float roundDown(float x)
+{
+    return (LIBFIVE_ISFINITE(x) & (x != 0.0f))
+        ? x - LIBFIVE_FABS(x) * EPSILON - DENORM_MIN : x;
+}
+
+inline float roundUp(float x)
+{
+    return (LIBFIVE_ISFINITE(x) & (x != 0.0f))
+        ? x + LIBFIVE_FABS(x) * EPSILON + DENORM_MIN : x;
+}
+
+/*  0 * inf is NaN in IEEE arithmetic, but 0 in interval arithmetic  */
+inline float product(float a, float b)
+{
+    const float p = a * b;
+    return LIBFIVE_ISNAN(p) ? 0.0f : p;
+}
+
+/*  A product or quotient that underflowed to zero may really be a tiny
+ *  negative (or positive) value, so these nudge zero bounds outwards if
+ *  the result could have that sign, given the signs of its inputs.  */
+inline float signedLower(float lo, float al, float ah, float bl, float bh)
+{
+    const bool neg = ((al < 0.0f) & (bh > 0.0f)) | ((ah > 0.0f) & (bl < 0.0f));
+    return ((lo == 0.0f) & neg) ? -DENORM_MIN : lo;
+}
+
+inline float signedUpper(float hi, float al, float ah, float bl, float bh)
+{
+    const bool pos = ((al < 0.0f) & (bl < 0.0f)) | ((ah > 0.0f) & (bh > 0.0f));
+    return ((hi == 0.0f) & pos) ? DENORM_MIN : hi;
+}
+
+#include "math.inl"
+
+/*  Checks whether any input is outside of the range where our trig
+ *  functions are accurate (or is NaN), in which case we use libm for
+ *  the whole batch.  */
+bool trigOutOfRange(const float* a, size_t n)
+{
+    bool out = false;
+    for (size_t i=0; i < n; ++i)
+    {
+        out |= !(LIBFIVE_FABS(a[i]) <= TRIG_LIMIT);
+    }
+    return out;
+}
+
+/*  Matches Python's modulo:  if b is positive, then the result is in the
+ *  range [0, b]; if b is negative, then the result is in the range [b, 0];
+ *  if b is zero, then the result is NaN.  */
+inline float mod_(float a, float b)
+{
+    const float d = LIBFIVE_FABS(a / b);
+    const float q = ((a < 0) ^ (b < 0)) ? -ceilf(d) : floorf(d);
+    float out = a - b * q;
+
+    // Clamping for safety
+    out = ((b > 0 && out > b) || (b < 0 && out < b)) ? b : out;
+    out = ((b > 0.0f && out < 0.0f) || (b < 0.0f && out > 0.0f))
+        ? 0.0f : out;
+    return out;
+}
+
+bool array(Opcode::Opcode op, float* out,
+           const float* a, const float* b, float k, size_t n)
+{
+    switch (op)
+    {
+#define LOOP(expr) for (size_t i=0; i < n; ++i) { out[i] = (expr); } break
+        case Opcode::OP_ADD:        LOOP(a[i] + b[i]);
+        case Opcode::OP_SUB:        LOOP(a[i] - b[i]);
+        case Opcode::OP_MUL:        LOOP(a[i] * b[i]);
+        case Opcode::OP_DIV:        LOOP(a[i] / b[i]);
+        case Opcode::OP_MIN:        LOOP(min_(a[i], b[i]));
+        case Opcode::OP_MAX:        LOOP(max_(a[i], b[i]));
+
+        case Opcode::OP_SQUARE:     LOOP(a[i] * a[i]);
+        case Opcode::OP_SQRT:       LOOP(LIBFIVE_SQRT(a[i]));
+        case Opcode::OP_NEG:        LOOP(-a[i]);
+        case Opcode::OP_ABS:        LOOP(LIBFIVE_FABS(a[i]));
+        case Opcode::OP_RECIP:      LOOP(1.0f / a[i]);
+        case Opcode::CONST_VAR:     LOOP(a[i]);
+
+        case Opcode::OP_SIN:
+            if (trigOutOfRange(a, n)) { LOOP(sinf(a[i])); }
+            LOOP(sin_(a[i]));
+        case Opcode::OP_COS:
+            if (trigOutOfRange(a, n)) { LOOP(cosf(a[i])); }
+            LOOP(cos_(a[i]));
+        case Opcode::OP_TAN:
+            if (trigOutOfRange(a, n)) { LOOP(tanf(a[i])); }
+            LOOP(tan_(a[i]));
+        case Opcode::OP_ASIN:       LOOP(asin_(a[i]));
+        case Opcode::OP_ACOS:       LOOP(acos_(a[i]));
+        case Opcode::OP_ATAN:       LOOP(atan_(a[i]));
+        case Opcode::OP_EXP:        LOOP(exp_(a[i]));
+        case Opcode::OP_LOG:        LOOP(log_(a[i]));
+
+        case Opcode::OP_ATAN2:      LOOP(atan2_(a[i], b[i]));
+        case Opcode::OP_POW:        LOOP(pow_(a[i], b[i]));
+        case Opcode::OP_MOD:        LOOP(mod_(a[i], b[i]));
+        case Opcode::OP_NANFILL:    LOOP(LIBFIVE_ISNAN(a[i]) ? b[i] : a[i]);
+        case Opcode::OP_COMPARE:
+            LOOP((a[i] < b[i]) ? -1.0f : (a[i] > b[i]) ? 1.0f : 0.0f);
+
+        case Opcode::OP_ADD_IMM:    LOOP(a[i] + k);
+        case Opcode::OP_SUB_IMM:    LOOP(a[i] - k);
+        case Opcode::OP_RSUB_IMM:   LOOP(k - a[i]);
+        case Opcode::OP_MUL_IMM:    LOOP(a[i] * k);
+        case Opcode::OP_DIV_IMM:    LOOP(a[i] / k);
+        case Opcode::OP_RDIV_IMM:   LOOP(k / a[i]);
+        case Opcode::OP_MIN_IMM:    LOOP(min_(a[i], k));
+        case Opcode::OP_MAX_IMM:    LOOP(max_(a[i], k));
+
+        case Opcode::OP_SUM_SQUARES:    LOOP(a[i] * a[i] + b[i] * b[i]);
+        case Opcode::OP_ADD_SQUARE:     LOOP(a[i] + b[i] * b[i]);
+        case Opcode::OP_HYPOT:
+            LOOP(LIBFIVE_SQRT(a[i] * a[i] + b[i] * b[i]));
+        case Opcode::OP_SQRT_ADD_SQUARE:
+            LOOP(LIBFIVE_SQRT(a[i] + b[i] * b[i]));
+#undef LOOP
+        default:
+            return false;
+    }
+    return true;
+}
+
+/*  Chunk size for derivative kernels that precompute a per-point factor  */
+constexpr size_t SCALE_CHUNK = 64;
+
+bool deriv(Opcode::Opcode op, float* od, const float* v,
+           const float* av, const float* ad,
+           const float* bv, const float* bd, float k, size_t n)
+{
+    // Derivatives are stored as (x, y, z) triples, so the inner loop runs
+    // over the three axes of point i, with j indexing into the triples
+    // and a / b / o indexing into the per-point values.
+    switch (op)
+    {
+#define LOOP(expr) for (size_t i=0; i < n; ++i) { \
+        for (size_t j=3*i; j < 3*i + 3; ++j) { od[j] = (expr); } } break
+        case Opcode::OP_ADD:        LOOP(ad[j] + bd[j]);
+        case Opcode::OP_SUB:        LOOP(ad[j] - bd[j]);
+        case Opcode::OP_MUL:        LOOP(bd[j] * av[i] + ad[j] * bv[i]);
+        case Opcode::OP_DIV:
+            LOOP((ad[j] * bv[i] - bd[j] * av[i]) / (bv[i] * bv[i]));
+        case Opcode::OP_MIN:        LOOP((av[i] < bv[i]) ? ad[j] : bd[j]);
+        case Opcode::OP_MAX:        LOOP((av[i] < bv[i]) ? bd[j] : ad[j]);
+
+        case Opcode::OP_SQUARE:     LOOP(ad[j] * av[i] * 2);
+        case Opcode::OP_SQRT:
+            LOOP((av[i] < 0 || ad[j] == 0) ? 0.0f : ad[j] / (2 * v[i]));
+        case Opcode::OP_NEG:        LOOP(-ad[j]);
+        case Opcode::OP_ABS:        LOOP((av[i] > 0) ? ad[j] : -ad[j]);
+        case Opcode::OP_RECIP:      LOOP(ad[j] / -(av[i] * av[i]));
+
+        // Transcendental derivatives are a per-point factor times ad, so
+        // the factor is computed first in its own (vectorizable) loop
+#define SCALED(factor, expr) \
+        for (size_t s=0; s < n; s += SCALE_CHUNK) { \
+            const size_t e = (n < s + SCALE_CHUNK) ? n : s + SCALE_CHUNK; \
+            float m[SCALE_CHUNK]; \
+            for (size_t i=s; i < e; ++i) { m[i - s] = (factor); } \
+            for (size_t i=s; i < e; ++i) { \
+                const float f = m[i - s]; \
+                for (size_t j=3*i; j < 3*i + 3; ++j) { od[j] = (expr); } } \
+        } break
+        case Opcode::OP_SIN:
+            if (trigOutOfRange(av, n)) { SCALED(cosf(av[i]), ad[j] * f); }
+            SCALED(cos_(av[i]), ad[j] * f);
+        case Opcode::OP_COS:
+            if (trigOutOfRange(av, n)) { SCALED(-sinf(av[i]), ad[j] * f); }
+            SCALED(-sin_(av[i]), ad[j] * f);
+        case Opcode::OP_TAN:
+            if (trigOutOfRange(av, n))
+            {
+                SCALED(cosf(av[i]) * cosf(av[i]), ad[j] / f);
+            }
+            SCALED(cos_(av[i]) * cos_(av[i]), ad[j] / f);
+        case Opcode::OP_ASIN:
+            LOOP(ad[j] / LIBFIVE_SQRT(1 - av[i] * av[i]));
+        case Opcode::OP_ACOS:
+            LOOP(ad[j] / -LIBFIVE_SQRT(1 - av[i] * av[i]));
+        case Opcode::OP_ATAN:       LOOP(ad[j] / (av[i] * av[i] + 1));
+        case Opcode::OP_EXP:        SCALED(exp_(av[i]), ad[j] * f);
+        case Opcode::OP_LOG:        LOOP(ad[j] / av[i]);
+
+        case Opcode::OP_ATAN2:
+            LOOP((ad[j] * bv[i] - bd[j] * av[i]) /
+                 (av[i] * av[i] + bv[i] * bv[i]));
+        case Opcode::OP_POW:
+            // The full form of the derivative is
+            // od = m * (bv * ad + av * log(av) * bd))
+            // However, log(av) is often NaN and bd is always zero,
+            // (since it must be CONST), so we skip that part.
+            SCALED(bv[i] * pow_(av[i], bv[i] - 1), ad[j] * f);
+#undef SCALED
+
+        case Opcode::OP_ADD_IMM:    // fallthrough
+        case Opcode::OP_SUB_IMM:    LOOP(ad[j]);
+        case Opcode::OP_RSUB_IMM:   LOOP(-ad[j]);
+        case Opcode::OP_MUL_IMM:    LOOP(ad[j] * k);
+        case Opcode::OP_DIV_IMM:    LOOP(ad[j] / k);
+        case Opcode::OP_RDIV_IMM:   LOOP(ad[j] * (-k / (av[i] * av[i])));
+        case Opcode::OP_MIN_IMM:    LOOP((av[i] < k) ? ad[j] : 0.0f);
+        case Opcode::OP_MAX_IMM:    LOOP((av[i] < k) ? 0.0f : ad[j]);
+
+        // The fused square roots use the same special cases as OP_SQRT
+        case Opcode::OP_SUM_SQUARES:
+            LOOP((ad[j] * av[i] + bd[j] * bv[i]) * 2);
+        case Opcode::OP_ADD_SQUARE:
+            LOOP(ad[j] + bd[j] * bv[i] * 2);
+        case Opcode::OP_HYPOT:
+            for (size_t i=0; i < n; ++i)
+            {
+                for (size_t j=3*i; j < 3*i + 3; ++j)
+                {
+                    const float ds = (ad[j] * av[i] + bd[j] * bv[i]) * 2;
+                    od[j] = (ds == 0) ? 0.0f : ds / (2 * v[i]);
+                }
+            }
+            break;
+        case Opcode::OP_SQRT_ADD_SQUARE:
+            for (size_t i=0; i < n; ++i)
+            {
+                for (size_t j=3*i; j < 3*i + 3; ++j)
+                {
+                    const float ds = ad[j] + bd[j] * bv[i] * 2;
+                    od[j] = (av[i] + bv[i] * bv[i] < 0 || ds == 0)
+                        ? 0.0f : ds / (2 * v[i]);
+                }
+            }
+            break;
+#undef LOOP
+        default:
+            return false;
+    }
+    return true;
+}
+
+/*  Interval kernels write into scratch arrays of this size, then copy
+ *  the results out, because the outputs may alias the inputs (and GCC
+ *  won't emit enough run-time alias checks to vectorize every loop).  */
+constexpr size_t INTERVAL_CHUNK = 64;
+
+/*  NaN flags are passed as bytes, since GCC won't vectorize loads and
+ *  stores of bool.  Conditions are likewise combined with bitwise
+ *  operators and selects, rather than with short-circuiting or ifs.  */
+bool intervalChunk(Opcode::Opcode op, float* __restrict olo,
+                   float* __restrict ohi, uint8_t* __restrict onan,
+                   const float* alo, const float* ahi, const uint8_t* anan,
+                   const float* blo, const float* bhi, const uint8_t* bnan,
+                   size_t n)
+{
+    switch (op)
+    {
+        case Opcode::OP_ADD:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                const float bl = blo[i], bh = bhi[i];
+                onan[i] = anan[i] | bnan[i] |
+                    ((al == -INF) & (bh == INF)) |
+                    ((bl == -INF) & (ah == INF));
+                olo[i] = roundDown(al + bl);
+                ohi[i] = roundUp(ah + bh);
+            }
+            break;
+        case Opcode::OP_SUB:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                const float bl = blo[i], bh = bhi[i];
+                onan[i] = anan[i] | bnan[i] |
+                    ((al == -INF) & (bl == -INF)) |
+                    ((ah == -INF) & (bh == -INF));
+                olo[i] = roundDown(al - bh);
+                ohi[i] = roundUp(ah - bl);
+            }
+            break;
+        case Opcode::OP_MUL:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                const float bl = blo[i], bh = bhi[i];
+                const float p0 = product(al, bl), p1 = product(al, bh);
+                const float p2 = product(ah, bl), p3 = product(ah, bh);
+                const float lo = min_(min_(min_(p0, p1), p2), p3);
+                const float hi = max_(max_(max_(p0, p1), p2), p3);
+                const bool a_inf = (al == -INF) | (ah == INF);
+                const bool b_inf = (bl == -INF) | (bh == INF);
+                onan[i] = anan[i] | bnan[i] |
+                    (a_inf & (bl <= 0.0f) & (bh >= 0.0f)) |
+                    (b_inf & (al <= 0.0f) & (ah >= 0.0f));
+                olo[i] = signedLower(roundDown(lo), al, ah, bl, bh);
+                ohi[i] = signedUpper(roundUp(hi), al, ah, bl, bh);
+            }
+            break;
+        case Opcode::OP_DIV:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                const float bl = blo[i], bh = bhi[i];
+
+                // As in Interval's operator/, a divisor that crosses zero
+                // gives the whole real line.  inf / inf has no useful bound
+                // (and neither does the NaN that it produces), so it gives
+                // the whole real line as well.
+                const float q0 = al / bl, q1 = al / bh;
+                const float q2 = ah / bl, q3 = ah / bh;
+                const float lo = min_(min_(min_(q0, q1), q2), q3);
+                const float hi = max_(max_(max_(q0, q1), q2), q3);
+                const bool whole = ((bl <= 0.0f) & (bh >= 0.0f)) |
+                    LIBFIVE_ISNAN(q0) | LIBFIVE_ISNAN(q1) |
+                    LIBFIVE_ISNAN(q2) | LIBFIVE_ISNAN(q3);
+                const float l = signedLower(roundDown(lo), al, ah, bl, bh);
+                const float h = signedUpper(roundUp(hi), al, ah, bl, bh);
+                const bool a_inf = (al == -INF) | (ah == INF);
+                const bool b_inf = (bl == -INF) | (bh == INF);
+                onan[i] = anan[i] | bnan[i] | (a_inf & b_inf) |
+                    ((al <= 0.0f) & (ah >= 0.0f) & (bl <= 0.0f) & (bh >= 0.0f));
+                olo[i] = whole ? -INF : l;
+                ohi[i] = whole ? INF : h;
+            }
+            break;
+
+        // These match the NaN handling in Interval::min / max,
+        // which follows std::min / std::max
+        case Opcode::OP_MIN:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float lo = min_(alo[i], blo[i]);
+                const float hi = bnan[i] ? ahi[i] : min_(ahi[i], bhi[i]);
+                onan[i] = anan[i];
+                olo[i] = lo;
+                ohi[i] = hi;
+            }
+            break;
+        case Opcode::OP_MAX:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float lo = bnan[i] ? alo[i] : max_(alo[i], blo[i]);
+                const float hi = max_(ahi[i], bhi[i]);
+                onan[i] = anan[i];
+                olo[i] = lo;
+                ohi[i] = hi;
+            }
+            break;
+
+        case Opcode::OP_NEG:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                onan[i] = anan[i];
+                olo[i] = -ah;
+                ohi[i] = -al;
+            }
+            break;
+        case Opcode::OP_ABS:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                onan[i] = anan[i];
+                olo[i] = (al >= 0.0f) ? al : ((ah <= 0.0f) ? -ah : 0.0f);
+                ohi[i] = max_(LIBFIVE_FABS(al), LIBFIVE_FABS(ah));
+            }
+            break;
+        case Opcode::OP_SQUARE:
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                float lo = (ah <= 0.0f) ? ah * ah : 0.0f;
+                lo = (al >= 0.0f) ? al * al : lo;
+                lo = max_(roundDown(lo), 0.0f);
+                float hi = roundUp(max_(al * al, ah * ah));
+                hi = ((hi == 0.0f) & ((al != 0.0f) | (ah != 0.0f)))
+                    ? DENORM_MIN : hi;
+                onan[i] = anan[i];
+                olo[i] = lo;
+                ohi[i] = hi;
+            }
+            break;
+        case Opcode::OP_SQRT:
+            // Matches boost, which clamps negative inputs to zero and
+            // returns an empty (NaN) interval if every input is negative
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                const float lo = (al > 0.0f)
+                    ? max_(roundDown(LIBFIVE_SQRT(al)), 0.0f) : 0.0f;
+                const float hi = roundUp(LIBFIVE_SQRT(max_(ah, 0.0f)));
+                onan[i] = anan[i] | (al < 0.0f);
+                olo[i] = (ah < 0.0f) ? NAN_ : lo;
+                ohi[i] = (ah < 0.0f) ? NAN_ : hi;
+            }
+            break;
+        case Opcode::OP_RECIP:
+            // Matches boost's 1 / [a, b], including half-open results for
+            // inputs with a zero bound.  [0, 0] gives the whole real line.
+            for (size_t i=0; i < n; ++i)
+            {
+                const float al = alo[i], ah = ahi[i];
+                float lo = roundDown(1.0f / ah);
+                float hi = roundUp(1.0f / al);
+                lo = (al == 0.0f) ? max_(lo, 0.0f) : lo;
+                hi = (ah == 0.0f) ? min_(hi, 0.0f) : hi;
+                const bool cross = (al <= 0.0f) & (ah >= 0.0f);
+                onan[i] = anan[i];
+                olo[i] = (cross & (al != 0.0f)) ? -INF : lo;
+                ohi[i] = (cross & (ah != 0.0f)) ? INF : hi;
+            }
+            break;
+        case Opcode::CONST_VAR:
+            for (size_t i=0; i < n; ++i)
+            {
+                onan[i] = anan[i];
+                olo[i] = alo[i];
+                ohi[i] = ahi[i];
+            }
+            break;
+
+        default:
+            return false;
+    }
+    return true;
+}
+
+bool interval(Opcode::Opcode op, float* olo, float* ohi, bool* onan,
+              const float* alo, const float* ahi, const bool* anan,
+              const float* blo, const float* bhi, const bool* bnan,
+              size_t n)
+{
+    float lo[INTERVAL_CHUNK];
+    float hi[INTERVAL_CHUNK];
+    uint8_t nan[INTERVAL_CHUNK];
+    for (size_t s=0; s < n; s += INTERVAL_CHUNK)
+    {
+        const size_t m = (n < s + INTERVAL_CHUNK) ? n - s : INTERVAL_CHUNK;
+        if (!intervalChunk(op, lo, hi, nan, alo + s, ahi + s,
+                reinterpret_cast<const uint8_t*>(anan + s), blo + s, bhi + s,
+                reinterpret_cast<const uint8_t*>(bnan + s), m))
+        {
+            return false;
+        }
+        memcpy(olo + s, lo, m * sizeof(float));
+        memcpy(ohi + s, hi, m * sizeof(float));
+        memcpy(onan + s, nan, m * sizeof(bool));
+    }
+    return true;
+}
+
+}   // anonymous namespace
+
+extern const Kernels table;
+const Kernels table = { array, deriv, interval };
+
+}   // namespace LIBFIVE_SIMD_LEVEL
+}   // namespace Simd
+}   // namespace libfive
+
+#undef LIBFIVE_SQRT
+#undef LIBFIVE_FABS
+#undef LIBFIVE_ISFINITE
+#undef LIBFIVE_ISNAN
@@ -0,0 +1,327 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+/*
+ *  Single-precision math functions for the SIMD kernels, included into the
+ *  anonymous namespace of kernels.inl (so the same rules apply:  nothing
+ *  with external linkage except libm functions).
+ *
+ *  Each function is branch-free (using selects rather than ifs), so that
+ *  loops calling it can be vectorized.  Selects are applied one at a time
+ *  and conditions are combined with bitwise operators, since chains of
+ *  ternaries and short-circuiting both defeat GCC's if-conversion.
+ *
+ *  Polynomials and range reduction follow Cephes, except that trig range
+ *  reduction is done in double precision.  Measured error bounds (against
+ *  the exact result), which are checked against libm in test/simd.cpp:
+ *
+ *      sin, cos        2 ulp for |x| <= TRIG_LIMIT
+ *      tan             4 ulp for |x| <= TRIG_LIMIT
+ *      asin, acos      3 ulp
+ *      atan, atan2     4 ulp
+ *      exp             1 ulp (including subnormal results)
+ *      log             1 ulp
+ *      pow             1 ulp + |b * log2(a)| * 2^-23 (relative)
+ *
+ *  Trig functions lose accuracy beyond TRIG_LIMIT, where the two-part
+ *  range reduction is no longer exact, so the kernels use libm for any
+ *  batch that contains such (rare) inputs; see trigOutOfRange.
+ *
+ *  Special values (NaN, infinities, signed zeros, and out-of-domain
+ *  inputs) follow the C standard, except that exp and pow flush results
+ *  below 2^-149 to zero without raising exceptions.
+ */
+
+constexpr float PI = 3.14159265358979323846f;
+constexpr float PI_2 = 1.57079632679489661923f;
+constexpr float PI_4 = 0.785398163397448309616f;
+constexpr float TRIG_LIMIT = 8192.0f;
+constexpr float NAN_ = std::numeric_limits<float>::quiet_NaN();
+constexpr float FLT_MIN_ = std::numeric_limits<float>::min();
+
+inline float asFloat(int32_t i)
+{
+    float f;
+    std::memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+inline int32_t asInt(float f)
+{
+    int32_t i;
+    std::memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+inline float copySign(float mag, float sgn)
+{
+    return asFloat((asInt(mag) & 0x7fffffff) | (asInt(sgn) & INT32_MIN));
+}
+
+/*  Rounds to the nearest integer, for |x| < 2^22  */
+inline float roundNearest(float x)
+{
+    constexpr float MAGIC = 12582912.0f; // 1.5 * 2^23
+    return (x + MAGIC) - MAGIC;
+}
+
+/*  Returns 2^n, for n in [-126, 127]  */
+inline float pow2(int32_t n)
+{
+    return asFloat((n + 127) << 23);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+/*  Reduces x to r in [-pi/4, pi/4], returning the quadrant
+ *  (so x = r + q * pi/2).  Only valid for |x| <= TRIG_LIMIT.  */
+inline int32_t trigReduce(float x, float& r)
+{
+    // pi/2 split into two doubles, where the first has few enough bits
+    // that multiplying it by q is exact.  Doing this in single precision
+    // loses hundreds of ulp near the roots of sin and cos.
+    constexpr double P1 = 1.5707963267341256;
+    constexpr double P2 = 6.077100506506192e-11;
+
+    // Guard the conversion, since large and NaN inputs are handled later
+    float q = roundNearest(x * (2.0f / PI));
+    q = (LIBFIVE_FABS(x) <= TRIG_LIMIT) ? q : 0.0f;
+    r = static_cast<float>((static_cast<double>(x) - q * P1) - q * P2);
+    return static_cast<int32_t>(q);
+}
+
+/*  Polynomial approximations on [-pi/4, pi/4]  */
+inline float sinPoly(float r)
+{
+    const float z = r * r;
+    return r + r * z * ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z
+                        - 1.6666654611e-1f);
+}
+
+inline float cosPoly(float r)
+{
+    const float z = r * r;
+    return ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z
+        + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+}
+
+inline float sin_(float x)
+{
+    float r;
+    const int32_t q = trigReduce(x, r);
+    const float s = sinPoly(r);
+    const float c = cosPoly(r);
+    const float out = (q & 1) ? c : s;
+    return (q & 2) ? -out : out;
+}
+
+inline float cos_(float x)
+{
+    float r;
+    const int32_t q = trigReduce(x, r);
+    const float s = sinPoly(r);
+    const float c = cosPoly(r);
+    const float out = (q & 1) ? s : c;
+    return ((q + 1) & 2) ? -out : out;
+}
+
+inline float tan_(float x)
+{
+    float r;
+    const int32_t q = trigReduce(x, r);
+    const float s = sinPoly(r);
+    const float c = cosPoly(r);
+    return (q & 1) ? -c / s : s / c;
+}
+
+/*  asin on [0, 1], with the result on [0, pi/2]  */
+inline float asinPositive(float a)
+{
+    // Above 0.5, use asin(a) = pi/2 - 2 asin(sqrt((1 - a) / 2))
+    const bool big = a > 0.5f;
+    const float z = big ? 0.5f * (1.0f - a) : a * a;
+    const float s = big ? LIBFIVE_SQRT(z) : a;
+    const float p = ((((4.2163199048e-2f * z + 2.4181311049e-2f) * z
+        + 4.5470025998e-2f) * z + 7.4953002686e-2f) * z
+        + 1.6666752422e-1f) * z * s + s;
+    return big ? PI_2 - 2.0f * p : p;
+}
+
+inline float asin_(float x)
+{
+    const float a = LIBFIVE_FABS(x);
+    const float out = copySign(asinPositive(a), x);
+    return (a > 1.0f) ? NAN_ : out;
+}
+
+inline float acos_(float x)
+{
+    // acos(x) = pi/2 - asin(x) loses accuracy near |x| = 1, so we use
+    // 2 asin(sqrt((1 - |x|) / 2)) there instead
+    const float a = LIBFIVE_FABS(x);
+    const float h = 2.0f * asinPositive(LIBFIVE_SQRT(0.5f * (1.0f - a)));
+    const float out = (a <= 0.5f) ? PI_2 - copySign(asinPositive(a), x)
+                    : (x < 0) ? PI - h : h;
+    return (a > 1.0f) ? NAN_ : out;
+}
+
+/*  atan on [0, inf], with the result on [0, pi/2]  */
+inline float atanPositive(float a)
+{
+    // Reduce to [0, tan(pi/8)] using atan(a) = pi/2 - atan(1/a)
+    // and atan(a) = pi/4 + atan((a - 1) / (a + 1))
+    const bool big = a > 2.414213562373095f;
+    const bool mid = a > 0.4142135623730950f;
+    float y0 = mid ? PI_4 : 0.0f;
+    y0 = big ? PI_2 : y0;
+    float x = mid ? (a - 1.0f) / (a + 1.0f) : a;
+    x = big ? -1.0f / a : x;
+    const float z = x * x;
+    return y0 + (((8.05374449538e-2f * z - 1.38776856032e-1f) * z
+        + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * x + x;
+}
+
+inline float atan_(float x)
+{
+    return copySign(atanPositive(LIBFIVE_FABS(x)), x);
+}
+
+inline float atan2_(float y, float x)
+{
+    const float ay = LIBFIVE_FABS(y);
+    const float ax = LIBFIVE_FABS(x);
+
+    // Take the atan of the smaller ratio, which is on [0, 1].  If both
+    // values are zero or infinite, then the ratio is taken to be 0 or 1.
+    const float lo = (ay < ax) ? ay : ax;
+    const float hi = (ay < ax) ? ax : ay;
+    float ratio = (lo == INF) ? 1.0f : lo / hi;
+    ratio = (hi == 0.0f) ? 0.0f : ratio;
+    float t = atanPositive(ratio);
+    t = (ay > ax) ? PI_2 - t : t;
+    t = (asInt(x) < 0) ? PI - t : t;   // includes -0
+    const float out = copySign(t, y);
+    return (LIBFIVE_ISNAN(x) | LIBFIVE_ISNAN(y)) ? x + y : out;
+}
+
+/*  Polynomial approximation of exp on [-ln(2) / 2, ln(2) / 2]  */
+inline float expPoly(float r)
+{
+    const float z = r * r;
+    return (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r
+        + 8.3334519073e-3f) * r + 4.1665795894e-2f) * r
+        + 1.6666665459e-1f) * r + 5.0000001201e-1f) * z + r + 1.0f;
+}
+
+inline float exp_(float x)
+{
+    constexpr float LOG2E = 1.44269504088896341f;
+    constexpr float C1 = 0.693359375f;       // ln(2), split in two parts
+    constexpr float C2 = -2.12194440e-4f;
+
+    // Guard the conversion (out-of-range inputs are fixed up below)
+    float xc = (x > 88.8f) ? 88.8f : x;
+    xc = (x < -104.0f) ? -104.0f : xc;
+    xc = LIBFIVE_ISNAN(x) ? 0.0f : xc;
+    const float n = roundNearest(xc * LOG2E);
+    const float r = (xc - n * C1) - n * C2;
+
+    const float p = expPoly(r);
+
+    // Scale by 2^n in two steps, so that subnormal results and results
+    // just below overflow don't need out-of-range exponents.
+    const int32_t ni = static_cast<int32_t>(n);
+    const int32_t n1 = ni / 2;
+    float out = p * pow2(n1) * pow2(ni - n1);
+    out = (x > 88.72283905f) ? INF : out;
+    out = (x < -103.972084f) ? 0.0f : out;
+    return LIBFIVE_ISNAN(x) ? x : out;
+}
+
+inline float log_(float x)
+{
+    constexpr float SQRTHF = 0.707106781186547524f;
+
+    // Scale subnormals into the normal range
+    const bool sub = x < FLT_MIN_;
+    const float xs = sub ? x * 8388608.0f : x;   // 2^23
+
+    // Split into mantissa on [0.5, 1) and exponent
+    const int32_t bits = asInt(xs);
+    float e = static_cast<float>(((bits >> 23) & 0xff) - 126)
+            - (sub ? 23.0f : 0.0f);
+    float m = asFloat((bits & 0x007fffff) | 0x3f000000);
+
+    // Move the mantissa to [sqrt(1/2) - 1, sqrt(2) - 1)
+    const bool low = m < SQRTHF;
+    e = low ? e - 1.0f : e;
+    m = low ? m + m - 1.0f : m - 1.0f;
+
+    const float z = m * m;
+    float y = ((((((((7.0376836292e-2f * m - 1.1514610310e-1f) * m
+        + 1.1676998740e-1f) * m - 1.2420140846e-1f) * m
+        + 1.4249322787e-1f) * m - 1.6668057665e-1f) * m
+        + 2.0000714765e-1f) * m - 2.4999993993e-1f) * m
+        + 3.3333331174e-1f) * m * z;
+    y += e * -2.12194440e-4f;
+    y += -0.5f * z;
+    float out = (m + y) + e * 0.693359375f;
+    out = (x == INF) ? INF : out;
+    out = (x == 0.0f) ? -INF : out;
+    out = (x < 0.0f) ? NAN_ : out;
+    return LIBFIVE_ISNAN(x) ? x : out;
+}
+
+inline float pow_(float a, float b)
+{
+    constexpr float TWO_24 = 16777216.0f;
+    constexpr float LOG2E = 1.44269504088896341f;
+    constexpr float LN2 = 0.693147180559945309f;
+
+    // Check whether b is an integer (and if so, whether it's odd).  Every
+    // float at or above 2^24 is an even integer.
+    const float ab = LIBFIVE_FABS(b);
+    const int32_t bi = (ab < TWO_24) ? static_cast<int32_t>(b) : 0;
+    const int32_t integer = (ab >= TWO_24) | (static_cast<float>(bi) == b);
+    const int32_t odd = (static_cast<float>(bi) == b) ? (bi & 1) : 0;
+
+    // |a|^b = 2^y with y = b log2 |a|, which is split into an integer n
+    // and a fraction, so that scaling by 2^n doesn't lose precision
+    const float aa = LIBFIVE_FABS(a);
+    const float y = b * (log_(aa) * LOG2E);
+    float yc = (y > 200.0f) ? 200.0f : y;
+    yc = (y < -200.0f) ? -200.0f : yc;
+    yc = LIBFIVE_ISNAN(y) ? 0.0f : yc;
+    const float n = roundNearest(yc);
+    const int32_t ni = static_cast<int32_t>(n);
+    const int32_t n1 = ni / 2;
+    float mag = expPoly((yc - n) * LN2) * pow2(n1) * pow2(ni - n1);
+    mag = (n > 128.0f) ? INF : mag;
+    mag = (n < -151.0f) ? 0.0f : mag;
+
+    // Special cases for the magnitude, from the C standard
+    const float zero_mag = (b < 0.0f) ? INF : 0.0f;
+    mag = (aa == 0.0f) ? zero_mag : mag;
+    const float inf_mag = (b < 0.0f) ? 0.0f : INF;
+    mag = (aa == INF) ? inf_mag : mag;
+    float big_mag = ((aa < 1.0f) == (b < 0.0f)) ? INF : 0.0f;
+    big_mag = (aa == 1.0f) ? 1.0f : big_mag;
+    mag = (ab == INF) ? big_mag : mag;
+
+    // Negative bases (including -0) need an integer exponent, except
+    // for zeros and infinities, which don't care
+    const bool neg = asInt(a) < 0;
+    float neg_out = (integer | (aa == 0.0f) | (aa == INF)) ? mag : NAN_;
+    neg_out = odd ? -mag : neg_out;
+    float out = neg ? neg_out : mag;
+    out = ((a == 1.0f) | (b == 0.0f)) ? 1.0f : out;
+    out = (LIBFIVE_ISNAN(a) & (b != 0.0f)) ? a : out;
+    out = (LIBFIVE_ISNAN(b) & (a != 1.0f)) ? b : out;
+    return out;
+}
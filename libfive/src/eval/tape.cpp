@@ -7,156 +7,324 @@ This Source Code Form is subject to the terms of the Mozilla Public
 License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
+#include <algorithm>
 #include <unordered_map>
 
 #include "libfive/eval/tape.hpp"
 #include "libfive/eval/deck.hpp"
+#include "libfive/eval/compiled_tape.hpp"
 #include "libfive/render/brep/region.hpp"
 
+#include "tape.inl"
+
 namespace libfive {
 
 Tape::Handle Tape::push(Deck& deck, KeepFunction fn, Type t)
 {
-    return push(deck, fn, t, Region<3>());
+    return push<KeepFunction>(deck, fn, t, Region<3>());
 }
 
 Tape::Handle Tape::push(Deck& deck, KeepFunction fn, Type type,
                         const Region<3>& r)
 {
-    // If this tape has no min/max clauses, then return it right away
-    if (terminal)
+    return push<KeepFunction>(deck, fn, type, r);
+}
+
+void Tape::resetPushState(Deck& deck) const
+{
+    // push only clears disabled for the root and for arguments of clauses
+    // in this tape, and only sets remap for clauses in this tape.  Oracle
+    // clauses store an oracle index in c.a, but setting an extra flag to
+    // true is harmless, since that's its resting state anyways.
+    deck.disabled[i] = true;
+    for (const auto& c : t)
     {
-        return shared_from_this();
+        deck.disabled[c.id] = true;
+        deck.disabled[c.a] = true;
+        deck.disabled[c.b] = true;
+        deck.remap[c.id] = 0;
     }
+}
 
-    // Since we'll be figuring out which clauses are disabled and
-    // which should be remapped, we reset those arrays here
-    std::fill(deck.disabled.begin(), deck.disabled.end(), true);
-    std::fill(deck.remap.begin(), deck.remap.end(), 0);
-
-    // Mark the root node as active
-    deck.disabled[i] = false;
-
-    // We'll store a temporary vector of Oracle contexts here.
-    //
-    // By default, these contexts will be the same as the previous tape,
-    // but we'll call push on each Oracle to see if we should refine it
-    // any further.
-    std::vector<std::shared_ptr<OracleContext>> new_contexts = contexts;
-    assert(new_contexts.size() == deck.oracles.size());
-
-    bool terminal = true;
-    bool changed = false;
+size_t Tape::hash() const
+{
+    // Boost-style hash combining
+    size_t h = std::hash<const Tape*>()(parent.get());
+    auto mix = [&h](size_t v) {
+        h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+    };
+    mix(i);
     for (const auto& c : t)
     {
-        if (!deck.disabled[c.id])
-        {
-            switch (fn(c.op, c.id, c.a, c.b))
-            {
-                case KEEP_A:        deck.disabled[c.a] = false;
-                                    deck.remap[c.id] = c.a;
-                                    changed = true;
-                                    break;
-                case KEEP_B:        deck.disabled[c.b] = false;
-                                    deck.remap[c.id] = c.b;
-                                    changed = true;
-                                    break;
-                case KEEP_BOTH:     terminal = false; // fallthrough
-                case KEEP_ALWAYS:   break;
-            }
-
-            if (deck.remap[c.id])
-            {
-                deck.disabled[c.id] = true;
-            }
-            // Oracle nodes are special-cased here.  They should always
-            // return either KEEP_BOTH or KEEP_ALWAYS, but have no children
-            // to disable (and c.a is a dummy index into the oracles[]
-            // array, so we shouldn't mis-interpret it as a clause index).
-            else if (c.op != Opcode::ORACLE)
-            {
-                deck.disabled[c.a] = false;
-                deck.disabled[c.b] = false;
-            }
-            else if (c.op == Opcode::ORACLE)
-            {
-                // Get the previous context, then use it to store
-                // a new context for the oracle, marking whether it
-                // has changed.
-                assert(c.a < contexts.size());
-                auto prev = contexts[c.a];
-
-                deck.oracles[c.a]->bind(prev);
-                new_contexts[c.a] = deck.oracles[c.a]->push(type);
-                deck.oracles[c.a]->unbind();
-
-                changed |= (new_contexts[c.a] != prev);
-                terminal &= (new_contexts[c.a].get() == nullptr) ||
-                             new_contexts[c.a]->isTerminal();
-            }
-        }
-    }
-
-
-    if (!changed)
+        mix(c.id);
+        mix(c.a);
+        mix(c.b);
+    }
+    for (const auto& c : contexts)
     {
-        return shared_from_this();
+        mix(std::hash<OracleContext*>()(c.get()));
     }
+    return h;
+}
 
-    Tape::Handle out;
-    if (deck.spares.size())
+bool Tape::sameAs(const Tape& other) const
+{
+    if (parent != other.parent || type != other.type || i != other.i ||
+        t.size() != other.t.size() || contexts != other.contexts)
+    {
+        return false;
+    }
+    // Opcodes are fixed by clause id, so we only compare ids and arguments
+    for (unsigned k=0; k < t.size(); ++k)
     {
-        out = deck.spares.back();
-        deck.spares.pop_back();
+        if (t[k].id != other.t[k].id || t[k].a != other.t[k].a ||
+            t[k].b != other.t[k].b)
+        {
+            return false;
+        }
     }
-    else
+    return true;
+}
+
+void Tape::lower(const std::vector<uint8_t>& inputs,
+                 const std::vector<float>& values, Slots& s) const
+{
+    // Count the users of each clause (with the root counting as a use), so
+    // that we only fold clauses whose results aren't needed elsewhere.
+    // s.pos maps from clause id to position in t for now.
+    s.uses[i]++;
+    for (unsigned k=0; k < t.size(); ++k)
     {
-        out.reset(new Tape);
+        const auto& c = t[k];
+        s.pos[c.id] = k;
+        if (c.op != Opcode::ORACLE)
+        {
+            s.uses[c.a]++;
+            s.uses[c.b]++;
+        }
     }
-    out->t.reserve(t.size());
 
-    out->type = type;
-    out->parent = shared_from_this();
-    out->terminal = terminal;
-    out->t.clear(); // preserves capacity
+    // Returns the clause that computes x if it has the given opcode and
+    // only one user, so that it can be folded into that user.
+    auto single = [&](Clause::Id x, Opcode::Opcode op) -> const Clause* {
+        if (inputs[x] || s.uses[x] != 1)
+        {
+            return nullptr;
+        }
+        const auto& c = t[s.pos[x]];
+        return (c.op == op) ? &c : nullptr;
+    };
+
+    // Folding a clause into its user is marked by clearing its use count,
+    // since every clause that isn't folded has at least one use.
+    struct Fused { Opcode::Opcode op; Clause::Id a; Clause::Id b; };
+    auto fuseAdd = [&](const Clause& c, bool apply) -> Fused {
+        const auto sa = single(c.a, Opcode::OP_SQUARE);
+        const auto sb = single(c.b, Opcode::OP_SQUARE);
+        if (apply && sa) s.uses[c.a] = 0;
+        if (apply && sb) s.uses[c.b] = 0;
+        if (sa && sb)   return {Opcode::OP_SUM_SQUARES, sa->a, sb->a};
+        else if (sb)    return {Opcode::OP_ADD_SQUARE, c.a, sb->a};
+        else if (sa)    return {Opcode::OP_ADD_SQUARE, c.b, sa->a};
+        else            return {Opcode::OP_ADD, c.a, c.b};
+    };
+
+    // Walk the tape from the root, so that each clause is visited before
+    // the clauses that it may absorb.  Once a clause is visited, its s.pos
+    // entry is changed to its position in the lowered tape.
+    auto& out = s.lowered;
+    out.clear();
+    for (const auto& c : t)
+    {
+        if (!s.uses[c.id])
+        {
+            continue;
+        }
+        s.pos[c.id] = out.size();
+
+        const bool ka = (c.op != Opcode::ORACLE) &&
+                        (inputs[c.a] == CONSTANT_INPUT);
+        const bool kb = (Opcode::args(c.op) == 2) &&
+                        (inputs[c.b] == CONSTANT_INPUT);
+        auto imm = [&](Opcode::Opcode op, Clause::Id a, Clause::Id k) {
+            out.push_back({op, c.id, a, Clause::encodeImmediate(values[k])});
+        };
+
+        // Min and max are only lowered with a constant rhs, since their
+        // behavior with NaN depends on the order of their arguments.
+        if (ka != kb && (c.op == Opcode::OP_ADD || c.op == Opcode::OP_MUL))
+        {
+            imm((c.op == Opcode::OP_ADD) ? Opcode::OP_ADD_IMM
+                                         : Opcode::OP_MUL_IMM,
+                ka ? c.b : c.a, ka ? c.a : c.b);
+        }
+        else if (ka != kb && c.op == Opcode::OP_SUB)
+        {
+            imm(ka ? Opcode::OP_RSUB_IMM : Opcode::OP_SUB_IMM,
+                ka ? c.b : c.a, ka ? c.a : c.b);
+        }
+        else if (ka != kb && c.op == Opcode::OP_DIV)
+        {
+            imm(ka ? Opcode::OP_RDIV_IMM : Opcode::OP_DIV_IMM,
+                ka ? c.b : c.a, ka ? c.a : c.b);
+        }
+        else if (kb && !ka && c.op == Opcode::OP_MIN)
+        {
+            imm(Opcode::OP_MIN_IMM, c.a, c.b);
+        }
+        else if (kb && !ka && c.op == Opcode::OP_MAX)
+        {
+            imm(Opcode::OP_MAX_IMM, c.a, c.b);
+        }
+        else if (c.op == Opcode::OP_ADD)
+        {
+            const auto f = fuseAdd(c, true);
+            out.push_back({f.op, c.id, f.a, f.b});
+        }
+        else if (c.op == Opcode::OP_SQRT && single(c.a, Opcode::OP_ADD) &&
+                 fuseAdd(t[s.pos[c.a]], false).op != Opcode::OP_ADD)
+        {
+            const auto f = fuseAdd(t[s.pos[c.a]], true);
+            s.uses[c.a] = 0;
+            out.push_back({(f.op == Opcode::OP_SUM_SQUARES)
+                                ? Opcode::OP_HYPOT
+                                : Opcode::OP_SQRT_ADD_SQUARE,
+                           c.id, f.a, f.b});
+        }
+        else
+        {
+            out.push_back(c);
+        }
+    }
 
-    // Now, use the data in disabled and remap to make the new tape
+    // Put uses back to all zeros for the next call
+    s.uses[i] = 0;
     for (const auto& c : t)
     {
-        if (!deck.disabled[c.id])
+        if (c.op != Opcode::ORACLE)
+        {
+            s.uses[c.a] = 0;
+            s.uses[c.b] = 0;
+        }
+    }
+}
+
+size_t Tape::assignSlots(const std::vector<uint8_t>& inputs, Slots& s)
+{
+    const auto& t = s.lowered;
+    const uint32_t n = t.size();
+
+    // Returns true if the clause's rhs is another clause (rather than
+    // an immediate, oracle index, or placeholder)
+    auto hasB = [](const Clause& c) {
+        return Opcode::args(c.op) == 2;
+    };
+
+    // Find the last use of each clause, walking in evaluation order
+    // (i.e. from the back of the tape).  Arguments to min and max are
+    // pinned until the end of the tape, as is the root.
+    for (uint32_t k=0; k < n; ++k)
+    {
+        const auto& c = t[n - k - 1];
+        s.last_use[c.id] = k;
+        if (c.op == Opcode::ORACLE)
+        {
+            continue;
+        }
+        const uint32_t u = (c.op == Opcode::OP_MIN ||
+                            c.op == Opcode::OP_MAX ||
+                            c.op == Opcode::OP_MIN_IMM ||
+                            c.op == Opcode::OP_MAX_IMM) ? n : k;
+        if (c.a && !inputs[c.a])
+        {
+            s.last_use[c.a] = std::max(s.last_use[c.a], u);
+        }
+        if (hasB(c) && c.b && !inputs[c.b])
         {
-            // Oracle nodes use c.a as an index into tape->oracles,
-            // rather than the address of an lhs / rhs expression,
-            // so we special-case them here to avoid bad remapping.
-            if (c.op == Opcode::ORACLE)
-            {
-                out->t.push_back({c.op, c.id, c.a, c.b});
-            }
-            else
-            {
-                Clause::Id ra, rb;
-                for (ra = c.a; deck.remap[ra]; ra = deck.remap[ra]);
-                for (rb = c.b; deck.remap[rb]; rb = deck.remap[rb]);
-                out->t.push_back({c.op, c.id, ra, rb});
-            }
+            s.last_use[c.b] = std::max(s.last_use[c.b], u);
         }
     }
+    if (!inputs[i])
+    {
+        s.last_use[i] = n;
+    }
+
+    // Then, walk the tape again, assigning each clause the most recently
+    // freed slot (or a fresh one) and freeing arguments at their last use.
+    // The output is assigned before arguments are freed, so a clause never
+    // writes into one of its own arguments' slots.
+    size_t count = 0;
+    s.free.clear();
+    for (uint32_t k=0; k < n; ++k)
+    {
+        const auto& c = t[n - k - 1];
+        if (s.free.size())
+        {
+            s.slot[c.id] = s.free.back();
+            s.free.pop_back();
+        }
+        else
+        {
+            s.slot[c.id] = ++count;
+        }
 
-    // Remap the tape root index
-    for (out->i = i; deck.remap[out->i]; out->i = deck.remap[out->i]);
+        if (c.op == Opcode::ORACLE)
+        {
+            continue;
+        }
+        if (c.a && !inputs[c.a] && s.last_use[c.a] == k)
+        {
+            s.free.push_back(s.slot[c.a]);
+        }
+        if (hasB(c) && c.b && c.b != c.a && !inputs[c.b] &&
+            s.last_use[c.b] == k)
+        {
+            s.free.push_back(s.slot[c.b]);
+        }
+    }
 
-    // Make sure that the tape got shorter
-    assert(out->t.size() <= t.size());
+    return count;
+}
 
-    // Store X / Y / Z bounds (may be irrelevant)
-    out->X = {r.lower.x(), r.upper.x()};
-    out->Y = {r.lower.y(), r.upper.y()};
-    out->Z = {r.lower.z(), r.upper.z()};
+void Tape::writeSlots(const Slots& s)
+{
+    allocated.clear(); // preserves capacity
+    allocated.reserve(s.lowered.size());
+    for (const auto& c : s.lowered)
+    {
+        // Oracle clauses use c.a as an index into the oracles array,
+        // and _IMM clauses store a float in c.b
+        if (c.op == Opcode::ORACLE)
+        {
+            allocated.push_back({c.op, s.slot[c.id], c.a, c.b});
+        }
+        else if (Opcode::args(c.op) == 1)
+        {
+            allocated.push_back({c.op, s.slot[c.id], s.slot[c.a], c.b});
+        }
+        else
+        {
+            allocated.push_back({c.op, s.slot[c.id],
+                                 s.slot[c.a], s.slot[c.b]});
+        }
+    }
+    root_slot = s.slot[i];
 
-    // Store the Oracle contexts
-    out->contexts = std::move(new_contexts);
+    index.resize(t.size());
+    for (unsigned k=0; k < t.size(); ++k)
+    {
+        index[k] = s.pos[t[k].id];
+    }
+}
 
-    return out;
+std::shared_ptr<const CompiledTape> Tape::compiled(size_t stride) const
+{
+    std::lock_guard<std::mutex> lock(jit_lock);
+    if (!jit || jit->stride() != stride)
+    {
+        jit = std::make_shared<const CompiledTape>(*this, stride);
+    }
+    return jit;
 }
 
 std::shared_ptr<OracleContext> Tape::getContext(unsigned i) const
@@ -0,0 +1,194 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2017  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#pragma once
+
+#include "libfive/eval/tape.hpp"
+#include "libfive/eval/deck.hpp"
+#include "libfive/render/brep/region.hpp"
+
+namespace libfive {
+
+template <typename F>
+Tape::Handle Tape::push(Deck& deck, const F& fn, Type type,
+                        const Region<3>& r)
+{
+    // If this tape has no min/max clauses, then return it right away
+    if (terminal)
+    {
+        return shared_from_this();
+    }
+
+    // Between pushes, every clause is disabled and nothing is remapped,
+    // so we only need to mark the clauses that this tape keeps (and undo
+    // those marks in resetPushState), rather than clearing the arrays
+    // for every clause in the Deck.
+
+    // Mark the root node as active
+    deck.disabled[i] = false;
+
+    // We'll store a temporary vector of Oracle contexts here.
+    //
+    // By default, these contexts will be the same as the previous tape,
+    // but we'll call push on each Oracle to see if we should refine it
+    // any further.
+    std::vector<std::shared_ptr<OracleContext>> new_contexts = contexts;
+    assert(new_contexts.size() == deck.oracles.size());
+
+    bool terminal = true;
+    bool changed = false;
+    for (unsigned k=0; k < t.size(); ++k)
+    {
+        const auto& c = t[k];
+        if (!deck.disabled[c.id])
+        {
+            if (c.op == Opcode::OP_MIN || c.op == Opcode::OP_MAX)
+            {
+                // The keep function reads evaluator results, which are
+                // stored by slot rather than by clause id.  If the clause
+                // was lowered to take an immediate, then we pass in the
+                // constant's slot (which evaluators still populate).
+                const auto& s = allocated[index[k]];
+                const auto b = Opcode::hasImmediate(s.op)
+                    ? deck.shared->slots[c.b] : s.b;
+                switch (fn(c.op, s.id, s.a, b))
+                {
+                    case KEEP_A:        deck.disabled[c.a] = false;
+                                        deck.remap[c.id] = c.a;
+                                        changed = true;
+                                        break;
+                    case KEEP_B:        deck.disabled[c.b] = false;
+                                        deck.remap[c.id] = c.b;
+                                        changed = true;
+                                        break;
+                    case KEEP_BOTH:     terminal = false; // fallthrough
+                    case KEEP_ALWAYS:   break;
+                }
+            }
+
+            if (deck.remap[c.id])
+            {
+                deck.disabled[c.id] = true;
+            }
+            // Oracle nodes are special-cased here.  They should always
+            // return either KEEP_BOTH or KEEP_ALWAYS, but have no children
+            // to disable (and c.a is a dummy index into the oracles[]
+            // array, so we shouldn't mis-interpret it as a clause index).
+            else if (c.op != Opcode::ORACLE)
+            {
+                deck.disabled[c.a] = false;
+                deck.disabled[c.b] = false;
+            }
+            else if (c.op == Opcode::ORACLE)
+            {
+                // Get the previous context, then use it to store
+                // a new context for the oracle, marking whether it
+                // has changed.
+                assert(c.a < contexts.size());
+                auto prev = contexts[c.a];
+
+                deck.oracles[c.a]->bind(prev);
+                new_contexts[c.a] = deck.oracles[c.a]->push(type);
+                deck.oracles[c.a]->unbind();
+
+                changed |= (new_contexts[c.a] != prev);
+                terminal &= (new_contexts[c.a].get() == nullptr) ||
+                             new_contexts[c.a]->isTerminal();
+            }
+        }
+    }
+
+
+    if (!changed)
+    {
+        resetPushState(deck);
+        return shared_from_this();
+    }
+
+    Tape::Handle out;
+    if (deck.spares.size())
+    {
+        out = deck.spares.back();
+        deck.spares.pop_back();
+    }
+    else
+    {
+        out.reset(new Tape);
+    }
+    out->t.reserve(t.size());
+
+    out->type = type;
+    out->parent = shared_from_this();
+    out->terminal = terminal;
+    out->t.clear(); // preserves capacity
+    out->jit.reset();
+
+    // Now, use the data in disabled and remap to make the new tape
+    for (const auto& c : t)
+    {
+        if (!deck.disabled[c.id])
+        {
+            // Oracle nodes use c.a as an index into tape->oracles,
+            // rather than the address of an lhs / rhs expression,
+            // so we special-case them here to avoid bad remapping.
+            if (c.op == Opcode::ORACLE)
+            {
+                out->t.push_back({c.op, c.id, c.a, c.b});
+            }
+            else
+            {
+                Clause::Id ra, rb;
+                for (ra = c.a; deck.remap[ra]; ra = deck.remap[ra]);
+                for (rb = c.b; deck.remap[rb]; rb = deck.remap[rb]);
+                out->t.push_back({c.op, c.id, ra, rb});
+            }
+        }
+    }
+
+    // Remap the tape root index
+    for (out->i = i; deck.remap[out->i]; out->i = deck.remap[out->i]);
+
+    // We're done with disabled and remap, so put them back the way we
+    // found them for the next push.
+    resetPushState(deck);
+
+    // Make sure that the tape got shorter
+    assert(out->t.size() <= t.size());
+
+    // Store the Oracle contexts
+    out->contexts = std::move(new_contexts);
+
+    // If a neighboring cell made the same choices, then reuse its tape.
+    // The shared tape keeps that cell's bounds, which is conservative:
+    // getBase will walk up to the parent for points outside of them.
+    if (type == INTERVAL)
+    {
+        auto prev = deck.intern(out);
+        if (prev != out)
+        {
+            out->parent.reset();
+            deck.spares.push_back(std::move(out));
+            return prev;
+        }
+    }
+
+    // Store X / Y / Z bounds (may be irrelevant)
+    out->X = {r.lower.x(), r.upper.x()};
+    out->Y = {r.lower.y(), r.upper.y()};
+    out->Z = {r.lower.z(), r.upper.z()};
+
+    // Lower the shortened tape and pick result slots
+    out->lower(deck.shared->inputs, deck.shared->values, deck.slots);
+    out->assignSlots(deck.shared->inputs, deck.slots);
+    out->writeSlots(deck.slots);
+
+    return out;
+}
+
+}   // namespace libfive
@@ -14,7 +14,8 @@ namespace libfive {
 TransformedOracle::TransformedOracle(
         std::unique_ptr<Oracle> underlying, Tree X_, Tree Y_, Tree Z_)
     : underlying(std::move(underlying)),
-      xEvaluator(X_), yEvaluator(Y_), zEvaluator(Z_)
+      xEvaluator(new Evaluator(X_)), yEvaluator(new Evaluator(Y_)),
+      zEvaluator(new Evaluator(Z_))
 {
     //nothing more to do here.
 }
@@ -22,16 +23,20 @@ TransformedOracle::TransformedOracle(
 void TransformedOracle::set(const Eigen::Vector3f& p, size_t index)
 {
     OracleStorage::set(p, index);
-    xEvaluator.set(p, index);
-    yEvaluator.set(p, index);
-    zEvaluator.set(p, index);
+    if (index >= xEvaluator->width())
+    {
+        widen(points.cols());
+    }
+    xEvaluator->set(p, index);
+    yEvaluator->set(p, index);
+    zEvaluator->set(p, index);
 }
 
 void TransformedOracle::evalInterval(Interval& out)
 {
-    auto xRange = xEvaluator.eval(lower, upper);
-    auto yRange = yEvaluator.eval(lower, upper);
-    auto zRange = zEvaluator.eval(lower, upper);
+    auto xRange = xEvaluator->eval(lower, upper);
+    auto yRange = yEvaluator->eval(lower, upper);
+    auto zRange = zEvaluator->eval(lower, upper);
 
     Eigen::Vector3f rangeLower{
         xRange.lower(), yRange.lower(), zRange.lower() };
@@ -48,12 +53,12 @@ void TransformedOracle::evalPoint(float& out, size_t index)
     assert(context == nullptr || ctx != nullptr);
 
     Eigen::Vector3f transformedPoint = ctx
-        ? Eigen::Vector3f(xEvaluator.value(points.col(index), *ctx->tx),
-                          yEvaluator.value(points.col(index), *ctx->ty),
-                          zEvaluator.value(points.col(index), *ctx->tz))
-        : Eigen::Vector3f(xEvaluator.value(points.col(index)),
-                          yEvaluator.value(points.col(index)),
-                          zEvaluator.value(points.col(index)));
+        ? Eigen::Vector3f(xEvaluator->value(points.col(index), *ctx->tx),
+                          yEvaluator->value(points.col(index), *ctx->ty),
+                          zEvaluator->value(points.col(index), *ctx->tz))
+        : Eigen::Vector3f(xEvaluator->value(points.col(index)),
+                          yEvaluator->value(points.col(index)),
+                          zEvaluator->value(points.col(index)));
 
     underlying->set(transformedPoint, index);
 
@@ -64,18 +69,18 @@ void TransformedOracle::evalPoint(float& out, size_t index)
 
 void TransformedOracle::evalArray(
     Eigen::Block<Eigen::Array<float, Eigen::Dynamic,
-                 LIBFIVE_EVAL_ARRAY_SIZE, Eigen::RowMajor>, 1, Eigen::Dynamic> out)
+                 Eigen::Dynamic, Eigen::RowMajor>, 1, Eigen::Dynamic> out)
 {
     auto ctx = dynamic_cast<Context*>(context.get());
     assert(context == nullptr || ctx != nullptr);
     const unsigned count = out.cols();
 
-    auto xPoints = ctx ? xEvaluator.values(count, *ctx->tx)
-                       : xEvaluator.values(count);
-    auto yPoints = ctx ? yEvaluator.values(count, *ctx->ty)
-                       : yEvaluator.values(count);
-    auto zPoints = ctx ? zEvaluator.values(count, *ctx->tz)
-                       : zEvaluator.values(count);
+    auto xPoints = ctx ? xEvaluator->values(count, *ctx->tx)
+                       : xEvaluator->values(count);
+    auto yPoints = ctx ? yEvaluator->values(count, *ctx->ty)
+                       : yEvaluator->values(count);
+    auto zPoints = ctx ? zEvaluator->values(count, *ctx->tz)
+                       : zEvaluator->values(count);
 
     for (unsigned i = 0; i < count; ++i)
     {
@@ -88,14 +93,14 @@ void TransformedOracle::evalArray(
 }
 
 void TransformedOracle::checkAmbiguous(
-    Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+    Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
                  1, Eigen::Dynamic> out)
 {
     const unsigned count = out.cols();
     underlying->checkAmbiguous(out);
-    out = out || xEvaluator.getAmbiguous(count)
-              || yEvaluator.getAmbiguous(count)
-              || zEvaluator.getAmbiguous(count);
+    out = out || xEvaluator->getAmbiguous(count)
+              || yEvaluator->getAmbiguous(count)
+              || zEvaluator->getAmbiguous(count);
 }
 
 void TransformedOracle::evalDerivs(
@@ -108,19 +113,19 @@ void TransformedOracle::evalDerivs(
     Eigen::Matrix3f Jacobian;
     Jacobian <<
         (ctx
-            ? xEvaluator.deriv(points.col(index), *ctx->tx)
-            : xEvaluator.deriv(points.col(index))).template head<3>(),
+            ? xEvaluator->deriv(points.col(index), *ctx->tx)
+            : xEvaluator->deriv(points.col(index))).template head<3>(),
         (ctx
-            ? yEvaluator.deriv(points.col(index), *ctx->ty)
-            : yEvaluator.deriv(points.col(index))).template head<3>(),
+            ? yEvaluator->deriv(points.col(index), *ctx->ty)
+            : yEvaluator->deriv(points.col(index))).template head<3>(),
         (ctx
-            ? zEvaluator.deriv(points.col(index), *ctx->tz)
-            : zEvaluator.deriv(points.col(index))).template head<3>();
+            ? zEvaluator->deriv(points.col(index), *ctx->tz)
+            : zEvaluator->deriv(points.col(index))).template head<3>();
 
     Eigen::Vector3f transformedPoint{
-        xEvaluator.value(points.col(index)),
-        yEvaluator.value(points.col(index)),
-        zEvaluator.value(points.col(index))};
+        xEvaluator->value(points.col(index)),
+        yEvaluator->value(points.col(index)),
+        zEvaluator->value(points.col(index))};
 
     underlying->set(transformedPoint, index);
 
@@ -132,19 +137,19 @@ void TransformedOracle::evalDerivs(
 }
 
 void TransformedOracle::evalDerivArray(
-    Eigen::Block<Eigen::Array<float, 3, LIBFIVE_EVAL_ARRAY_SIZE>,
+    Eigen::Block<Eigen::Array<float, 3, Eigen::Dynamic>,
                  3, Eigen::Dynamic, true> out)
 {
     auto ctx = dynamic_cast<Context*>(context.get());
     const unsigned count = out.cols();
     assert(context == nullptr || ctx != nullptr);
 
-    auto xDerivs = ctx ? xEvaluator.derivs(count, *ctx->tx)
-                       : xEvaluator.derivs(count);
-    auto yDerivs = ctx ? yEvaluator.derivs(count, *ctx->ty)
-                       : yEvaluator.derivs(count);
-    auto zDerivs = ctx ? zEvaluator.derivs(count, *ctx->tz)
-                       : zEvaluator.derivs(count);
+    auto xDerivs = ctx ? xEvaluator->derivs(count, *ctx->tx)
+                       : xEvaluator->derivs(count);
+    auto yDerivs = ctx ? yEvaluator->derivs(count, *ctx->ty)
+                       : yEvaluator->derivs(count);
+    auto zDerivs = ctx ? zEvaluator->derivs(count, *ctx->tz)
+                       : zEvaluator->derivs(count);
 
     underlying->bind(ctx ? ctx->u : nullptr);
     underlying->evalDerivArray(out);
@@ -169,16 +174,16 @@ void TransformedOracle::evalFeatures(
     out.clear();
     auto pt = points.col(0);
     Eigen::Vector3f transformedPoint = ctx
-        ? Eigen::Vector3f(xEvaluator.value(pt, *ctx->tx),
-                          yEvaluator.value(pt, *ctx->ty),
-                          zEvaluator.value(pt, *ctx->tz))
-        : Eigen::Vector3f(xEvaluator.value(pt),
-                          yEvaluator.value(pt),
-                          zEvaluator.value(pt));
+        ? Eigen::Vector3f(xEvaluator->value(pt, *ctx->tx),
+                          yEvaluator->value(pt, *ctx->ty),
+                          zEvaluator->value(pt, *ctx->tz))
+        : Eigen::Vector3f(xEvaluator->value(pt),
+                          yEvaluator->value(pt),
+                          zEvaluator->value(pt));
 
-    auto xFeatures = xEvaluator.features_(pt);
-    auto yFeatures = yEvaluator.features_(pt);
-    auto zFeatures = zEvaluator.features_(pt);
+    auto xFeatures = xEvaluator->features_(pt);
+    auto yFeatures = yEvaluator->features_(pt);
+    auto zFeatures = zEvaluator->features_(pt);
 
     boost::container::small_vector<Feature, 4> underlyingOut;
     underlying->set(transformedPoint);
@@ -232,12 +237,12 @@ std::shared_ptr<OracleContext> TransformedOracle::push(Tape::Type t)
 
     auto out = std::shared_ptr<Context>(new Context);
 
-    out->tx = ctx ? xEvaluator.push(ctx->tx)
-                  : xEvaluator.push();
-    out->ty = ctx ? yEvaluator.push(ctx->ty)
-                  : yEvaluator.push();
-    out->tz = ctx ? zEvaluator.push(ctx->tz)
-                  : zEvaluator.push();
+    out->tx = ctx ? xEvaluator->push(ctx->tx)
+                  : xEvaluator->push();
+    out->ty = ctx ? yEvaluator->push(ctx->ty)
+                  : yEvaluator->push();
+    out->tz = ctx ? zEvaluator->push(ctx->tz)
+                  : zEvaluator->push();
 
     underlying->bind(ctx ? ctx->u : nullptr);
     out->u = underlying->push(t);
@@ -247,6 +252,23 @@ std::shared_ptr<OracleContext> TransformedOracle::push(Tape::Type t)
 }
 
 
+void TransformedOracle::widen(size_t width)
+{
+    // The new evaluators share the old ones' Decks, so tapes stored in
+    // contexts are still valid.  Points that were already set are copied
+    // over from OracleStorage.
+    const size_t prev = xEvaluator->width();
+    for (auto e : {&xEvaluator, &yEvaluator, &zEvaluator})
+    {
+        e->reset(new Evaluator((*e)->getDeck(),
+                               std::map<Tree::Id, float>(), width));
+        for (size_t i=0; i < prev; ++i)
+        {
+            (*e)->set(points.col(i), i);
+        }
+    }
+}
+
 bool TransformedOracle::Context::isTerminal()
 {
     return tx->isTerminal() &&
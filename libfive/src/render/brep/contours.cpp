@@ -29,9 +29,14 @@ std::unique_ptr<Contours> Contours::render(
     std::vector<Evaluator, Eigen::aligned_allocator<Evaluator>> es;
     es.reserve(settings.workers);
     const auto t = t_.optimized();
+
+    // Flatten the tree once, then share the result between evaluators
+    const auto deck = std::make_shared<const Deck::Shared>(t);
     for (unsigned i=0; i < settings.workers; ++i)
     {
-        es.emplace_back(Evaluator(t));
+        es.emplace_back(Evaluator(std::make_shared<Deck>(deck),
+                                  std::map<Tree::Id, float>(),
+                                  settings.eval_width));
     }
 
     // Create the quadtree on the scaffold
@@ -106,11 +111,12 @@ bool Contours::saveSVG(const std::string& filename)
     return true;
 }
 
-void Contours::collect(const std::vector<PerThreadBRep<2>>& children)
+void Contours::collect(const std::vector<PerThreadBRep<2>>& children,
+                       unsigned workers, ThreadPool* pool)
 {
     // First, collect into a single b-rep, with unique indices
     BRep<2> segs;
-    segs.collect(children);
+    segs.collect(children, workers, pool);
 
     // Maps from index to item in segments vector
     std::map<uint32_t, uint32_t> heads;
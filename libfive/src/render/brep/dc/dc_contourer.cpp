@@ -99,7 +99,7 @@ void DCContourer::load(const std::array<const DCTree<2>*, 2>& ts)
         vs[i] = ts[i]->leaf->index[vi];
     }
     // Handle contour winding direction
-    m.branes.push_back({vs[!D], vs[D]});
+    m.pushBrane({vs[!D], vs[D]});
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -152,7 +152,7 @@ void DCMesher::load(const std::array<const DCTree<3>*, 4>& ts)
     auto push_triangle = [&](uint32_t a, uint32_t b, uint32_t c) {
         if (a != b && b != c && a != c)
         {
-            m.branes.push_back({a, b, c});
+            m.pushBrane({a, b, c});
         }
     };
 
@@ -7,6 +7,7 @@ This Source Code Form is subject to the terms of the Mozilla Public
 License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
+#include <algorithm>
 #include <future>
 #include <numeric>
 #include <functional>
@@ -97,11 +98,18 @@ Tape::Handle DCTree<N>::evalInterval(Evaluator* eval,
 {
     // Do a preliminary evaluation to prune the tree, storing the interval
     // result and an handle to the pushed tape (which we'll use when recursing)
-    auto o = eval->intervalAndPush(
+    return evalInterval(eval, tape, pool,
+        eval->intervalAndPush(
             this->region.lower3().template cast<float>(),
             this->region.upper3().template cast<float>(),
-            tape);
+            tape));
+}
 
+template <unsigned N>
+Tape::Handle DCTree<N>::evalInterval(
+        Evaluator* eval, const Tape::Handle& tape, Pool& pool,
+        std::pair<Interval, Tape::Handle> o)
+{
     this->type = o.first.state();
     if (!o.first.isSafe())
     {
@@ -133,36 +141,51 @@ void DCTree<N>::evalLeaf(Evaluator* eval,
                         Pool& object_pool,
                         const DCNeighbors<N>& neighbors)
 {
-    // Track how many corners have to be evaluated here
-    // (if they can be looked up from a neighbor, they don't have
-    //  to be evaluated here, which can save time)
-    size_t count = 0;
-
-    // Remap from a value in the range [0, count) to a corner index
-    // in the range [0, 1 <<N).
-    std::array<int, 1 << N> corner_indices;
-
-    // Local array of corners
-    std::array<Interval::State, 1 << N> corners;
+    DCTree<N>* self = this;
+    evalLeaves(eval, tape, object_pool, &self, &neighbors, 1);
+}
 
-    // Pack corners into evaluator
-    Eigen::Matrix<float, 3, 1 << N> pos;
-    for (uint8_t i=0; i < this->children.size(); ++i)
+template <unsigned N>
+void DCTree<N>::evalLeaves(Evaluator* eval,
+                           const Tape::Handle& tape,
+                           Pool& object_pool,
+                           DCTree<N>* const* trees,
+                           const DCNeighbors<N>* neighbors,
+                           unsigned count)
+{
+    // Corner states for each tree in the batch
+    std::vector<std::array<Interval::State, 1 << N>> corners(count);
+
+    // Positions of every corner that needs to be evaluated.  Corners which
+    // are shared between trees in the batch are only evaluated once;
+    // corner_index[t][i] is the index into this array for a particular
+    // tree and corner (or -1 if it can be looked up from a neighbor).
+    std::vector<Eigen::Vector3f> pts;
+    std::vector<std::array<int, 1 << N>> corner_index(count);
+    for (unsigned t=0; t < count; ++t)
     {
-        auto c = neighbors.check(i);
-        if (c == Interval::UNKNOWN)
-        {
-            pos.col(count) = this->region.corner3f(i);
-            eval->set(pos.col(count), count);
-            corner_indices[count++] = i;
-        }
-        else
+        for (uint8_t i=0; i < trees[t]->children.size(); ++i)
         {
-            corners[i] = c;
+            auto c = neighbors[t].check(i);
+            if (c == Interval::UNKNOWN)
+            {
+                const Eigen::Vector3f p = trees[t]->region.corner3f(i);
+                const auto itr = std::find(pts.begin(), pts.end(), p);
+                corner_index[t][i] = itr - pts.begin();
+                if (itr == pts.end())
+                {
+                    pts.push_back(p);
+                }
+            }
+            else
+            {
+                corner_index[t][i] = -1;
+                corners[t][i] = c;
+            }
         }
     }
 
-    // Evaluate the region's corners and check their states
+    // Evaluate the corners and check their states
     // We handle evaluation in three phases:
     // 1)  Evaluate the distance field at corners, mark < 0 or > 0
     //     as filled or empty.
@@ -173,37 +196,42 @@ void DCTree<N>::evalLeaf(Evaluator* eval,
     //     can find an inside-outside transition).
     // 3)  For values that are == 0 and ambiguous, call isInside
     //     (the heavy hitter of inside-outside checking).
-    auto vs = eval->values(count, *tape);
+    std::vector<Interval::State> states(pts.size(), Interval::UNKNOWN);
 
-    // We store ambiguity here, but clear it if the point is inside
-    // or outside (so after the loop below, ambig(i) is only set if
-    // pos[i] is both == 0 and ambiguous).
-    auto ambig = eval->getAmbiguous(count, *tape);
-
-    // This is a count of how many points there are that == 0
-    // but are unambiguous; unambig_remap[z] returns the index
-    // into the corner_indices array for a particular unambiguous zero.
-    uint8_t unambiguous_zeros = 0;
-    std::array<int, 1 << N> unambig_remap;
+    // Indices (into pts) of zeros which are unambiguous / ambiguous
+    std::vector<size_t> unambig_zeros;
+    std::vector<size_t> ambig_zeros;
 
     // This is phase 1, as described above
-    for (uint8_t i=0; i < count; ++i)
+    for (size_t start=0; start < pts.size(); start += eval->width())
     {
-        // Handle inside, outside, and (non-ambiguous) on-boundary
-        if (vs(i) > 0 || std::isnan(vs(i)))
-        {
-            corners[corner_indices[i]] = Interval::EMPTY;
-            ambig(i) = false;
-        }
-        else if (vs(i) < 0)
+        const size_t n = std::min(pts.size() - start, eval->width());
+        for (unsigned i=0; i < n; ++i)
         {
-            corners[corner_indices[i]] = Interval::FILLED;
-            ambig(i) = false;
+            eval->set(pts[start + i], i);
         }
-        else if (!ambig(i))
+        auto vs = eval->values(n, *tape);
+        auto ambig = eval->getAmbiguous(n, *tape);
+
+        for (unsigned i=0; i < n; ++i)
         {
-            unambig_remap[unambiguous_zeros] = i;
-            unambiguous_zeros++;
+            // Handle inside, outside, and (non-ambiguous) on-boundary
+            if (vs(i) > 0 || std::isnan(vs(i)))
+            {
+                states[start + i] = Interval::EMPTY;
+            }
+            else if (vs(i) < 0)
+            {
+                states[start + i] = Interval::FILLED;
+            }
+            else if (!ambig(i))
+            {
+                unambig_zeros.push_back(start + i);
+            }
+            else
+            {
+                ambig_zeros.push_back(start + i);
+            }
         }
     }
 
@@ -211,344 +239,413 @@ void DCTree<N>::evalLeaf(Evaluator* eval,
     // We can get both positive and negative values out if
     // there's a non-zero gradient. Once again, we need to use
     // single-point evaluation if it's sufficiently close to zero.
-    if (unambiguous_zeros)
+    for (size_t start=0; start < unambig_zeros.size();
+         start += eval->width())
     {
-        for (unsigned i = 0; i < unambiguous_zeros; ++i)
+        const size_t n = std::min(unambig_zeros.size() - start,
+                                  eval->width());
+        for (unsigned i=0; i < n; ++i)
         {
-            eval->set(pos.col(unambig_remap[i]), i);
+            eval->set(pts[unambig_zeros[start + i]], i);
         }
-        auto ds = eval->derivs(unambiguous_zeros, *tape);
-        for (unsigned i=0; i < unambiguous_zeros; ++i)
+        auto ds = eval->derivs(n, *tape);
+        for (unsigned i=0; i < n; ++i)
         {
-            corners[corner_indices[unambig_remap[i]]] =
+            states[unambig_zeros[start + i]] =
                 (ds.col(i).template head<3>() != 0).any()
                 ? Interval::FILLED : Interval::EMPTY;
         }
     }
 
     // Phase 3: One last pass for handling ambiguous corners
-    for (uint8_t i=0; i < count; ++i)
+    for (auto i : ambig_zeros)
     {
-        if (ambig(i))
-        {
-            corners[corner_indices[i]] =
-                eval->isInside(pos.col(i), tape)
-                    ? Interval::FILLED
-                    : Interval::EMPTY;
-        }
+        states[i] = eval->isInside(pts[i], tape)
+            ? Interval::FILLED
+            : Interval::EMPTY;
     }
 
-    bool all_full = true;
-    bool all_empty = true;
+    // Trees which are ambiguous (and need to have vertices placed),
+    // along with their neighbors
+    std::vector<std::pair<DCTree<N>*, const DCNeighbors<N>*>> active;
+    active.reserve(count);
 
-    // Pack corners into filled / empty arrays
-    for (uint8_t i=0; i < this->children.size(); ++i)
+    for (unsigned t=0; t < count; ++t)
     {
-        all_full  &= (corners[i] == Interval::FILLED);
-        all_empty &= (corners[i] == Interval::EMPTY);
-    }
+        auto tree = trees[t];
+        bool all_full = true;
+        bool all_empty = true;
 
-    this->type = all_empty ? Interval::EMPTY
-               : all_full  ? Interval::FILLED : Interval::AMBIGUOUS;
+        // Pack corners into filled / empty arrays
+        for (uint8_t i=0; i < tree->children.size(); ++i)
+        {
+            if (corner_index[t][i] != -1)
+            {
+                corners[t][i] = states[corner_index[t][i]];
+            }
+            all_full  &= (corners[t][i] == Interval::FILLED);
+            all_empty &= (corners[t][i] == Interval::EMPTY);
+        }
 
-    // Early exit if this leaf is unambiguous
-    if (this->type != Interval::AMBIGUOUS)
-    {
-        if (this->done()) {
-            releaseTo(object_pool);
+        tree->type = all_empty ? Interval::EMPTY
+                   : all_full  ? Interval::FILLED : Interval::AMBIGUOUS;
+
+        // Early exit if this leaf is unambiguous
+        if (tree->type != Interval::AMBIGUOUS)
+        {
+            if (tree->done()) {
+                tree->releaseTo(object_pool);
+            }
+            continue;
         }
-        return;
-    }
 
-    assert(this->leaf == nullptr);
-    this->leaf = object_pool.next().get();
-    this->leaf->corner_mask = buildCornerMask(corners);
+        assert(tree->leaf == nullptr);
+        tree->leaf = object_pool.next().get();
+        tree->leaf->corner_mask = buildCornerMask(corners[t]);
+
+        // Now, for the fun part of actually placing vertices!
+        // Figure out if the leaf is manifold
+        tree->leaf->manifold = cornersAreManifold(tree->leaf->corner_mask);
 
-    // Now, for the fun part of actually placing vertices!
-    // Figure out if the leaf is manifold
-    this->leaf->manifold = cornersAreManifold(this->leaf->corner_mask);
+        active.push_back({tree, &neighbors[t]});
+    }
 
-    // Iterate over manifold patches, storing one vertex per patch
-    const auto& ps = MarchingTable<N>::v(this->leaf->corner_mask);
-    while (this->leaf->vertex_count < ps.size() &&
-           ps[this->leaf->vertex_count][0].first != -1)
+    // Per-tree state for the manifold patch that is being processed
+    struct Patch
     {
+        DCTree<N>* tree;
+
         // Number of edges, total
         unsigned edge_count;
 
         // Edge indices (as found with mt->e[a][b]) for all edges,
         // with edge_count valid entries.
         std::array<size_t, _edges(N)> edges;
+    };
 
-        {   // Within this block, we calculate all edges that haven't
-            // already been calculated by neighbors and store them in
-            // the appropriate slot of the intersections array.
+    // An edge which needs to be searched for an intersection
+    struct Target
+    {
+        DCTree<N>* tree;
 
-            // Numbers of edges that need evaluation
-            unsigned eval_count;
+        // Inside-outside pair
+        std::pair<Vec, Vec> pos;
 
-            // Inside-outside pairs, with eval_count valid pairs
-            std::array<std::pair<Vec, Vec>, _edges(N)> targets;
+        // Edge index (as found with mt->e[a][b])
+        size_t edge;
+    };
 
-            // Edge indices (as found with mt->e[a][b]) for edges under
-            // evaluation, with eval_count valid values.
-            std::array<size_t, _edges(N)> eval_edges;
+    // Iterate over manifold patches, storing one vertex per patch.  Each
+    // pass through this loop handles one patch from every tree that has
+    // patches remaining, so that we can batch together their edge searches.
+    std::vector<Patch> patches;
+    std::vector<Target> targets;
+    while (true)
+    {
+        patches.clear();
+        targets.clear();
+
+        for (auto& a : active)
+        {
+            auto tree = a.first;
+            const auto& ps = MarchingTable<N>::v(tree->leaf->corner_mask);
+            if (tree->leaf->vertex_count >= ps.size() ||
+                ps[tree->leaf->vertex_count][0].first == -1)
+            {
+                continue;
+            }
+            const auto& p = ps[tree->leaf->vertex_count];
+
+            patches.push_back(Patch());
+            auto& patch = patches.back();
+            patch.tree = tree;
 
             // Iterate over edges in this patch, storing [inside, outside]
             // in the targets array if the list of intersections can't be
             // re-used from a neighbor.
-            for (edge_count=0, eval_count=0;
-                 edge_count < ps[this->leaf->vertex_count].size() &&
-                     ps[this->leaf->vertex_count][edge_count].first != -1;
-                 ++edge_count)
+            for (patch.edge_count=0;
+                 patch.edge_count < p.size() &&
+                     p[patch.edge_count].first != -1;
+                 ++patch.edge_count)
             {
                 // Sanity-checking
-                assert(corners[ps[this->leaf->vertex_count][edge_count].first]
-                       == Interval::FILLED);
-                assert(corners[ps[this->leaf->vertex_count][edge_count].second]
-                       == Interval::EMPTY);
+                auto c = p[patch.edge_count];
+                assert(tree->cornerState(c.first) == Interval::FILLED);
+                assert(tree->cornerState(c.second) == Interval::EMPTY);
 
                 // Store the edge index associated with this target
-                auto c = ps[this->leaf->vertex_count][edge_count];
-                edges[edge_count] = MarchingTable<N>::e(c.first)[c.second];
+                const size_t edge = MarchingTable<N>::e(c.first)[c.second];
+                patch.edges[patch.edge_count] = edge;
+                assert(edge < tree->leaf->intersections.size());
 
-                auto compare = neighbors.check(c.first, c.second);
+                auto compare = a.second->check(c.first, c.second);
                 // Enable this to turn on sharing of results with neighbors
                 if (compare != nullptr)
                 {
-                    this->leaf->intersections[edges[edge_count]] = compare;
+                    tree->leaf->intersections[edge] = compare;
                 }
                 else
                 {
-                    // Store inside / outside in targets array, and the edge
-                    // index in the eval_edges array.
-                    targets[eval_count] = {this->region.corner(c.first),
-                                           this->region.corner(c.second)};
-                    eval_edges[eval_count] = edges[edge_count];
-
-                    assert(eval_edges[eval_count] < this->leaf->intersections.size());
-                    eval_count++;
+                    // Store inside / outside in targets array, along
+                    // with the edge index.
+                    targets.push_back({tree,
+                                       {tree->region.corner(c.first),
+                                        tree->region.corner(c.second)},
+                                       edge});
                 }
-
-                assert(edges[edge_count] < this->leaf->intersections.size());
             }
+        }
 
-            // Next, we search over the target edges, doing an
-            // N-fold reduction at each stage to home in on the
-            // exact intersection position
-            constexpr int SEARCH_COUNT = 4;
-            constexpr int POINTS_PER_SEARCH = 16;
-            static_assert(
-                    _edges(N) * POINTS_PER_SEARCH <= ArrayEvaluator::N,
-                    "Potential overflow");
-
-            // Multi-stage binary search for intersection
-            for (int s=0; s < SEARCH_COUNT; ++s)
+        if (patches.empty())
+        {
+            break;
+        }
+
+        // Next, we search over the target edges, doing an
+        // N-fold reduction at each stage to home in on the
+        // exact intersection position
+        //
+        // Batches are limited by the evaluator's width, and by the
+        // size of the local arrays below (which are ArrayEvaluator::N wide)
+        constexpr int SEARCH_COUNT = 4;
+        constexpr int POINTS_PER_SEARCH = 16;
+        const size_t batch = std::min(eval->width(), ArrayEvaluator::N);
+        const unsigned TARGETS_PER_SEARCH = batch / POINTS_PER_SEARCH;
+        assert(TARGETS_PER_SEARCH > 0); // Evaluator is too small
+
+        // Multi-stage binary search for intersection
+        for (int s=0; s < SEARCH_COUNT; ++s)
+        {
+            for (size_t start=0; start < targets.size();
+                 start += TARGETS_PER_SEARCH)
             {
+                const unsigned eval_count = std::min<size_t>(
+                        targets.size() - start, TARGETS_PER_SEARCH);
+
                 // Load search points into evaluator
-                Eigen::Array<double, N, POINTS_PER_SEARCH * _edges(N)> ps;
+                Eigen::Array<double, N, ArrayEvaluator::N> ps;
                 for (unsigned e=0; e < eval_count; ++e)
                 {
+                    const auto& target = targets[start + e];
                     for (int j=0; j < POINTS_PER_SEARCH; ++j)
                     {
                         const double frac = j / (POINTS_PER_SEARCH - 1.0);
                         const unsigned i = j + e*POINTS_PER_SEARCH;
-                        ps.col(i) = (targets[e].first * (1 - frac)) +
-                                    (targets[e].second * frac);
-                        eval->set<N>(ps.col(i), this->region, i);
+                        ps.col(i) = (target.pos.first * (1 - frac)) +
+                                    (target.pos.second * frac);
+                        eval->set<N>(ps.col(i), target.tree->region, i);
                     }
                 }
 
                 // Evaluate, then search for the first outside point
                 // and adjust inside / outside to their new positions
-                if (eval_count)
+
+                // Store the results here, because calling isInside
+                // invalidates the output array.
+                Eigen::Array<float, 1, ArrayEvaluator::N> out;
+                out.leftCols(POINTS_PER_SEARCH * eval_count) =
+                    eval->values(POINTS_PER_SEARCH * eval_count, *tape);
+
+                for (unsigned e=0; e < eval_count; ++e)
                 {
-                    // Store the results here, because calling isInside
-                    // invalidates the output array.
-                    Eigen::Array<float, 1, ArrayEvaluator::N> out;
-                    out.leftCols(POINTS_PER_SEARCH * eval_count) =
-                        eval->values(
-                            POINTS_PER_SEARCH * eval_count, *tape);
-
-                    for (unsigned e=0; e < eval_count; ++e)
+                    auto& target = targets[start + e];
+
+                    // Skip one point, because the very first point is
+                    // already known to be inside the shape (but
+                    // sometimes, due to numerical issues, it registers
+                    // as outside!)
+                    for (unsigned j=1; j < POINTS_PER_SEARCH; ++j)
                     {
-                        // Skip one point, because the very first point is
-                        // already known to be inside the shape (but
-                        // sometimes, due to numerical issues, it registers
-                        // as outside!)
-                        for (unsigned j=1; j < POINTS_PER_SEARCH; ++j)
+                        const unsigned i = j + e*POINTS_PER_SEARCH;
+                        if (out[i] > 0)
+                        {
+                            assert(i > 0);
+                            target.pos = {ps.col(i - 1), ps.col(i)};
+                            break;
+                        }
+                        else if (out[i] == 0)
                         {
-                            const unsigned i = j + e*POINTS_PER_SEARCH;
-                            if (out[i] > 0)
+                            if (!eval->isInside<N>(ps.col(i),
+                                                   target.tree->region,
+                                                   tape))
                             {
                                 assert(i > 0);
-                                targets[e] = {ps.col(i - 1), ps.col(i)};
-                                break;
-                            }
-                            else if (out[i] == 0)
-                            {
-                                if (!eval->isInside<N>(ps.col(i), this->region,
-                                                               tape))
-                                {
-                                    assert(i > 0);
-                                    targets[e] = {ps.col(i - 1), ps.col(i)};
-                                    break;
-                                }
-                            }
-                            // Special-case for final point in the search,
-                            // working around numerical issues where
-                            // different evaluators disagree with whether
-                            // points are inside or outside.
-                            else if (j == POINTS_PER_SEARCH - 1)
-                            {
-                                targets[e] = {ps.col(i - 1), ps.col(i)};
+                                target.pos = {ps.col(i - 1), ps.col(i)};
                                 break;
                             }
                         }
+                        // Special-case for final point in the search,
+                        // working around numerical issues where
+                        // different evaluators disagree with whether
+                        // points are inside or outside.
+                        else if (j == POINTS_PER_SEARCH - 1)
+                        {
+                            target.pos = {ps.col(i - 1), ps.col(i)};
+                            break;
+                        }
                     }
                 }
             }
+        }
+
+        // Now, we evaluate the distance field (value + derivatives) at
+        // each intersection (which is associated with a specific edge).
+        const unsigned TARGETS_PER_DERIV = batch / 2;
+        for (size_t start=0; start < targets.size();
+             start += TARGETS_PER_DERIV)
+        {
+            const unsigned eval_count = std::min<size_t>(
+                    targets.size() - start, TARGETS_PER_DERIV);
+            for (unsigned i=0; i < eval_count; ++i)
+            {
+                const auto& target = targets[start + i];
+                eval->set<N>(target.pos.first, target.tree->region, 2*i);
+                eval->set<N>(target.pos.second, target.tree->region,
+                             2*i + 1);
+            }
 
-            // Now, we evaluate the distance field (value + derivatives) at
-            // each intersection (which is associated with a specific edge).
-            static_assert(_edges(N) * 2 <= ArrayEvaluator::N,
-                          "Too many results");
-            if (eval_count)
+            // Copy the results to a local array, to avoid invalidating
+            // the results array when we call features() below.
+            Eigen::Array<float, 4, ArrayEvaluator::N> ds;
+            ds.leftCols(2 * eval_count) = eval->derivs(
+                    2 * eval_count, *tape);
+            auto ambig = eval->getAmbiguous(2 * eval_count, *tape);
+
+            // Iterate over all inside-outside pairs, storing the number
+            // of intersections before each inside node (in prev_size),
+            // then checking the rank of the pair after each outside
+            // node based on the accumulated intersections.
+            for (unsigned i=0; i < 2 * eval_count; ++i)
             {
-                for (unsigned i=0; i < eval_count; ++i)
+                const auto& target = targets[start + i/2];
+
+                // This is the position associated with the intersection
+                // being investigated.
+                Eigen::Vector3d pos;
+                pos << ((i & 1) ? target.pos.second : target.pos.first),
+                       target.tree->region.perp;
+
+                // If this position is unambiguous, then we can use the
+                // derivatives value calculated and stored in ds.
+                if (!ambig(i))
                 {
-                    eval->set<N>(targets[i].first, this->region, 2*i);
-                    eval->set<N>(targets[i].second, this->region, 2*i + 1);
+                    target.tree->saveIntersection(
+                            pos.template head<N>(),
+                            ds.col(i).template cast<double>()
+                                     .template head<N>(),
+                            ds.col(i).w(), target.edge, object_pool);
                 }
-
-                // Copy the results to a local array, to avoid invalidating
-                // the results array when we call features() below.
-                Eigen::Array<float, 4, ArrayEvaluator::N> ds;
-                ds.leftCols(2 * eval_count) = eval->derivs(
-                        2 * eval_count, *tape);
-                auto ambig = eval->getAmbiguous(2 * eval_count, *tape);
-
-                // Iterate over all inside-outside pairs, storing the number
-                // of intersections before each inside node (in prev_size),
-                // then checking the rank of the pair after each outside
-                // node based on the accumulated intersections.
-                for (unsigned i=0; i < 2 * eval_count; ++i)
+                // Otherwise, we need to use the feature-finding special
+                // case to find all possible derivatives at this point.
+                else
                 {
-                    // This is the position associated with the intersection
-                    // being investigated.
-                    Eigen::Vector3d pos;
-                    pos << ((i & 1) ? targets[i/2].second
-                                    : targets[i/2].first),
-                           this->region.perp;
-
-                    // If this position is unambiguous, then we can use the
-                    // derivatives value calculated and stored in ds.
-                    if (!ambig(i))
-                    {
-                        saveIntersection(pos.template head<N>(),
-                                         ds.col(i).template cast<double>()
-                                                  .template head<N>(),
-                                         ds.col(i).w(), eval_edges[i/2],
-                                         object_pool);
-                    }
-                    // Otherwise, we need to use the feature-finding special
-                    // case to find all possible derivatives at this point.
-                    else
-                    {
-                        const auto fs = eval->features(
-                                pos.template cast<float>(), tape);
+                    const auto fs = eval->features(
+                            pos.template cast<float>(), tape);
 
-                        for (auto& f : fs)
-                        {
-                            saveIntersection(pos.template head<N>(),
-                                             f.template head<N>()
-                                              .template cast<double>(),
-                                             ds.col(i).w(), eval_edges[i/2],
-                                             object_pool);
-                        }
+                    for (auto& f : fs)
+                    {
+                        target.tree->saveIntersection(
+                                pos.template head<N>(),
+                                f.template head<N>()
+                                 .template cast<double>(),
+                                ds.col(i).w(), target.edge, object_pool);
                     }
                 }
             }
         }
+
         // At this point, every [intersections[e] for e in edges] should be
-        // populated with an Intersection object, whether taken from a neighbor
-        // or calculated in the code above.
-
-        // Reset the mass point, since we may have used it for the previous
-        // vertex.
-        this->leaf->mass_point = this->leaf->mass_point.Zero();
-
-        {   // Build the mass point from max-rank intersections
-            int max_rank = 0;
-            for (unsigned i=0; i < edge_count; ++i) {
-                if (this->leaf->intersections[edges[i]]) {
-                    auto r = this->leaf->intersections[edges[i]]->get_rank();
-                    if (r > max_rank) {
-                        max_rank = r;
-                    }
-                }
-            }
+        // populated with an Intersection object, whether taken from a
+        // neighbor or calculated in the code above.
+        for (auto& patch : patches)
+        {
+            patch.tree->placeVertex(patch.edges, patch.edge_count);
+        }
+    }
 
-            for (unsigned i=0; i < edge_count; ++i)
-            {
-                if (this->leaf->intersections[edges[i]] &&
-                    this->leaf->intersections[edges[i]]->get_rank() == max_rank)
-                {
-                    this->leaf->mass_point +=
-                        this->leaf->intersections[edges[i]]
-                                  ->normalized_mass_point();
+    for (auto& a : active)
+    {
+        a.first->done();
+    }
+}
+
+template <unsigned N>
+void DCTree<N>::placeVertex(const std::array<size_t, _edges(N)>& edges,
+                            unsigned edge_count)
+{
+    // Reset the mass point, since we may have used it for the previous
+    // vertex.
+    this->leaf->mass_point = this->leaf->mass_point.Zero();
+
+    {   // Build the mass point from max-rank intersections
+        int max_rank = 0;
+        for (unsigned i=0; i < edge_count; ++i) {
+            if (this->leaf->intersections[edges[i]]) {
+                auto r = this->leaf->intersections[edges[i]]->get_rank();
+                if (r > max_rank) {
+                    max_rank = r;
                 }
             }
         }
 
-        // Now, we'll (pretend to) unpack into A and b matrices,
-        // then immediately calculate AtA, AtB, and BtB
-        //
-        // (Note: this has been moved to the Intersection class, but
-        //  the explanation below is still valid)
-        //
-        //  The A matrix is of the form
-        //  [n1x, n1y, n1z]
-        //  [n2x, n2y, n2z]
-        //  [n3x, n3y, n3z]
-        //  ...
-        //  (with one row for each sampled point's normal)
-        //
-        //  The b matrix is of the form
-        //  [p1 . n1]
-        //  [p2 . n2]
-        //  [p3 . n3]
-        //  ...
-        //  (with one row for each sampled point)
-        //
-        // Since we're deliberately sampling on either side of the
-        // intersection, we subtract out the distance-field value
-        // to make the math work out.
-        //
-        // Instead of actually populating these matrices, we'll immediately
-        // construct the compact results AtA, AtB, BtB
-        this->leaf->AtA.array() = 0;
-        this->leaf->AtB.array() = 0;
-        this->leaf->BtB = 0;
         for (unsigned i=0; i < edge_count; ++i)
         {
-            if (this->leaf->intersections[edges[i]])
+            if (this->leaf->intersections[edges[i]] &&
+                this->leaf->intersections[edges[i]]->get_rank() == max_rank)
             {
-                this->leaf->AtA += this->leaf->intersections[edges[i]]->AtA;
-                this->leaf->AtB += this->leaf->intersections[edges[i]]->AtB;
-                this->leaf->BtB += this->leaf->intersections[edges[i]]->BtB;
+                this->leaf->mass_point +=
+                    this->leaf->intersections[edges[i]]
+                              ->normalized_mass_point();
             }
         }
+    }
 
-        // Find the vertex position, storing into the appropriate column
-        // of the vertex array and ignoring the error result (because
-        // this is the bottom of the recursion)
-        findVertex(this->leaf->vertex_count);
-
-        // Move on to the next vertex
-        this->leaf->vertex_count++;
+    // Now, we'll (pretend to) unpack into A and b matrices,
+    // then immediately calculate AtA, AtB, and BtB
+    //
+    // (Note: this has been moved to the Intersection class, but
+    //  the explanation below is still valid)
+    //
+    //  The A matrix is of the form
+    //  [n1x, n1y, n1z]
+    //  [n2x, n2y, n2z]
+    //  [n3x, n3y, n3z]
+    //  ...
+    //  (with one row for each sampled point's normal)
+    //
+    //  The b matrix is of the form
+    //  [p1 . n1]
+    //  [p2 . n2]
+    //  [p3 . n3]
+    //  ...
+    //  (with one row for each sampled point)
+    //
+    // Since we're deliberately sampling on either side of the
+    // intersection, we subtract out the distance-field value
+    // to make the math work out.
+    //
+    // Instead of actually populating these matrices, we'll immediately
+    // construct the compact results AtA, AtB, BtB
+    this->leaf->AtA.array() = 0;
+    this->leaf->AtB.array() = 0;
+    this->leaf->BtB = 0;
+    for (unsigned i=0; i < edge_count; ++i)
+    {
+        if (this->leaf->intersections[edges[i]])
+        {
+            this->leaf->AtA += this->leaf->intersections[edges[i]]->AtA;
+            this->leaf->AtB += this->leaf->intersections[edges[i]]->AtB;
+            this->leaf->BtB += this->leaf->intersections[edges[i]]->BtB;
+        }
     }
-    this->done();
+
+    // Find the vertex position, storing into the appropriate column
+    // of the vertex array and ignoring the error result (because
+    // this is the bottom of the recursion)
+    findVertex(this->leaf->vertex_count);
+
+    // Move on to the next vertex
+    this->leaf->vertex_count++;
 }
 
 template <unsigned N>
@@ -446,7 +446,7 @@ void HybridMesher::load(const std::array<const HybridTree<3>*, 4>& ts)
                 }
 
                 // Save the resulting triangle
-                m.branes.push_back(tri_vert_indices);
+                m.pushBrane(tri_vert_indices);
             }
         }
     }
@@ -466,6 +466,7 @@ uint64_t HybridMesher::searchEdge(Eigen::Vector3d inside,
     constexpr int POINTS_PER_SEARCH = 16;
     static_assert(POINTS_PER_SEARCH <= ArrayEvaluator::N,
                   "Overflowing ArrayEvaluator data array");
+    assert(POINTS_PER_SEARCH <= eval->width());
 
     // Multi-stage binary search for intersection
     for (int s=0; s < SEARCH_COUNT; ++s)
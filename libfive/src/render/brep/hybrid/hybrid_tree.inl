@@ -106,6 +106,7 @@ Eigen::Matrix<double, N, 2> searchBetween(
     constexpr int POINTS_PER_SEARCH = 16;
     static_assert(POINTS_PER_SEARCH <= ArrayEvaluator::N,
                   "Overflowing ArrayEvaluator data array");
+    assert(POINTS_PER_SEARCH <= eval->width());
 
     // Multi-stage binary search for intersection
     for (int s=0; s < SEARCH_COUNT; ++s)
@@ -205,11 +206,18 @@ Tape::Handle HybridTree<N>::evalInterval(Evaluator* eval,
 {
     // Do a preliminary evaluation to prune the tree, storing the interval
     // result and an handle to the pushed tape (which we'll use when recursing)
-    auto o = eval->intervalAndPush(
+    return evalInterval(eval, tape, object_pool,
+        eval->intervalAndPush(
             this->region.lower3().template cast<float>(),
             this->region.upper3().template cast<float>(),
-            tape);
+            tape));
+}
 
+template <unsigned N>
+Tape::Handle HybridTree<N>::evalInterval(
+        Evaluator* eval, const Tape::Handle& tape, Pool& object_pool,
+        std::pair<Interval, Tape::Handle> o)
+{
     this->type = o.first.state();
     if (!o.first.isSafe())
     {
@@ -0,0 +1,246 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <algorithm>
+
+#include "libfive/eval/evaluator.hpp"
+#include "libfive/eval/deck.hpp"
+#include "libfive/eval/tape.hpp"
+
+#include "libfive/render/brep/incremental_mesher.hpp"
+#include "libfive/render/brep/mesh.hpp"
+#include "libfive/render/brep/dual.hpp"
+#include "libfive/render/brep/settings.hpp"
+#include "libfive/render/brep/progress.hpp"
+
+#include "libfive/render/brep/dc/dc_worker_pool.hpp"
+#include "libfive/render/brep/dc/dc_mesher.hpp"
+
+namespace libfive {
+
+IncrementalMesher::IncrementalMesher(Evaluator* es, const Region<3>& region,
+                                     const std::map<Tree::Id, float>& vars)
+    : es(es), region(region), vars(vars)
+{
+    // Nothing to do here
+}
+
+/*
+ *  Checks whether any clause in the tape reads from the given slots
+ */
+static bool readsAny(const Tape& tape, const std::vector<Clause::Id>& slots)
+{
+    auto found = [&](Clause::Id id) {
+        return std::find(slots.begin(), slots.end(), id) != slots.end();
+    };
+
+    if (found(tape.root()))
+    {
+        return true;
+    }
+    for (auto itr = tape.rbegin(); itr != tape.rend(); ++itr)
+    {
+        const auto n = Opcode::args(itr->op);
+        if ((n >= 1 && found(itr->a)) || (n >= 2 && found(itr->b)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void IncrementalMesher::findChanged(
+        const DCTree<3>* parent, unsigned index,
+        const DCTree<3>* t, const Region<3>& r,
+        const std::shared_ptr<Tape>& tape,
+        const std::vector<Clause::Id>& slots,
+        std::vector<std::pair<const DCTree<3>*, unsigned>>& out)
+{
+    auto o = es[0].intervalAndPush(r.lower3().template cast<float>(),
+                                   r.upper3().template cast<float>(),
+                                   tape);
+
+    // Interval arithmetic is inclusion-monotonic, so if the cell is filled
+    // or empty for every value in the range, then it was (and will be)
+    // filled or empty with the old and new values.
+    const bool safe = o.first.isSafe();
+    if (safe && o.first.state() != Interval::AMBIGUOUS)
+    {
+        return;
+    }
+
+    // If the specialized tape doesn't use any of the changed variables,
+    // then the function is identical within this cell, so the subtree
+    // (and any intersections shared with its neighbors) is still valid.
+    const auto& next = safe ? o.second : tape;
+    if (!readsAny(*next, slots))
+    {
+        return;
+    }
+
+    if (t->isBranch() && r.level > REBUILD_LEVEL)
+    {
+        auto rs = r.subdivide();
+        for (unsigned i=0; i < rs.size(); ++i)
+        {
+            findChanged(t, i, t->children[i].load(), rs[i], next, slots, out);
+        }
+    }
+    else
+    {
+        out.push_back({parent, index});
+    }
+}
+
+void IncrementalMesher::resetIndices(const DCTree<3>* t)
+{
+    if (t->isBranch())
+    {
+        for (auto& c : t->children)
+        {
+            resetIndices(c.load());
+        }
+    }
+    else if (t->leaf)
+    {
+        t->leaf->index.fill(0);
+    }
+}
+
+std::unique_ptr<Mesh> IncrementalMesher::render(
+        const std::map<Tree::Id, float>& vs, const BRepSettings& settings)
+{
+    // Find the variables that have changed since the tree was built.  If
+    // we don't know a variable's old value, then we can't bound how far
+    // it has moved, so we fall back to building the whole tree.
+    bool full = root.get() == nullptr || dirty ||
+                settings.min_feature != min_feature ||
+                settings.max_err != max_err ||
+                root.size() > 2 * full_size;
+    std::map<Tree::Id, Interval> changed;
+    for (auto& v : vs)
+    {
+        auto itr = vars.find(v.first);
+        if (itr == vars.end())
+        {
+            full = true;
+        }
+        else if (itr->second != v.second)
+        {
+            changed.insert({v.first,
+                Interval(std::min(itr->second, v.second),
+                         std::max(itr->second, v.second))});
+        }
+    }
+
+    // Find cells which may be affected (before updating the evaluators,
+    // since the search needs to cover the whole range of values).
+    std::vector<std::pair<const DCTree<3>*, unsigned>> cells;
+    if (!full && !changed.empty())
+    {
+        auto deck = es[0].getDeck();
+        std::vector<Clause::Id> slots;
+        for (auto& c : changed)
+        {
+            auto s = deck->vars.right.find(c.first);
+            if (s != deck->vars.right.end())
+            {
+                slots.push_back(s->second);
+                es[0].IntervalEvaluator::setVar(c.first, c.second);
+            }
+        }
+        // Invariant clauses which read a changed variable have changed too
+        for (auto& c : deck->invariant)
+        {
+            if (std::find(slots.begin(), slots.end(), c.a) != slots.end() ||
+                (Opcode::args(c.op) == 2 &&
+                 std::find(slots.begin(), slots.end(), c.b) != slots.end()))
+            {
+                slots.push_back(c.id);
+            }
+        }
+        if (slots.size())
+        {
+            findChanged(nullptr, 0, root.get(), root->region,
+                        deck->tape, slots, cells);
+        }
+    }
+
+    for (unsigned i=0; i < settings.workers; ++i)
+    {
+        es[i].updateVars(vs);
+    }
+    for (auto& v : vs)
+    {
+        vars[v.first] = v.second;
+    }
+
+    if (settings.progress_handler)
+    {
+        // Full builds have root.reset, Pool::build, and Dual::walk;
+        // incremental builds have one Pool::build per cell, then Dual::walk
+        settings.progress_handler->start(std::vector<unsigned>(
+                    full ? 3 : (cells.size() + 1), 1));
+    }
+
+    auto cancel = [&]() {
+        dirty = true;
+        if (settings.progress_handler) {
+            settings.progress_handler->finish();
+        }
+        return nullptr;
+    };
+
+    if (full)
+    {
+        root.reset(settings);
+        root = DCWorkerPool<3>::build(
+                es, region.withResolution(settings.min_feature), settings);
+        if (settings.cancel.load() || root.get() == nullptr)
+        {
+            return cancel();
+        }
+        min_feature = settings.min_feature;
+        max_err = settings.max_err;
+        full_size = root.size();
+        rebuilt_count = 1;
+    }
+    else
+    {
+        for (auto& c : cells)
+        {
+            // The cell may be a singleton, so we look up its region
+            // through its parent (which has the level set, so that the
+            // rebuilt tree lines up with its neighbors).
+            const auto r = c.first ? c.first->region.subdivide()[c.second]
+                                   : root->region;
+            auto t = DCWorkerPool<3>::build(es, r, settings);
+            if (settings.cancel.load() || t.get() == nullptr)
+            {
+                return cancel();
+            }
+            root.graft(c.first, c.second, std::move(t));
+        }
+        rebuilt_count = cells.size();
+    }
+    dirty = false;
+
+    // Vertex indices are assigned while walking the tree, so they need to
+    // be cleared out from the previous walk.
+    resetIndices(root.get());
+    auto out = Dual<3>::walk<DCMesher>(root, settings);
+
+    if (settings.progress_handler)
+    {
+        settings.progress_handler->finish();
+    }
+
+    return settings.cancel.load() ? nullptr : std::move(out);
+}
+
+}   // namespace libfive
@@ -7,6 +7,7 @@ This Source Code Form is subject to the terms of the Mozilla Public
 License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
+#include <list>
 #include <numeric>
 #include <fstream>
 #include <boost/algorithm/string/predicate.hpp>
@@ -14,6 +15,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "libfive/eval/evaluator.hpp"
 
 #include "libfive/render/brep/mesh.hpp"
+#include "libfive/render/brep/mesh_writer.hpp"
 #include "libfive/render/brep/dual.hpp"
 #include "libfive/render/brep/region.hpp"
 #include "libfive/render/brep/settings.hpp"
@@ -38,8 +40,13 @@ std::unique_ptr<Mesh> Mesh::render(const Tree& t_, const Region<3>& r,
     std::vector<Evaluator, Eigen::aligned_allocator<Evaluator>> es;
     es.reserve(settings.workers);
     const auto t = t_.optimized();
+
+    // Flatten the tree once, then share the result between evaluators
+    const auto deck = std::make_shared<const Deck::Shared>(t);
     for (unsigned i=0; i < settings.workers; ++i) {
-        es.emplace_back(Evaluator(t));
+        es.emplace_back(Evaluator(std::make_shared<Deck>(deck),
+                                  std::map<Tree::Id, float>(),
+                                  settings.eval_width));
     }
 
     return render(es.data(), r, settings);
@@ -48,6 +55,182 @@ std::unique_ptr<Mesh> Mesh::render(const Tree& t_, const Region<3>& r,
 std::unique_ptr<Mesh> Mesh::render(
         Evaluator* es,
         const Region<3>& r, const BRepSettings& settings)
+{
+    return render(es, r, settings, nullptr);
+}
+
+bool Mesh::renderToFile(const std::string& filename,
+                        const Tree& t_, const Region<3>& r,
+                        const BRepSettings& settings)
+{
+    MeshWriter::Format format;
+    if (!MeshWriter::formatFor(filename, &format))
+    {
+        std::cerr << "Mesh::renderToFile: filename \"" << filename
+                  << "\" does not end in .stl or .ply" << std::endl;
+        return false;
+    }
+
+    MeshWriter writer(filename, format);
+    if (!writer.isOpen())
+    {
+        return false;
+    }
+
+    std::vector<Evaluator, Eigen::aligned_allocator<Evaluator>> es;
+    es.reserve(settings.workers);
+    const auto t = t_.optimized();
+
+    // Flatten the tree once, then share the result between evaluators
+    const auto deck = std::make_shared<const Deck::Shared>(t);
+    for (unsigned i=0; i < settings.workers; ++i) {
+        es.emplace_back(Evaluator(std::make_shared<Deck>(deck),
+                                  std::map<Tree::Id, float>(),
+                                  settings.eval_width));
+    }
+
+    const bool ok = (settings.tile_depth && settings.alg == DUAL_CONTOURING)
+        ? renderTiled(es.data(), r, settings, &writer)
+        : (render(es.data(), r, settings, &writer) != nullptr);
+
+    if (!ok || settings.cancel.load())
+    {
+        return false;
+    }
+    return writer.finish();
+}
+
+/*
+ *  Calls the face and edge procedures on the seams between the brick at
+ *  position p and its neighbors on the lower side of axis A, which must
+ *  have already been built.
+ */
+template <Axis::Axis A>
+static void stitchBricks(const std::vector<Root<DCTree<3>>>& bricks,
+                         const Eigen::Array3i& p, int n, DCMesher& m)
+{
+    auto at = [&](Eigen::Array3i b) {
+        return bricks[b.x() + n * (b.y() + n * b.z())].get();
+    };
+
+    auto unit = [](Axis::Axis b) {
+        Eigen::Array3i out = Eigen::Array3i::Zero();
+        out(Axis::toIndex(b)) = 1;
+        return out;
+    };
+    const auto a = unit(A);
+    const auto q = unit(Axis::Q(A));
+    const auto r = unit(Axis::R(A));
+
+    if (p(Axis::toIndex(A)) > 0)
+    {
+        face3<DCTree<3>, DCMesher, A>({{at(p - a), at(p)}}, m);
+    }
+
+    // The edge running along A, with bricks ordered as in call_edge3
+    if (p(Axis::toIndex(Axis::Q(A))) > 0 && p(Axis::toIndex(Axis::R(A))) > 0)
+    {
+        edge3<DCTree<3>, DCMesher, A>(
+                {{at(p - q - r), at(p - r), at(p - q), at(p)}}, m);
+    }
+}
+
+bool Mesh::renderTiled(Evaluator* es, const Region<3>& r_,
+                       const BRepSettings& settings, BRepSink<3>* sink)
+{
+    // Don't split the region below the resolution of its smallest cells
+    const auto r = r_.withResolution(settings.min_feature);
+    const int depth = std::min<int>(settings.tile_depth, r.level);
+    const int n = 1 << depth;
+
+    // Brick boundaries are computed once, so that neighboring bricks see
+    // exactly the same coordinates (and evaluate identical corners) along
+    // the seams between them.
+    std::array<std::vector<double>, 3> bounds;
+    for (unsigned a=0; a < 3; ++a)
+    {
+        for (int i=0; i < n; ++i)
+        {
+            bounds[a].push_back(r.lower(a) + (r.upper(a) - r.lower(a)) * i / n);
+        }
+        bounds[a].push_back(r.upper(a));
+    }
+
+    if (settings.progress_handler) {
+        // Pool::build, Dual::walk, t.reset for each brick
+        settings.progress_handler->start(
+                std::vector<unsigned>(3 * n * n * n, 1));
+    }
+
+    // Bricks are built in x, y, z order.  Each brick is stitched to the
+    // neighbors below it, so it has to stay alive until the brick at
+    // (+1, +1, +1) has been built; at most one layer of bricks (plus a
+    // row and a brick) is live at any given time.
+    std::vector<Root<DCTree<3>>> bricks(n * n * n);
+    std::list<int> live;
+
+    PerThreadBRep<3> seams(sink->index, sink);
+    DCMesher m(seams);
+
+    bool ok = true;
+    for (int i=0; i < n * n * n && ok; ++i)
+    {
+        const Eigen::Array3i p(i % n, (i / n) % n, i / (n * n));
+        const Region<3> brick(
+                {bounds[0][p.x()], bounds[1][p.y()], bounds[2][p.z()]},
+                {bounds[0][p.x() + 1], bounds[1][p.y() + 1],
+                 bounds[2][p.z() + 1]});
+
+        bricks[i] = DCWorkerPool<3>::build(es, brick, settings);
+        if (settings.cancel.load() || bricks[i].get() == nullptr)
+        {
+            ok = false;
+            break;
+        }
+        live.push_back(i);
+
+        Dual<3>::walk_<DCMesher>(bricks[i], settings,
+                [](PerThreadBRep<3>& brep, int) {
+                    return DCMesher(brep);
+                }, sink);
+
+        stitchBricks<Axis::X>(bricks, p, n, m);
+        stitchBricks<Axis::Y>(bricks, p, n, m);
+        stitchBricks<Axis::Z>(bricks, p, n, m);
+        seams.flush();
+
+        // Free any bricks that won't be stitched to again
+        for (auto itr = live.begin(); itr != live.end();)
+        {
+            const Eigen::Array3i q(*itr % n, (*itr / n) % n, *itr / (n * n));
+            const Eigen::Array3i last = (q + 1).min(n - 1);
+            if (last.x() + n * (last.y() + n * last.z()) <= i)
+            {
+                bricks[*itr].reset(settings);
+                itr = live.erase(itr);
+            }
+            else
+            {
+                ++itr;
+            }
+        }
+    }
+
+    for (auto& i : live)
+    {
+        bricks[i].reset(settings);
+    }
+
+    if (settings.progress_handler) {
+        settings.progress_handler->finish();
+    }
+    return ok && !settings.cancel.load();
+}
+
+std::unique_ptr<Mesh> Mesh::render(
+        Evaluator* es,
+        const Region<3>& r, const BRepSettings& settings,
+        BRepSink<3>* sink)
 {
     std::unique_ptr<Mesh> out;
     if (settings.alg == DUAL_CONTOURING)
@@ -66,7 +249,10 @@ std::unique_ptr<Mesh> Mesh::render(
         }
 
         // Perform marching squares
-        out = Dual<3>::walk<DCMesher>(t, settings);
+        out = Dual<3>::walk_<DCMesher>(t, settings,
+                [](PerThreadBRep<3>& brep, int) {
+                    return DCMesher(brep);
+                }, sink);
 
         // TODO: check for early return here again
         t.reset(settings);
@@ -91,7 +277,7 @@ std::unique_ptr<Mesh> Mesh::render(
         out = Dual<3>::walk_<SimplexMesher>(t, settings,
                 [&](PerThreadBRep<3>& brep, int i) {
                     return SimplexMesher(brep, &es[i]);
-                });
+                }, sink);
         t.reset(settings);
     }
     else if (settings.alg == HYBRID)
@@ -114,7 +300,7 @@ std::unique_ptr<Mesh> Mesh::render(
         out = Dual<3>::walk_<HybridMesher>(t, settings,
                 [&](PerThreadBRep<3>& brep, int i) {
                     return HybridMesher(brep, &es[i]);
-                });
+                }, sink);
         t.reset(settings);
     }
 
@@ -153,40 +339,30 @@ bool Mesh::saveSTL(const std::string& filename,
         return false;
     }
 
-    // File header (giving human-readable info about file type)
-    std::string header = "This is a binary STL exported from libfive.";
-    file.write(header.c_str(), header.length());
-
-    // Pad the rest of the header to 80 bytes
-    for (int i=header.length(); i < 80; ++i)
-    {
-        file.put(' ');
-    }
+    MeshWriter::writeSTLHeader(file);
 
     // Write the triangle count to the file
     uint32_t num = std::accumulate(meshes.begin(), meshes.end(), (uint32_t)0,
             [](uint32_t i, const Mesh* m){ return i + m->branes.size(); });
     file.write(reinterpret_cast<char*>(&num), sizeof(num));
 
+    // Encode triangles into a buffer, then write them out in large blocks
+    // (rather than with many tiny writes per triangle)
+    constexpr size_t BLOCK_SIZE = 4096;
+    std::vector<char> buf(BLOCK_SIZE * MeshWriter::STL_RECORD_SIZE);
     for (const auto& m : meshes)
     {
-        for (const auto& t : m->branes)
+        for (size_t i=0; i < m->branes.size(); i += BLOCK_SIZE)
         {
-            // Write out the normal vector for this face (all zeros)
-            float norm[3] = {0, 0, 0};
-            file.write(reinterpret_cast<char*>(&norm), sizeof(norm));
-
-            // Iterate over vertices (which are indices into the verts list)
-            for (unsigned i=0; i < 3; ++i)
+            const size_t n = std::min(BLOCK_SIZE, m->branes.size() - i);
+            for (size_t j=0; j < n; ++j)
             {
-                auto v = m->verts[t[i]];
-                float vert[3] = {v.x(), v.y(), v.z()};
-                file.write(reinterpret_cast<char*>(&vert), sizeof(vert));
+                const auto& t = m->branes[i + j];
+                MeshWriter::encodeSTL(&buf[j * MeshWriter::STL_RECORD_SIZE],
+                                      m->verts[t[0]], m->verts[t[1]],
+                                      m->verts[t[2]]);
             }
-
-            // Write out this face's attribute short
-            uint16_t attrib = 0;
-            file.write(reinterpret_cast<char*>(&attrib), sizeof(attrib));
+            file.write(buf.data(), n * MeshWriter::STL_RECORD_SIZE);
         }
     }
 
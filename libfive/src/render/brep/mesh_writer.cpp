@@ -0,0 +1,257 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "libfive/render/brep/mesh_writer.hpp"
+
+namespace libfive {
+
+MeshWriter::MeshWriter(const std::string& filename, Format format)
+    : format(format), chunks(1 << (32 - CHUNK_BITS)), vertex_end(1),
+      triangle_count(0), faces(nullptr), ok(true)
+{
+    for (auto& c : chunks)
+    {
+        c.store(nullptr);
+    }
+
+    file.open(filename, std::ios::out | std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "MeshWriter: could not open " << filename << std::endl;
+        ok = false;
+        return;
+    }
+
+    if (format == STL)
+    {
+        // The triangle count is a placeholder, patched in by finish()
+        writeSTLHeader(file);
+        uint32_t num = 0;
+        file.write(reinterpret_cast<char*>(&num), sizeof(num));
+    }
+    else
+    {
+        faces = std::tmpfile();
+        if (faces == nullptr)
+        {
+            std::cerr << "MeshWriter: could not open temporary file"
+                      << std::endl;
+            ok = false;
+        }
+    }
+}
+
+MeshWriter::~MeshWriter()
+{
+    if (faces)
+    {
+        std::fclose(faces);
+    }
+    for (auto& c : chunks)
+    {
+        delete [] c.load();
+    }
+}
+
+bool MeshWriter::formatFor(const std::string& filename, Format* format)
+{
+    if (boost::algorithm::iends_with(filename, ".stl"))
+    {
+        *format = STL;
+        return true;
+    }
+    else if (boost::algorithm::iends_with(filename, ".ply"))
+    {
+        *format = PLY;
+        return true;
+    }
+    return false;
+}
+
+bool MeshWriter::isOpen() const
+{
+    return ok;
+}
+
+void MeshWriter::pushVertex(uint32_t index, const Eigen::Vector3f& v)
+{
+    auto& chunk = chunks[index >> CHUNK_BITS];
+    auto ptr = chunk.load();
+    if (ptr == nullptr)
+    {
+        // Race to allocate this chunk, cleaning up if we lose
+        auto fresh = new Eigen::Vector3f[CHUNK_SIZE];
+        if (chunk.compare_exchange_strong(ptr, fresh))
+        {
+            ptr = fresh;
+        }
+        else
+        {
+            delete [] fresh;
+        }
+    }
+    ptr[index & (CHUNK_SIZE - 1)] = v;
+
+    // Track the end of the (dense) vertex range
+    auto end = vertex_end.load();
+    while (index >= end && !vertex_end.compare_exchange_weak(end, index + 1));
+}
+
+const Eigen::Vector3f& MeshWriter::vert(uint32_t index) const
+{
+    return chunks[index >> CHUNK_BITS].load()[index & (CHUNK_SIZE - 1)];
+}
+
+void MeshWriter::pushBranes(const Eigen::Matrix<uint32_t, 3, 1>* bs,
+                            size_t count)
+{
+    // Encode the whole batch before taking the lock, so that the lock
+    // is only held for a single large write.
+    std::vector<char> buf;
+    if (format == STL)
+    {
+        buf.resize(count * STL_RECORD_SIZE);
+        for (size_t i=0; i < count; ++i)
+        {
+            encodeSTL(&buf[i * STL_RECORD_SIZE],
+                      vert(bs[i][0]), vert(bs[i][1]), vert(bs[i][2]));
+        }
+    }
+    else
+    {
+        // Each face is a uint8_t vertex count, then three uint32_t
+        // indices (which are 0-indexed in the PLY file).
+        constexpr size_t FACE_SIZE = 1 + 3 * sizeof(uint32_t);
+        buf.resize(count * FACE_SIZE);
+        for (size_t i=0; i < count; ++i)
+        {
+            char* f = &buf[i * FACE_SIZE];
+            f[0] = 3;
+            for (unsigned j=0; j < 3; ++j)
+            {
+                const uint32_t k = bs[i][j] - 1;
+                memcpy(f + 1 + j * sizeof(k), &k, sizeof(k));
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mut);
+    if (format == STL)
+    {
+        file.write(buf.data(), buf.size());
+    }
+    else if (faces)
+    {
+        ok &= std::fwrite(buf.data(), 1, buf.size(), faces) == buf.size();
+    }
+    triangle_count += count;
+}
+
+bool MeshWriter::finish()
+{
+    if (!ok)
+    {
+        return false;
+    }
+
+    if (triangle_count > std::numeric_limits<uint32_t>::max())
+    {
+        std::cerr << "MeshWriter: too many triangles" << std::endl;
+        return false;
+    }
+    const uint32_t num = triangle_count;
+
+    if (format == STL)
+    {
+        // Patch the triangle count, which comes right after the header
+        file.seekp(80);
+        file.write(reinterpret_cast<const char*>(&num), sizeof(num));
+    }
+    else
+    {
+        const uint32_t num_verts = vertex_end.load() - 1;
+        file << "ply\n"
+             << "format binary_little_endian 1.0\n"
+             << "comment This is a binary PLY exported from libfive.\n"
+             << "element vertex " << num_verts << "\n"
+             << "property float x\n"
+             << "property float y\n"
+             << "property float z\n"
+             << "element face " << num << "\n"
+             << "property list uchar uint vertex_indices\n"
+             << "end_header\n";
+
+        // Write vertices in blocks, one chunk at a time
+        std::vector<float> buf;
+        for (uint32_t i=1; i <= num_verts; i += buf.size() / 3)
+        {
+            const uint32_t n = std::min(num_verts - i + 1,
+                                        CHUNK_SIZE - (i & (CHUNK_SIZE - 1)));
+            buf.resize(n * 3);
+            for (uint32_t j=0; j < n; ++j)
+            {
+                const auto& v = vert(i + j);
+                buf[3*j] = v.x();
+                buf[3*j + 1] = v.y();
+                buf[3*j + 2] = v.z();
+            }
+            file.write(reinterpret_cast<const char*>(buf.data()),
+                       buf.size() * sizeof(float));
+        }
+
+        // Then copy the faces over from the temporary file
+        std::rewind(faces);
+        std::vector<char> copy(1 << 20);
+        size_t n;
+        while ((n = std::fread(copy.data(), 1, copy.size(), faces)))
+        {
+            file.write(copy.data(), n);
+        }
+        ok &= !std::ferror(faces);
+    }
+
+    file.close();
+    ok &= !file.fail();
+    return ok;
+}
+
+void MeshWriter::encodeSTL(char* buf, const Eigen::Vector3f& a,
+                           const Eigen::Vector3f& b, const Eigen::Vector3f& c)
+{
+    // Normal vector for this face (all zeros), then the three vertices
+    const float data[12] = {0, 0, 0,
+                            a.x(), a.y(), a.z(),
+                            b.x(), b.y(), b.z(),
+                            c.x(), c.y(), c.z()};
+    memcpy(buf, data, sizeof(data));
+
+    // Finally, this face's attribute short
+    const uint16_t attrib = 0;
+    memcpy(buf + sizeof(data), &attrib, sizeof(attrib));
+}
+
+void MeshWriter::writeSTLHeader(std::ostream& out)
+{
+    // File header (giving human-readable info about file type)
+    std::string header = "This is a binary STL exported from libfive.";
+    out.write(header.c_str(), header.length());
+
+    // Pad the rest of the header to 80 bytes
+    for (int i=header.length(); i < 80; ++i)
+    {
+        out.put(' ');
+    }
+}
+
+}   // namespace libfive
@@ -8,8 +8,11 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #pragma once
 
+#include <new>
+
 #include "libfive/render/brep/progress.hpp"
 #include "libfive/render/brep/object_pool.hpp"
+#include "libfive/render/thread_pool.hpp"
 
 namespace libfive {
 
@@ -45,7 +48,8 @@ T* ObjectPool<T, Ts...>::get(Args... args)
 
     if (fresh_blocks.empty()) {
         fresh_blocks.push_back(std::make_pair(
-                    static_cast<T*>(T::operator new[](sizeof(T) * N)), 0));
+                    static_cast<T*>(::operator new[](sizeof(T) * N,
+                        std::align_val_t(alignof(T)))), 0));
     }
     assert(fresh_blocks.size());
 
@@ -123,7 +127,8 @@ int64_t ObjectPool<T, Ts...>::num_blocks() const {
 
 template <typename T, typename... Ts>
 void ObjectPool<T, Ts...>::reset(unsigned workers,
-           ProgressHandler* progress_watcher)
+           ProgressHandler* progress_watcher,
+           ThreadPool* pool)
 {
     auto workers_needed = std::max(allocated_blocks.size(),
                                    fresh_blocks.size());
@@ -137,7 +142,7 @@ void ObjectPool<T, Ts...>::reset(unsigned workers,
 
     // Delete all of the blocks, using multiple threads for speed
     for (unsigned i=0; i < workers; ++i) {
-        futures[i] = std::async(std::launch::async,
+        futures[i] = ThreadPool::run(pool,
                 [i, this, workers, &progress_watcher]() {
                 for (unsigned j=i; j < allocated_blocks.size();
                                    j += workers)
@@ -148,7 +153,8 @@ void ObjectPool<T, Ts...>::reset(unsigned workers,
                     if (progress_watcher) {
                         progress_watcher->tick();
                     }
-                    T::operator delete[](allocated_blocks[j]);
+                    ::operator delete[](allocated_blocks[j],
+                                       std::align_val_t(alignof(T)));
                 }
 
             for (unsigned j=i; j < fresh_blocks.size(); j += workers) {
@@ -158,7 +164,8 @@ void ObjectPool<T, Ts...>::reset(unsigned workers,
                 if (progress_watcher) {
                     progress_watcher->tick();
                 }
-                T::operator delete [](fresh_blocks[j].first);
+                ::operator delete[](fresh_blocks[j].first,
+                                   std::align_val_t(alignof(T)));
             }
         });
     }
@@ -171,6 +178,6 @@ void ObjectPool<T, Ts...>::reset(unsigned workers,
     allocated_blocks.clear();
     fresh_blocks.clear();
 
-    next().reset(workers, progress_watcher);
+    next().reset(workers, progress_watcher, pool);
 }
 }   // namespace libfive
@@ -428,7 +428,7 @@ void SimplexMesher::load(const std::array<const SimplexTree<3>*, 4>& ts)
                 }
 
                 // Save the resulting triangle
-                m.branes.push_back(tri_vert_indices);
+                m.pushBrane(tri_vert_indices);
             }
         }
     }
@@ -448,6 +448,7 @@ uint64_t SimplexMesher::searchEdge(Eigen::Vector3d inside,
     constexpr int POINTS_PER_SEARCH = 16;
     static_assert(POINTS_PER_SEARCH <= ArrayEvaluator::N,
                   "Overflowing ArrayEvaluator data array");
+    assert(POINTS_PER_SEARCH <= eval->width());
 
     // Multi-stage binary search for intersection
     for (int s=0; s < SEARCH_COUNT; ++s)
@@ -16,16 +16,17 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <Eigen/StdVector>
 #include <boost/lockfree/queue.hpp>
-#include <boost/lockfree/stack.hpp>
 
 #include "libfive/render/brep/simplex/simplex_tree.hpp"
 #include "libfive/render/brep/simplex/simplex_neighbors.hpp"
 
 #include "libfive/render/brep/region.hpp"
 #include "libfive/render/brep/settings.hpp"
+#include "libfive/render/brep/task_queue.hpp"
 #include "libfive/render/brep/neighbor_tables.hpp"
 
 #include "libfive/render/axes.hpp"
+#include "libfive/render/thread_pool.hpp"
 #include "libfive/eval/tape.hpp"
 
 #include "../xtree.inl"
@@ -222,11 +223,18 @@ Tape::Handle SimplexTree<N>::evalInterval(Evaluator* eval,
 {
     // Do a preliminary evaluation to prune the tree, storing the interval
     // result and an handle to the pushed tape (which we'll use when recursing)
-    auto o = eval->intervalAndPush(
+    return evalInterval(eval, tape, object_pool,
+        eval->intervalAndPush(
             this->region.lower3().template cast<float>(),
             this->region.upper3().template cast<float>(),
-            tape);
+            tape));
+}
 
+template <unsigned N>
+Tape::Handle SimplexTree<N>::evalInterval(
+        Evaluator* eval, const Tape::Handle& tape, Pool& object_pool,
+        std::pair<Interval, Tape::Handle> o)
+{
     this->type = o.first.state();
     if (!o.first.isSafe())
     {
@@ -288,8 +296,9 @@ void SimplexTree<N>::findLeafVertices(
 #endif
     constexpr unsigned SAMPLES_PER_EDGE = 2 + LIBFIVE_SIMPLEX_SUBSAMPLE;
     static_assert(SAMPLES_PER_EDGE >= 2, "Too few samples per edge");
-    static_assert(ipow(SAMPLES_PER_EDGE, N) < LIBFIVE_EVAL_ARRAY_SIZE,
+    static_assert(ipow(SAMPLES_PER_EDGE, N) < ArrayEvaluator::N,
                   "Too many points to evaluate");
+    assert(ipow(SAMPLES_PER_EDGE, N) < eval->width());
 
     // Track how many grid points have to be evaluated here
     // (if they have been be looked up from a neighbor, they don't have
@@ -687,33 +696,21 @@ struct AssignIndexTask {
 };
 
 template <unsigned N>
-using LockFreeStack = boost::lockfree::stack<
-        AssignIndexTask<N>,
-        boost::lockfree::fixed_sized<true>>;
-
-template <unsigned N>
-void assignIndicesWorker(LockFreeStack<N>& tasks,
+void assignIndicesWorker(TaskQueue<AssignIndexTask<N>>& tasks,
+                         unsigned worker,
                          std::atomic<uint64_t>& index,
                          std::atomic_bool& done,
                          std::atomic_bool& cancel)
 {
     // See detailed comments in worker_pool.cpp, which
     // implements a similar worker pool system.
-    std::stack<AssignIndexTask<N>, std::vector<AssignIndexTask<N>>> local;
-
     while (!done.load() && !cancel.load()) {
-        // Pick a task from the local empty, falling back to the MPMC
-        // stack if the local stack is empty.  If both are empty, then
-        // spin here until another thread adds a task to the global stack.
+        // Pick a task from our own deque, stealing from other threads
+        // if it is empty.  If there's nothing to steal, then sleep here
+        // until another thread pushes a task.
         AssignIndexTask<N> task;
-        if (local.size()) {
-            task = local.top();
-            local.pop();
-        } else if (!tasks.pop(task)) {
-            task.target = nullptr;
-        }
-
-        if (task.target == nullptr) {
+        if (!tasks.pop(worker, task)) {
+            tasks.park();
             continue;
         }
 
@@ -728,9 +725,7 @@ void assignIndicesWorker(LockFreeStack<N>& tasks,
                 next_task.neighbors->ns = task.neighbors->ns.push(i, task.target->children);
                 next_task.neighbors->parent = task.neighbors;
 
-                if (!tasks.bounded_push(next_task)) {
-                    local.push(next_task);
-                }
+                tasks.push(worker, next_task);
             }
             continue;
         }
@@ -848,6 +843,7 @@ void assignIndicesWorker(LockFreeStack<N>& tasks,
     }
 
     done.store(true);
+    tasks.halt();
 }
 
 template <unsigned N>
@@ -855,9 +851,9 @@ void SimplexTree<N>::assignIndices(const BRepSettings& settings) const
 {
     this->resetPending();
 
-    LockFreeStack<N> tasks(settings.workers);
+    TaskQueue<AssignIndexTask<N>> tasks(settings.workers);
     AssignIndexTask<N> first{this, std::make_shared<NeighborStack<N>>()};
-    tasks.push(first);
+    tasks.push(0, first);
 
     std::atomic<uint64_t> global_index(1);
     std::atomic_bool done(false);
@@ -865,9 +861,10 @@ void SimplexTree<N>::assignIndices(const BRepSettings& settings) const
     std::vector<std::future<void>> futures;
     futures.resize(settings.workers);
     for (unsigned i=0; i < settings.workers; ++i) {
-        futures[i] = std::async(std::launch::async,
-            [&done, &settings, &tasks, &global_index]() {
-                assignIndicesWorker(tasks, global_index, done, settings.cancel);
+        futures[i] = ThreadPool::run(settings.pool,
+            [&done, &settings, &tasks, &global_index, i]() {
+                assignIndicesWorker(tasks, i, global_index, done,
+                                    settings.cancel);
             });
     }
 
@@ -37,15 +37,21 @@ std::unique_ptr<VolTree> VolTree::empty()
 
 Tape::Handle VolTree::evalInterval(Evaluator* eval,
                                    const Tape::Handle& tape,
-                                   Pool&)
+                                   Pool& object_pool)
 {
     // Do a preliminary evaluation to prune the tree, storing the interval
     // result and an handle to the pushed tape (which we'll use when recursing)
-    auto o = eval->intervalAndPush(
+    return evalInterval(eval, tape, object_pool,
+        eval->intervalAndPush(
             this->region.lower3().template cast<float>(),
             this->region.upper3().template cast<float>(),
-            tape);
+            tape));
+}
 
+Tape::Handle VolTree::evalInterval(
+        Evaluator* eval, const Tape::Handle& tape, Pool&,
+        std::pair<Interval, Tape::Handle> o)
+{
     this->type = o.first.state();
     if (!o.first.isSafe())
     {
@@ -12,6 +12,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "libfive/render/brep/settings.hpp"
 #include "libfive/render/brep/worker_pool.hpp"
 #include "libfive/render/brep/vol/vol_tree.hpp"
+#include "libfive/render/thread_pool.hpp"
 #include "libfive/eval/evaluator.hpp"
 
 namespace libfive {
@@ -25,8 +26,13 @@ Root<T> WorkerPool<T, Neighbors, N>::build(
     const auto t = t_.optimized();
     std::vector<Evaluator, Eigen::aligned_allocator<Evaluator>> es;
     es.reserve(settings.workers);
+
+    // Flatten the tree once, then share the result between evaluators
+    const auto deck = std::make_shared<const Deck::Shared>(t);
     for (unsigned i=0; i < settings.workers; ++i) {
-        es.emplace_back(Evaluator(t));
+        es.emplace_back(Evaluator(std::make_shared<Deck>(deck),
+                                  std::map<Tree::Id, float>(),
+                                  settings.eval_width));
     }
     return build(es.data(), region_, settings);
 }
@@ -40,11 +46,17 @@ Root<T> WorkerPool<T, Neighbors, N>::build(
         std::cerr << "WorkerPool::build: Invalid region for vol tree\n";
     }
 
-    const auto region = region_.withResolution(settings.min_feature);
+    // If the region already has a level (e.g. because it's a cell from an
+    // existing tree that is being rebuilt), then keep it, so that the new
+    // tree's cells line up exactly with the old tree's cells.
+    const auto region = (region_.level >= 0)
+        ? region_
+        : region_.withResolution(settings.min_feature);
     auto root(new T(nullptr, 0, region));
 
-    LockFreeStack tasks(settings.workers);
-    tasks.push({root, eval->getDeck()->tape, Neighbors(), settings.vol});
+    TaskQueue<Task> tasks(settings.workers);
+    tasks.push(0, {root, eval->getDeck()->tape, Neighbors(), settings.vol,
+                   Interval(), nullptr});
 
     std::vector<std::future<void>> futures;
     futures.resize(settings.workers);
@@ -65,9 +77,9 @@ Root<T> WorkerPool<T, Neighbors, N>::build(
     std::atomic_bool done(false);
     for (unsigned i=0; i < settings.workers; ++i)
     {
-        futures[i] = std::async(std::launch::async,
+        futures[i] = ThreadPool::run(settings.pool,
                 [&eval, &tasks, &out, &root_lock, &settings, &done, i](){
-                    run(eval + i, tasks, out, root_lock, settings, done);
+                    run(eval + i, tasks, i, out, root_lock, settings, done);
                 });
     }
 
@@ -91,40 +103,29 @@ Root<T> WorkerPool<T, Neighbors, N>::build(
 
 template <typename T, typename Neighbors, unsigned N>
 void WorkerPool<T, Neighbors, N>::run(
-        Evaluator* eval, LockFreeStack& tasks,
+        Evaluator* eval, TaskQueue<Task>& tasks, unsigned index,
         Root<T>& root, std::mutex& root_lock,
         const BRepSettings& settings,
         std::atomic_bool& done)
 {
-    // Tasks to be evaluated by this thread (populated when the
-    // MPMC stack is completely full).
-    std::stack<Task, std::vector<Task>> local;
-
     typename T::Pool object_pool;
 
     while (!done.load() && !settings.cancel.load())
     {
-        // Prioritize picking up a local task before going to
-        // the MPMC queue, to keep things in this thread for
-        // as long as possible.
+        // Pick up a task from this thread's own deque (to keep working
+        // on the same subtree for as long as possible), stealing from
+        // other threads if it's empty.
         Task task;
-        if (local.size())
-        {
-            task = local.top();
-            local.pop();
-        }
-        else if (!tasks.pop(task))
-        {
-            task.target = nullptr;
-        }
 
-        // If we failed to get a task, keep looping
-        // (so that we terminate when either of the flags are set).
-        if (task.target == nullptr)
+        // If we failed to get a task, then sleep until one shows up
+        // and keep looping (so that we terminate when either of the
+        // flags are set).
+        if (!tasks.pop(index, task))
         {
             if (settings.free_thread_handler != nullptr) {
                 settings.free_thread_handler->offerWait();
             }
+            tasks.park();
             continue;
         }
 
@@ -143,6 +144,11 @@ void WorkerPool<T, Neighbors, N>::run(
         // If this tree is larger than the minimum size, then it will either
         // be unambiguously filled/empty, or we'll need to recurse.
         const bool can_subdivide = t->region.level > 0;
+
+        // Set if this tree's children were evaluated as a batch of leaves,
+        // in which case we skip straight to collecting them.
+        bool batched = false;
+
         if (can_subdivide)
         {
             Tape::Handle next_tape;
@@ -153,41 +159,122 @@ void WorkerPool<T, Neighbors, N>::run(
                 }
             }
             if (t->type == Interval::UNKNOWN) {
-                next_tape = t->evalInterval(eval, task.tape, object_pool);
+                if (task.interval_tape) {
+                    next_tape = t->evalInterval(eval, task.tape, object_pool,
+                          {task.interval, task.interval_tape});
+                } else if (settings.affine) {
+                    next_tape = t->evalInterval(eval, task.tape, object_pool,
+                          eval->affineAndPush(
+                              t->region.lower3().template cast<float>(),
+                              t->region.upper3().template cast<float>(),
+                              task.tape));
+                } else {
+                    next_tape = t->evalInterval(eval, task.tape, object_pool);
+                }
             }
             if (next_tape != nullptr) {
                 tape = next_tape;
             }
 
-            // If this Tree is ambiguous, then push the children to the stack
+            // If this Tree is ambiguous, then push the children to the queue
             // and keep going (because all the useful work will be done
             // by collectChildren eventually).
             assert(t->type != Interval::UNKNOWN);
             if (t->type == Interval::AMBIGUOUS)
             {
                 auto rs = t->region.subdivide();
-                for (unsigned i=0; i < t->children.size(); ++i)
+
+                // If the children are leaf cells and the tree type supports
+                // it, then evaluate all of them right here as one batch
+                // (which makes better use of the evaluator than doing so
+                // one cell at a time).
+                if constexpr (T::hasLeafBatching())
                 {
-                    // If there are available slots, then pass this work
-                    // to the queue; otherwise, undo the decrement and
-                    // assign it to be evaluated locally.
-                    auto next_tree = object_pool.get(t, i, rs[i]);
-                    auto next_vol = task.vol ? task.vol->push(i, rs[i].perp)
-                                             : nullptr;
-                    Task next{next_tree, tape, neighbors, next_vol};
-                    if (!tasks.bounded_push(next))
+                    if (t->region.level == 1 && settings.leaf_batching)
                     {
-                        local.push(next);
+                        std::array<T*, 1 << N> leaves;
+                        std::array<Neighbors, 1 << N> leaf_neighbors;
+                        for (unsigned i=0; i < t->children.size(); ++i)
+                        {
+                            leaves[i] = object_pool.get(t, i, rs[i]);
+                            leaf_neighbors[i] = neighbors.push(i, t->children);
+                        }
+                        T::evalLeaves(eval, tape, object_pool, leaves.data(),
+                                      leaf_neighbors.data(), leaves.size());
+                        if (settings.progress_handler)
+                        {
+                            settings.progress_handler->tick(leaves.size());
+                        }
+
+                        // collectChildren must be called once per child;
+                        // the final call happens below, as if the last
+                        // leaf had just finished.
+                        for (unsigned i=1; i < leaves.size(); ++i)
+                        {
+                            const bool ready = t->collectChildren(
+                                    eval, tape, object_pool, settings.max_err);
+                            assert(!ready);
+                            (void)ready;
+                        }
+                        batched = true;
                     }
                 }
 
-                // If we did an interval evaluation, then we either
-                // (a) are done with this tree because it is empty / filled
-                // (b) don't do anything until all of its children are done
-                //
-                // In both cases, we should keep looping; the latter case
-                // is handled in collectChildren below.
-                continue;
+                if (!batched)
+                {
+                    // If the children will also be subdivided, then evaluate
+                    // all of their intervals in a single tape walk here,
+                    // rather than one walk per child.  We skip this when a
+                    // VolTree is present, since it may make the interval
+                    // evaluation unnecessary.
+                    std::vector<std::pair<Interval, Tape::Handle>> batch;
+                    if (t->region.level > 1 && !task.vol)
+                    {
+                        std::vector<Eigen::Vector3f> lower, upper;
+                        for (const auto& r : rs)
+                        {
+                            lower.push_back(r.lower3().template cast<float>());
+                            upper.push_back(r.upper3().template cast<float>());
+                        }
+                        batch = eval->intervalAndPushBatch(lower, upper, tape);
+                    }
+
+                    for (unsigned i=0; i < t->children.size(); ++i)
+                    {
+                        // Push this work onto our own deque, where it's
+                        // available to be stolen by idle threads.
+                        auto next_tree = object_pool.get(t, i, rs[i]);
+                        auto next_vol = task.vol ? task.vol->push(i, rs[i].perp)
+                                                 : nullptr;
+                        Task next{next_tree, tape, neighbors, next_vol,
+                                  Interval(), nullptr};
+                        // With affine arithmetic, children that the
+                        // batch couldn't classify are evaluated again
+                        // individually (which may prove them unambiguous).
+                        if (batch.size() && settings.affine &&
+                            batch[i].first.state() == Interval::AMBIGUOUS)
+                        {
+                            if (batch[i].second != tape) {
+                                eval->getDeck()->claim(
+                                        std::move(batch[i].second));
+                            }
+                        }
+                        else if (batch.size())
+                        {
+                            next.interval = batch[i].first;
+                            next.interval_tape = batch[i].second;
+                        }
+                        tasks.push(index, next);
+                    }
+
+                    // If we did an interval evaluation, then we either
+                    // (a) are done with this tree because it is empty / filled
+                    // (b) don't do anything until all of its children are done
+                    //
+                    // In both cases, we should keep looping; the latter case
+                    // is handled in collectChildren below.
+                    continue;
+                }
             }
         }
         else
@@ -195,7 +282,7 @@ void WorkerPool<T, Neighbors, N>::run(
             t->evalLeaf(eval, tape, object_pool, neighbors);
         }
 
-        if (settings.progress_handler)
+        if (settings.progress_handler && !batched)
         {
             if (can_subdivide)
             {
@@ -223,7 +310,9 @@ void WorkerPool<T, Neighbors, N>::run(
                 tape = tape->getBase(t->region.region3());
             }
         };
-        up();
+        if (!batched) {
+            up();
+        }
         while (t != nullptr && t->collectChildren(eval, tape,
                                                   object_pool,
                                                   settings.max_err))
@@ -245,8 +334,10 @@ void WorkerPool<T, Neighbors, N>::run(
     }
 
     // If we've broken out of the loop, then we should set the done flag
-    // so that other worker threads also terminate.
+    // (and wake up any sleeping threads) so that other worker threads
+    // also terminate.
     done.store(true);
+    tasks.halt();
 
     {   // Release the pooled objects to the root
         std::lock_guard<std::mutex> lock(root_lock);
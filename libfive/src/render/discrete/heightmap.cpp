@@ -17,6 +17,7 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include <png.h>
 
 #include "libfive/render/discrete/heightmap.hpp"
+#include "libfive/render/thread_pool.hpp"
 #include "libfive/eval/tape.hpp"
 
 namespace libfive {
@@ -30,7 +31,8 @@ struct NormalRenderer
 {
     NormalRenderer(Evaluator* e, const Tape::Handle& tape,
                    const Voxels::View& r, Heightmap::Normal& norm)
-        : e(e), tape(tape), r(r), norm(norm) {}
+        : e(e), tape(tape), r(r), norm(norm),
+          xs(e->width()), ys(e->width()) {}
 
     /*
      *  Assert on destruction that the normals were flushed
@@ -75,7 +77,7 @@ struct NormalRenderer
 
         // If the gradient array is completely full, execute a
         // calculation that finds normals and blits them to the image
-        if (count == NUM_POINTS)
+        if (count == xs.size())
         {
             run();
         }
@@ -87,9 +89,9 @@ struct NormalRenderer
     Heightmap::Normal& norm;
 
     // Store the x, y coordinates of rendered points for normal calculations
-    static constexpr size_t NUM_POINTS = ArrayEvaluator::N;
-    size_t xs[NUM_POINTS];
-    size_t ys[NUM_POINTS];
+    // (one per point in the evaluator)
+    std::vector<size_t> xs;
+    std::vector<size_t> ys;
     size_t count = 0;
 };
 
@@ -212,7 +214,7 @@ bool Heightmap::recurse(Evaluator* e, const Tape::Handle& tape,
     }
 
     // If we're below a certain size, render pixel-by-pixel
-    if (r.voxels() <= ArrayEvaluator::N)
+    if (r.voxels() <= e->width())
     {
         pixels(e, tape, r);
         return true;
@@ -255,16 +257,20 @@ Heightmap::Heightmap(unsigned rows, unsigned cols)
 
 std::unique_ptr<Heightmap> Heightmap::render(
     const Tree& t_, Voxels r, const std::atomic_bool& abort,
-    size_t workers)
+    size_t workers, ThreadPool* pool)
 {
     std::vector<Evaluator*> es;
     const auto t = t_.optimized();
+
+    // Flatten the tree once, then share the result between evaluators
+    const auto deck = std::make_shared<const Deck::Shared>(t);
     for (size_t i=0; i < workers; ++i)
     {
-        es.push_back(new Evaluator(t));
+        es.push_back(new Evaluator(std::make_shared<Deck>(deck),
+                                   std::map<Tree::Id, float>(), EVAL_WIDTH));
     }
 
-    auto out = render(es, r, abort);
+    auto out = render(es, r, abort, pool);
 
     for (auto e : es)
     {
@@ -275,7 +281,7 @@ std::unique_ptr<Heightmap> Heightmap::render(
 
 std::unique_ptr<Heightmap> Heightmap::render(
         const std::vector<Evaluator*>& es, Voxels r,
-        const std::atomic_bool& abort)
+        const std::atomic_bool& abort, ThreadPool* pool)
 {
     auto out = new Heightmap(r.pts[1].size(), r.pts[0].size());
 
@@ -298,7 +304,7 @@ std::unique_ptr<Heightmap> Heightmap::render(
     auto itr = es.begin();
     for (auto region : rs)
     {
-        futures.push_back(std::async(std::launch::async,
+        futures.push_back(ThreadPool::run(pool,
             [itr, region, &out, &abort](){
                 out->recurse(*itr, (*itr)->getDeck()->tape, region, abort);
             }));
@@ -0,0 +1,88 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+Copyright (C) 2019  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "libfive/render/thread_pool.hpp"
+
+namespace libfive {
+
+ThreadPool::ThreadPool(unsigned count)
+    : done(false)
+{
+    if (count == 0)
+    {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    threads.reserve(count);
+    for (unsigned i=0; i < count; ++i)
+    {
+        threads.emplace_back([this]() { work(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        done = true;
+    }
+    cv.notify_all();
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+std::future<void> ThreadPool::run(std::function<void()> f)
+{
+    std::packaged_task<void()> job(std::move(f));
+    auto out = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        jobs.push(std::move(job));
+    }
+    cv.notify_one();
+    return out;
+}
+
+std::future<void> ThreadPool::run(ThreadPool* pool, std::function<void()> f)
+{
+    if (pool)
+    {
+        return pool->run(std::move(f));
+    }
+    else
+    {
+        return std::async(std::launch::async, std::move(f));
+    }
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::packaged_task<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mut);
+            cv.wait(lock, [this]() { return done || !jobs.empty(); });
+
+            // Drain the queue before exiting, so that every future
+            // that we've handed out is eventually made ready.
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+        job();
+    }
+}
+
+}   // namespace libfive
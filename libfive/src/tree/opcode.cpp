@@ -41,6 +41,14 @@ size_t Opcode::args(Opcode op)
         case OP_LOG:
         case OP_RECIP:
         case CONST_VAR:
+        case OP_ADD_IMM:
+        case OP_SUB_IMM:
+        case OP_RSUB_IMM:
+        case OP_MUL_IMM:
+        case OP_DIV_IMM:
+        case OP_RDIV_IMM:
+        case OP_MIN_IMM:
+        case OP_MAX_IMM:
             return 1;
 
         case OP_ADD: // fallthrough
@@ -55,6 +63,10 @@ size_t Opcode::args(Opcode op)
         case OP_MOD:
         case OP_NANFILL:
         case OP_COMPARE:
+        case OP_SUM_SQUARES:
+        case OP_ADD_SQUARE:
+        case OP_HYPOT:
+        case OP_SQRT_ADD_SQUARE:
             return 2;
 
         case INVALID: // fallthrough
@@ -64,6 +76,29 @@ size_t Opcode::args(Opcode op)
     return -1;
 }
 
+bool Opcode::hasImmediate(Opcode op)
+{
+    bool swap;
+    return withoutImmediate(op, swap) != INVALID;
+}
+
+Opcode::Opcode Opcode::withoutImmediate(Opcode op, bool& swap)
+{
+    swap = (op == OP_RSUB_IMM || op == OP_RDIV_IMM);
+    switch (op)
+    {
+        case OP_ADD_IMM:    return OP_ADD;
+        case OP_SUB_IMM:    // fallthrough
+        case OP_RSUB_IMM:   return OP_SUB;
+        case OP_MUL_IMM:    return OP_MUL;
+        case OP_DIV_IMM:    // fallthrough
+        case OP_RDIV_IMM:   return OP_DIV;
+        case OP_MIN_IMM:    return OP_MIN;
+        case OP_MAX_IMM:    return OP_MAX;
+        default:            return INVALID;
+    }
+}
+
 const static std::map<Opcode::Opcode, std::string> _opcode_names = {
 #define OPCODE(s, i) {Opcode::s, #s},
     OPCODES
@@ -174,7 +209,20 @@ std::string Opcode::toOpString(Opcode op)
         case INVALID: // fallthrough
         case CONSTANT:
         case ORACLE:
-        case LAST_OP: return "";
+        case LAST_OP:
+        case OP_ADD_IMM:
+        case OP_SUB_IMM:
+        case OP_RSUB_IMM:
+        case OP_MUL_IMM:
+        case OP_DIV_IMM:
+        case OP_RDIV_IMM:
+        case OP_MIN_IMM:
+        case OP_MAX_IMM:
+        case OP_SUM_SQUARES:
+        case OP_ADD_SQUARE:
+        case OP_HYPOT:
+        case OP_SQRT_ADD_SQUARE:
+            return "";
     }
     assert(false);
     return "";
@@ -214,6 +262,18 @@ bool Opcode::isCommutative(Opcode op)
         case OP_RECIP:
         case CONST_VAR:
         case LAST_OP:
+        case OP_ADD_IMM:
+        case OP_SUB_IMM:
+        case OP_RSUB_IMM:
+        case OP_MUL_IMM:
+        case OP_DIV_IMM:
+        case OP_RDIV_IMM:
+        case OP_MIN_IMM:
+        case OP_MAX_IMM:
+        case OP_SUM_SQUARES:
+        case OP_ADD_SQUARE:
+        case OP_HYPOT:
+        case OP_SQRT_ADD_SQUARE:
             return false;
 
         case OP_ADD: // fallthrough
@@ -262,6 +322,18 @@ bool Opcode::isIdempotent(Opcode op)
         case LAST_OP:
         case OP_ADD:
         case OP_MUL:
+        case OP_ADD_IMM:
+        case OP_SUB_IMM:
+        case OP_RSUB_IMM:
+        case OP_MUL_IMM:
+        case OP_DIV_IMM:
+        case OP_RDIV_IMM:
+        case OP_MIN_IMM:
+        case OP_MAX_IMM:
+        case OP_SUM_SQUARES:
+        case OP_ADD_SQUARE:
+        case OP_HYPOT:
+        case OP_SQRT_ADD_SQUARE:
             return false;
 
         case OP_MIN:
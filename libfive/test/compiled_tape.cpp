@@ -0,0 +1,194 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "catch.hpp"
+
+#include "libfive/tree/tree.hpp"
+#include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/eval_interval.hpp"
+#include "libfive/eval/compiled_tape.hpp"
+#include "libfive/eval/deck.hpp"
+#include "libfive/eval/tape.hpp"
+
+#include "util/shapes.hpp"
+
+using namespace libfive;
+
+static void compareBackends(const Tree& t)
+{
+    ArrayEvaluator a(t);
+    ArrayEvaluator b(t);
+    REQUIRE(b.setBackend(ArrayEvaluator::JIT));
+
+    // Use a count that isn't a multiple of the block size
+    const size_t count = ArrayEvaluator::N - 3;
+    for (unsigned i=0; i < count; ++i)
+    {
+        Eigen::Vector3f p = Eigen::Vector3f::Random() * 3;
+        a.set(p, i);
+        b.set(p, i);
+    }
+
+    auto va = a.values(count).eval();
+    auto vb = b.values(count).eval();
+    for (unsigned i=0; i < count; ++i)
+    {
+        CAPTURE(i);
+        // Eigen's vectorized sqrt may use an approximate reciprocal,
+        // so we can't expect bit-exact results here.
+        REQUIRE(vb(i) == Approx(va(i)).margin(1e-4));
+    }
+}
+
+TEST_CASE("CompiledTape: segments")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto t = min(x * 2 + y, sqrt(x * x + y * y) - 1);
+    auto d = std::make_shared<Deck>(t);
+
+    CompiledTape c(*d->tape, ArrayEvaluator::N);
+    REQUIRE(c.stride() == ArrayEvaluator::N);
+
+    size_t total = 0;
+    for (auto& s : c.segments())
+    {
+        REQUIRE(s.begin == total);
+        REQUIRE(s.end > s.begin);
+        total = s.end;
+    }
+    REQUIRE(total == d->tape->size());
+
+    if (CompiledTape::available())
+    {
+        REQUIRE(c.compiledCount() == d->tape->size());
+    }
+    else
+    {
+        REQUIRE(c.compiledCount() == 0);
+    }
+}
+
+TEST_CASE("CompiledTape: matches interpreter")
+{
+    if (!CompiledTape::available())
+    {
+        ArrayEvaluator e(Tree::X());
+        REQUIRE(!e.setBackend(ArrayEvaluator::JIT));
+        REQUIRE(e.getBackend() == ArrayEvaluator::INTERPRETER);
+        return;
+    }
+
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    SECTION("Arithmetic")
+    {
+        compareBackends((x + 2) * (y - 3) / (z + 10) - x * y);
+    }
+
+    SECTION("Unary")
+    {
+        compareBackends(abs(x) + square(y) - sqrt(abs(z)) + -x);
+    }
+
+    SECTION("Min / max")
+    {
+        compareBackends(max(min(x, y), min(z, x * y)));
+    }
+
+    SECTION("Sphere")
+    {
+        compareBackends(sphere(1));
+    }
+
+    SECTION("Box")
+    {
+        compareBackends(box({-1, -1, -1}, {1, 1, 1}));
+    }
+
+    SECTION("Menger sponge")
+    {
+        compareBackends(menger(2));
+    }
+
+    SECTION("Mixed with interpreted clauses")
+    {
+        compareBackends(sphereGyroid());
+    }
+}
+
+TEST_CASE("CompiledTape: pushed tapes")
+{
+    if (!CompiledTape::available())
+    {
+        return;
+    }
+
+    auto t = min(Tree::X(), Tree::Y() + 1);
+    ArrayEvaluator e(t);
+    REQUIRE(e.setBackend(ArrayEvaluator::JIT));
+
+    e.set({-3, 0, 0}, 0);
+    e.set({5, 0, 0}, 1);
+    REQUIRE(e.values(2)(0) == Approx(-3));
+    REQUIRE(e.values(2)(1) == Approx(1));
+
+    // Only the X branch is active in this region
+    auto d = std::make_shared<Deck>(t);
+    IntervalEvaluator i(d);
+    auto tape = i.intervalAndPush({-10, 0, 0}, {-5, 1, 0}).second;
+    REQUIRE(tape->size() < d->tape->size());
+
+    ArrayEvaluator p(d);
+    REQUIRE(p.setBackend(ArrayEvaluator::JIT));
+    p.set({-7, 0, 0}, 0);
+    REQUIRE(p.values(1, *tape)(0) == Approx(-7));
+}
+
+TEST_CASE("CompiledTape: performance", "[!benchmark]")
+{
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"sphere", sphere(1)},
+        {"box", box({-1, -1, -1}, {1, 1, 1})},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    for (auto& s : shapes)
+    {
+        ArrayEvaluator interp(s.second);
+        ArrayEvaluator jit(s.second);
+        jit.setBackend(ArrayEvaluator::JIT);
+
+        for (unsigned i=0; i < ArrayEvaluator::N; ++i)
+        {
+            Eigen::Vector3f p = Eigen::Vector3f::Random();
+            interp.set(p, i);
+            jit.set(p, i);
+        }
+
+        float sum = 0;
+        BENCHMARK(s.first + " (interpreter)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                sum += interp.values(ArrayEvaluator::N)(0);
+            }
+        }
+        BENCHMARK(s.first + " (JIT)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                sum += jit.values(ArrayEvaluator::N)(0);
+            }
+        }
+        CAPTURE(sum);
+    }
+}
@@ -13,6 +13,12 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "libfive/tree/tree.hpp"
 #include "libfive/eval/deck.hpp"
+#include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/eval_interval.hpp"
+#include "libfive/eval/eval_deriv_array.hpp"
+#include "libfive/eval/eval_feature.hpp"
+#include "libfive/eval/evaluator.hpp"
+#include "libfive/eval/tape.hpp"
 
 using namespace libfive;
 
@@ -39,3 +45,249 @@ TEST_CASE("Deck::constants")
     CAPTURE(t.constants.begin()->second);
     REQUIRE(t.constants[0] == std::make_pair<Clause::Id, float>(2, 5.0f));
 }
+
+TEST_CASE("Deck::num_slots")
+{
+    SECTION("Long chain")
+    {
+        auto t = Tree::X();
+        for (unsigned i=0; i < 100; ++i) {
+            t = sin(t);
+        }
+        Deck d(t);
+        REQUIRE(d.num_clauses == 103);
+        REQUIRE(d.num_slots == 5); // Two for the chain, plus X, Y, Z
+    }
+
+    SECTION("Min and max arguments are kept alive")
+    {
+        Deck d(min(sin(Tree::X()), cos(Tree::Y())));
+        REQUIRE(d.num_clauses == 6);
+        REQUIRE(d.num_slots == 6);
+    }
+}
+
+TEST_CASE("Deck::Shared")
+{
+    auto shared = std::make_shared<const Deck::Shared>(
+            min(Tree::X() + 2, Tree::Y()));
+    auto a = std::make_shared<Deck>(shared);
+    auto b = std::make_shared<Deck>(shared);
+
+    REQUIRE(a->tape == b->tape);
+    REQUIRE(&a->constants == &b->constants);
+    REQUIRE(a->X == b->X);
+
+    ArrayEvaluator ea(a);
+    ArrayEvaluator eb(b);
+    REQUIRE(ea.value({1, 5, 0}) == 3);
+    REQUIRE(eb.value({4, 3, 0}) == 3);
+
+    // Pushing uses per-Deck storage, but leaves the shared tape alone
+    auto pa = ea.valueAndPush({1, 5, 0});
+    auto pb = eb.valueAndPush({4, 3, 0});
+    REQUIRE(pa.second != a->tape);
+    REQUIRE(pb.second != b->tape);
+    REQUIRE(pa.second->size() < a->tape->size());
+    REQUIRE(ea.value({1, 5, 0}, *pa.second) == 3);
+    REQUIRE(eb.value({4, 3, 0}, *pb.second) == 3);
+    REQUIRE(ea.value({1, 5, 0}) == 3);
+}
+
+TEST_CASE("Deck::cacheStats")
+{
+    auto d = std::make_shared<Deck>(max(Tree::X(), Tree::Y()));
+    IntervalEvaluator e(d);
+
+    auto a = e.intervalAndPush({1, -2, 0}, {2, -1, 0});
+    REQUIRE(a.second->size() < d->tape->size());
+    REQUIRE(d->cacheStats().hits == 0);
+    REQUIRE(d->cacheStats().misses == 1);
+
+    // A different cell which makes the same choice shares the tape
+    auto b = e.intervalAndPush({3, -4, 0}, {4, -3, 0});
+    REQUIRE(b.second == a.second);
+    REQUIRE(d->cacheStats().hits == 1);
+    REQUIRE(d->cacheStats().misses == 1);
+
+    // Making the other choice builds a new tape
+    auto c = e.intervalAndPush({-2, 1, 0}, {-1, 2, 0});
+    REQUIRE(c.second != a.second);
+    REQUIRE(d->cacheStats().hits == 1);
+    REQUIRE(d->cacheStats().misses == 2);
+
+    // Cached tapes are still in use, so they aren't recycled
+    d->claim(std::move(b.second));
+    auto f = e.intervalAndPush({5, -6, 0}, {6, -5, 0});
+    REQUIRE(f.second == a.second);
+    auto i = e.eval({5, -6, 0}, {6, -5, 0}, f.second);
+    REQUIRE(i.lower() == 5);
+    REQUIRE(i.upper() == 6);
+}
+
+TEST_CASE("Deck: lowered tapes")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    SECTION("Immediates")
+    {
+        // x * 2 + 1, 3 - x, and x / 4 are one clause each
+        auto d = std::make_shared<Deck>((x * 2 + 1) * (3 - y) + z / 4);
+        REQUIRE(d->tape->size() == 6);
+
+        ArrayEvaluator e(d);
+        REQUIRE(e.value({1, 2, 8}) == Approx(5));
+
+        DerivArrayEvaluator de(d);
+        auto ds = de.deriv({1, 2, 8});
+        REQUIRE(ds.x() == Approx(2));
+        REQUIRE(ds.y() == Approx(-3));
+        REQUIRE(ds.z() == Approx(0.25));
+        REQUIRE(ds.w() == Approx(5));
+
+        IntervalEvaluator ie(d);
+        auto i = ie.eval({1, 2, 8}, {2, 2, 8});
+        REQUIRE(i.lower() == Approx(5));
+        REQUIRE(i.upper() == Approx(7));
+    }
+
+    SECTION("Sums of squares")
+    {
+        // Sphere is one fused sum of squares, a fused square root of sum,
+        // and a subtraction with an immediate
+        auto d = std::make_shared<Deck>(
+                sqrt(square(x) + square(y) + square(z)) - 1);
+        REQUIRE(d->tape->size() == 3);
+
+        ArrayEvaluator e(d);
+        REQUIRE(e.value({2, 3, 6}) == Approx(6));
+
+        DerivArrayEvaluator de(d);
+        auto ds = de.deriv({2, 3, 6});
+        REQUIRE(ds.x() == Approx(2 / 7.0));
+        REQUIRE(ds.y() == Approx(3 / 7.0));
+        REQUIRE(ds.z() == Approx(6 / 7.0));
+
+        IntervalEvaluator ie(d);
+        auto i = ie.eval({2, 3, 6}, {2, 3, 6});
+        REQUIRE(i.lower() == Approx(6));
+        REQUIRE(i.upper() == Approx(6));
+    }
+
+    SECTION("Squares with other users aren't fused")
+    {
+        auto s = square(x);
+        auto d = std::make_shared<Deck>((s + square(y)) * s);
+        REQUIRE(d->tape->size() == 3);
+
+        ArrayEvaluator e(d);
+        REQUIRE(e.value({2, 3, 0}) == Approx(52));
+    }
+
+    SECTION("Min and max with immediates")
+    {
+        auto d = std::make_shared<Deck>(max(min(x, 1), -1));
+        REQUIRE(d->tape->size() == 2);
+
+        ArrayEvaluator e(d);
+        REQUIRE(e.value({0.5, 0, 0}) == Approx(0.5));
+        REQUIRE(e.value({5, 0, 0}) == Approx(1));
+        REQUIRE(e.value({-5, 0, 0}) == Approx(-1));
+
+        // Pushing can still pick the constant branch
+        IntervalEvaluator ie(d);
+        auto p = ie.intervalAndPush({2, 0, 0}, {3, 0, 0});
+        REQUIRE(p.first.lower() == 1);
+        REQUIRE(p.first.upper() == 1);
+        REQUIRE(p.second->size() == 0);
+        REQUIRE(ie.eval({2, 0, 0}, {3, 0, 0}, p.second).upper() == 1);
+
+        auto q = ie.intervalAndPush({0, 0, 0}, {0.5, 0, 0});
+        REQUIRE(q.second->size() == 0);
+        REQUIRE(q.second->root() == d->X);
+
+        // Feature evaluation treats immediates as constants
+        FeatureEvaluator fe(d);
+        REQUIRE(fe.features({1, 0, 0}).size() == 2);
+        REQUIRE(fe.features({5, 0, 0}).size() == 1);
+    }
+}
+
+TEST_CASE("Deck::invariant")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto a = Tree::var();
+    auto b = Tree::var();
+
+    // square(a) and sin(b) don't depend on X, Y, Z
+    auto t = max(x - square(a), y * sin(b));
+    std::map<Tree::Id, float> vars = {{a.id(), 2}, {b.id(), 0.5}};
+    auto d = std::make_shared<Deck>(t);
+    REQUIRE(d->invariant.size() == 2);
+    REQUIRE(d->tape->size() == 3);
+
+    SECTION("Values")
+    {
+        ArrayEvaluator e(d, vars);
+        REQUIRE(e.value({1, 2, 0}) == Approx(2 * sin(0.5)));
+        REQUIRE(e.value({5, 0, 0}) == Approx(1));
+
+        REQUIRE(e.setVar(a.id(), 1));
+        REQUIRE(e.value({5, 0, 0}) == Approx(4));
+
+        REQUIRE(e.updateVars({{a.id(), 0}, {b.id(), 1}}));
+        REQUIRE(!e.updateVars({{a.id(), 0}, {b.id(), 1}}));
+        REQUIRE(e.value({-5, 2, 0}) == Approx(2 * sin(1)));
+    }
+
+    SECTION("Intervals")
+    {
+        IntervalEvaluator e(d, vars);
+        auto i = e.eval({4, 0, 0}, {5, 0, 0});
+        REQUIRE(i.lower() == Approx(0));
+        REQUIRE(i.upper() == Approx(1));
+
+        REQUIRE(e.setVar(a.id(), Interval(1.0f, 2.0f)));
+        i = e.eval({4, 0, 0}, {5, 0, 0});
+        REQUIRE(i.lower() == Approx(0));
+        REQUIRE(i.upper() == Approx(4));
+
+        // Batches use the same invariant values
+        std::vector<Eigen::Vector3f> lower = {Eigen::Vector3f(4, 0, 0)};
+        std::vector<Eigen::Vector3f> upper = {Eigen::Vector3f(5, 0, 0)};
+        auto is = e.evalBatch(lower, upper);
+        REQUIRE(is[0].upper() == Approx(4));
+    }
+
+    SECTION("Derivatives")
+    {
+        DerivArrayEvaluator e(d, vars);
+        auto ds = e.deriv({1, 2, 0});
+        REQUIRE(ds.x() == Approx(0));
+        REQUIRE(ds.y() == Approx(sin(0.5)));
+        REQUIRE(ds.z() == Approx(0));
+
+        FeatureEvaluator f(d, vars);
+        REQUIRE(f.features({1, 2, 0}).size() == 1);
+    }
+
+    SECTION("Gradients with respect to variables")
+    {
+        Evaluator e(d, vars);
+        auto g = e.gradient({5, 0, 0});
+        REQUIRE(g.at(a.id()) == Approx(-4));
+        REQUIRE(g.at(b.id()) == Approx(0));
+
+        g = e.gradient({1, 2, 0});
+        REQUIRE(g.at(a.id()) == Approx(0));
+        REQUIRE(g.at(b.id()) == Approx(2 * cos(0.5)));
+
+        REQUIRE(e.updateVars({{a.id(), 3}}));
+        g = e.gradient({20, 0, 0});
+        REQUIRE(g.at(a.id()) == Approx(-6));
+        REQUIRE(e.eval({20, 0, 0}, {20, 0, 0}).upper() == Approx(11));
+    }
+}
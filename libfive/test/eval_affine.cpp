@@ -0,0 +1,228 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include "catch.hpp"
+
+#include "libfive/tree/tree.hpp"
+#include "libfive/eval/eval_affine.hpp"
+#include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/evaluator.hpp"
+#include "libfive/eval/deck.hpp"
+#include "libfive/eval/tape.hpp"
+#include "libfive/render/brep/settings.hpp"
+#include "libfive/render/brep/dc/dc_tree.hpp"
+#include "libfive/render/brep/dc/dc_worker_pool.hpp"
+#include "libfive/render/brep/mesh.hpp"
+
+#include "util/shapes.hpp"
+
+using namespace libfive;
+
+TEST_CASE("AffineEvaluator::evalAffine")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+
+    SECTION("Linear cancellation")
+    {
+        // Rotating by an angle and then back again gives x, but plain
+        // interval arithmetic loses track of that
+        auto u = 0.6 * x + 0.8 * y;
+        auto v = -0.8 * x + 0.6 * y;
+        AffineEvaluator e(0.6 * u - 0.8 * v);
+        auto i = e.eval({-1, -1, 0}, {1, 1, 0});
+        REQUIRE(i.lower() == Approx(-1.96));
+        REQUIRE(i.upper() == Approx(1.96));
+
+        auto a = e.evalAffine({-1, -1, 0}, {1, 1, 0});
+        REQUIRE(a.lower() == Approx(-1));
+        REQUIRE(a.upper() == Approx(1));
+        REQUIRE(a.lower() <= -1);
+        REQUIRE(a.upper() >= 1);
+    }
+
+    SECTION("Squares")
+    {
+        // Over [1, 3], x^2 - 4x is in [-4, -3]; the interval result is
+        // [-11, 5], and affine arithmetic should do much better.
+        AffineEvaluator e(square(x) - 4 * x);
+        auto a = e.evalAffine({1, 0, 0}, {3, 0, 0});
+        REQUIRE(a.lower() <= -4);
+        REQUIRE(a.upper() >= -3);
+        REQUIRE(a.upper() - a.lower() < 3);
+    }
+
+    SECTION("Rotated shapes")
+    {
+        // Count how many small boxes near a rotated square are classified
+        // as empty or filled with each kind of arithmetic
+        AffineEvaluator e(rotate2d(rectangle(-1, 1, -1, 1), 0.6f));
+        unsigned interval_count = 0;
+        unsigned affine_count = 0;
+        for (unsigned i=0; i < 1000; ++i)
+        {
+            Eigen::Vector3f lower = Eigen::Vector3f::Random() * 1.5;
+            lower.z() = 0;
+            Eigen::Vector3f upper = lower + Eigen::Vector3f(0.2, 0.2, 0);
+            auto r = e.eval(lower, upper);
+            auto a = e.evalAffine(lower, upper);
+            REQUIRE(!(a.lower() < r.lower()));
+            REQUIRE(!(a.upper() > r.upper()));
+            interval_count += (r.state() != Interval::AMBIGUOUS);
+            affine_count += (a.state() != Interval::AMBIGUOUS);
+        }
+        REQUIRE(affine_count > interval_count);
+    }
+}
+
+TEST_CASE("AffineEvaluator::affineAndPush")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"arithmetic", (x + 2) * (y - 3) - square(z) * x + abs(-y)},
+        {"division", x / y + (z - 1) / (x * 3) + 1 / (y + 0.5)},
+        {"sqrt", sqrt(x) + sqrt(y * z - 1) + sqrt(square(x) + square(z))},
+        {"min / max", max(min(x, y), min(z, x * y))},
+        {"transcendental", sin(x) * cos(y) + exp(z) / (1 + square(y)) +
+                           log(x + 4)},
+        {"rotated", rotate_x(rotate2d(box({-1, -1, -1}, {1, 1, 1}), 0.3f),
+                             0.5f)},
+        {"sphere", sphere(1)},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    // Random boxes, plus boxes with zero and infinite bounds
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<Eigen::Vector3f> lower = {
+        {0, 0, 0}, {-1, 0, -inf}, {0, -2, 0}, {-inf, -inf, -inf}, {1, 2, 3}};
+    std::vector<Eigen::Vector3f> upper = {
+        {0, 0, 0}, {0, 1, 0}, {inf, 0, 1}, {inf, inf, inf}, {1, 2, 3}};
+    for (unsigned i=0; i < 100; ++i)
+    {
+        Eigen::Vector3f a = Eigen::Vector3f::Random() * 3;
+        Eigen::Vector3f b = Eigen::Vector3f::Random() * 3;
+        lower.push_back(a.cwiseMin(b));
+        upper.push_back(a.cwiseMax(b));
+    }
+
+    for (auto& s : shapes)
+    {
+        CAPTURE(s.first);
+        auto deck = std::make_shared<Deck>(s.second);
+        AffineEvaluator e(deck);
+        ArrayEvaluator p(deck);
+
+        for (unsigned i=0; i < lower.size(); ++i)
+        {
+            CAPTURE(lower[i].transpose());
+            CAPTURE(upper[i].transpose());
+            auto r = e.intervalAndPush(lower[i], upper[i]);
+            auto a = e.affineAndPush(lower[i], upper[i]);
+            CAPTURE(r.first.lower());
+            CAPTURE(r.first.upper());
+            CAPTURE(a.first.lower());
+            CAPTURE(a.first.upper());
+
+            // Affine results are never looser than interval results,
+            // and must flag the same possible NaNs
+            REQUIRE(!(a.first.lower() < r.first.lower()));
+            REQUIRE(!(a.first.upper() > r.first.upper()));
+            REQUIRE(a.first.isSafe() == r.first.isSafe());
+            REQUIRE(a.second->size() <= r.second->size());
+
+            // Check that the bounds contain sample points in the box
+            // (with a little slop for rounding in the point evaluator)
+            if (!lower[i].array().isFinite().all() ||
+                !upper[i].array().isFinite().all())
+            {
+                continue;
+            }
+            for (unsigned j=0; j < 20; ++j)
+            {
+                const Eigen::Vector3f t =
+                    (Eigen::Vector3f::Random().array() + 1) / 2;
+                const Eigen::Vector3f pt = lower[i].array() +
+                    t.array() * (upper[i] - lower[i]).array();
+                const float v = p.value(pt);
+                if (std::isnan(v))
+                {
+                    continue;
+                }
+                CAPTURE(pt.transpose());
+                CAPTURE(v);
+                const float slop = 1e-4 * (1 + std::abs(v));
+                REQUIRE(v >= a.first.lower() - slop);
+                REQUIRE(v <= a.first.upper() + slop);
+            }
+        }
+    }
+}
+
+TEST_CASE("AffineEvaluator: octree construction")
+{
+    // A rotated polynomial torus has many boxes that are only ambiguous
+    // because of the dependency problem.  Affine classification shouldn't
+    // change the output, since cells whose children all have the same
+    // state are collapsed anyways.
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    auto torus = square(square(x) + square(y) + square(z) + 1 - 0.09) -
+                 4 * (square(x) + square(y));
+    auto shape = rotate_x(torus, 0.5f);
+    const Region<3> r({-2, -2, -2}, {2, 2, 2});
+
+    BRepSettings settings;
+    settings.min_feature = 0.1;
+    settings.workers = 1;
+    auto plain = Mesh::render(shape, r, settings);
+
+    settings.affine = true;
+    auto affine = Mesh::render(shape, r, settings);
+
+    REQUIRE(plain.get() != nullptr);
+    REQUIRE(affine.get() != nullptr);
+    REQUIRE(plain->branes.size() > 0);
+    REQUIRE(affine->branes.size() == plain->branes.size());
+    REQUIRE(affine->verts.size() == plain->verts.size());
+}
+
+TEST_CASE("AffineEvaluator: octree construction (performance)",
+          "[!benchmark]")
+{
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"rotated cylinder", rotate_x(cylinder(0.7, 2, {0, 0, -1}), 0.5f)},
+        {"polynomial torus", rotate_x(
+            square(square(Tree::X()) + square(Tree::Y()) + square(Tree::Z())
+                   + 1 - 0.09) - 4 * (square(Tree::X()) + square(Tree::Y())),
+            0.5f)},
+        {"sphere", sphere(1)},
+        {"sphereGyroid", sphereGyroid()}};
+    const Region<3> r({-2, -2, -2}, {2, 2, 2});
+
+    for (auto& s : shapes)
+    {
+        for (bool affine : {false, true})
+        {
+            BRepSettings settings;
+            settings.min_feature = 0.02;
+            settings.affine = affine;
+
+            int64_t count = 0;
+            BENCHMARK(s.first + (affine ? " (affine)" : " (interval)"))
+            {
+                count = DCWorkerPool<3>::build(s.second, r, settings).size();
+            }
+            CAPTURE(count);
+        }
+    }
+}
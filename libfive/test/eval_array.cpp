@@ -13,6 +13,9 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "libfive/tree/tree.hpp"
 #include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/eval_deriv_array.hpp"
+
+#include "util/shapes.hpp"
 
 using namespace libfive;
 
@@ -251,3 +254,80 @@ TEST_CASE("ArrayEvaluator::valueAndPush")
         REQUIRE(e.value({10, 5, 0}, *h.second) == 5);
     }
 }
+
+TEST_CASE("ArrayEvaluator: width")
+{
+    auto t = sphereGyroid();
+    auto d = std::make_shared<Deck>(t);
+    ArrayEvaluator ref(d);
+    REQUIRE(ref.width() == ArrayEvaluator::N);
+
+    for (size_t width : {1, 13, 1000})
+    {
+        CAPTURE(width);
+        DerivArrayEvaluator e(d, {}, width);
+        REQUIRE(e.width() == width);
+
+        std::vector<Eigen::Vector3f> pts;
+        for (unsigned i=0; i < width; ++i)
+        {
+            pts.push_back(Eigen::Vector3f::Random() * 3);
+            e.set(pts.back(), i);
+        }
+        auto vs = e.values(width).eval();
+        auto ds = e.derivs(width).eval();
+
+        for (unsigned i=0; i < width; ++i)
+        {
+            CAPTURE(i);
+            REQUIRE(vs(i) == Approx(ref.value(pts[i])));
+            REQUIRE(ds(3, i) == Approx(vs(i)));
+        }
+
+        if (e.setBackend(ArrayEvaluator::JIT))
+        {
+            auto js = e.values(width);
+            for (unsigned i=0; i < width; ++i)
+            {
+                REQUIRE(js(i) == Approx(vs(i)).margin(1e-4));
+            }
+        }
+    }
+}
+
+TEST_CASE("ArrayEvaluator: width (performance)", "[!benchmark]")
+{
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"sphere", sphere(1)},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    // Every width evaluates the same number of points, in as many
+    // passes as it takes.
+    const size_t total = 4096;
+    for (auto& s : shapes)
+    {
+        auto d = std::make_shared<Deck>(s.second);
+        for (size_t width : {8, 16, 64, 256, 1024, 4096})
+        {
+            ArrayEvaluator e(d, {}, width);
+            for (unsigned i=0; i < width; ++i)
+            {
+                e.set(Eigen::Vector3f::Random(), i);
+            }
+
+            float sum = 0;
+            BENCHMARK(s.first + " (width " + std::to_string(width) + ")")
+            {
+                for (unsigned i=0; i < 100; ++i)
+                {
+                    for (size_t j=0; j < total; j += width)
+                    {
+                        sum += e.values(width)(0);
+                    }
+                }
+            }
+            CAPTURE(sum);
+        }
+    }
+}
@@ -18,6 +18,8 @@ You can obtain one at http://mozilla.org/MPL/2.0/.
 #include "libfive/eval/tape.hpp"
 #include "libfive/render/brep/region.hpp"
 
+#include "util/shapes.hpp"
+
 using namespace libfive;
 
 TEST_CASE("IntervalEvaluator::eval")
@@ -108,6 +110,40 @@ TEST_CASE("IntervalEvaluator::intervalAndPush")
         REQUIRE(i.second->root() == d->X);
     }
 
+    SECTION("Repeated pushes")
+    {
+        // Pushing only resets the parts of the Deck's scratch arrays that
+        // were used by the previous push, so check that a sequence of
+        // pushes gives the same tapes as pushing with a fresh Deck.
+        Tree t = Tree::X() + 10;
+        for (int i=0; i < 8; ++i)
+        {
+            t = min(t, sphere(0.5, {float(i), 0, 0}));
+        }
+        auto deck = std::make_shared<Deck>(t);
+        IntervalEvaluator e(deck);
+        for (int k=0; k < 2; ++k)
+        {
+            for (int i=0; i < 8; ++i)
+            {
+                const Eigen::Vector3f lower(i - 0.1, -0.1, -0.1);
+                const Eigen::Vector3f upper(i + 0.1, 0.1, 0.1);
+                auto a = e.intervalAndPush(lower, upper);
+
+                IntervalEvaluator fresh(t);
+                auto b = fresh.intervalAndPush(lower, upper);
+                REQUIRE(a.second->size() == b.second->size());
+                REQUIRE(a.second->size() < deck->tape->size());
+
+                // Push again from the pushed tape, into a smaller box
+                auto c = e.intervalAndPush(lower / 2, upper / 2, a.second);
+                auto d = fresh.intervalAndPush(lower / 2, upper / 2,
+                                               b.second);
+                REQUIRE(c.second->size() == d.second->size());
+            }
+        }
+    }
+
     SECTION("With NaNs")
     {
         auto x = Tree::X();
@@ -237,3 +273,252 @@ TEST_CASE("IntervalEvaluator::eval(): NaN behavior")
         REQUIRE(!e.eval({1, -1, -1}, {2, 2, 2}).isSafe());
     }
 }
+
+TEST_CASE("IntervalEvaluator::evalBatch")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"arithmetic", (x + 2) * (y - 3) - square(z) * x + abs(-y)},
+        {"min / max", max(min(x, y), min(z, x * y))},
+        {"transcendental", sin(x) * cos(y) + exp(z) / (1 + square(y))},
+        {"sphere", sphere(1)},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    for (auto& s : shapes)
+    {
+        CAPTURE(s.first);
+        IntervalEvaluator e(s.second);
+
+        std::vector<Eigen::Vector3f> lower, upper;
+        for (unsigned i=0; i < 37; ++i)
+        {
+            Eigen::Vector3f a = Eigen::Vector3f::Random() * 3;
+            Eigen::Vector3f b = Eigen::Vector3f::Random() * 3;
+            lower.push_back(a.cwiseMin(b));
+            upper.push_back(a.cwiseMax(b));
+        }
+
+        auto out = e.evalBatch(lower, upper);
+        REQUIRE(out.size() == lower.size());
+        for (unsigned i=0; i < out.size(); ++i)
+        {
+            CAPTURE(i);
+            auto r = e.eval(lower[i], upper[i]);
+
+            // Batch results may be slightly wider, but must contain
+            // the single-interval result
+            REQUIRE(out[i].lower() <= r.lower());
+            REQUIRE(out[i].upper() >= r.upper());
+            REQUIRE(out[i].lower() == Approx(r.lower()).margin(1e-5));
+            REQUIRE(out[i].upper() == Approx(r.upper()).margin(1e-5));
+            REQUIRE(out[i].isSafe() == r.isSafe());
+        }
+    }
+}
+
+TEST_CASE("IntervalEvaluator::intervalAndPushBatch")
+{
+    auto t = std::make_shared<Deck>(min(Tree::X(), Tree::Y()) + 1);
+    IntervalEvaluator e(t);
+
+    std::vector<Eigen::Vector3f> lower = {
+        {-5, 0, 0}, {0, -5, 0}, {-1, -1, 0}};
+    std::vector<Eigen::Vector3f> upper = {
+        {-4, 1, 0}, {1, -4, 0}, {1, 1, 0}};
+
+    auto out = e.intervalAndPushBatch(lower, upper, t->tape);
+    REQUIRE(out.size() == 3);
+
+    REQUIRE(out[0].first.lower() == Approx(-4));
+    REQUIRE(out[0].first.upper() == Approx(-3));
+    REQUIRE(out[1].first.lower() == Approx(-4));
+    REQUIRE(out[1].first.upper() == Approx(-3));
+    REQUIRE(out[2].first.lower() == Approx(0).margin(1e-6));
+    REQUIRE(out[2].first.upper() == Approx(2));
+
+    // The first two boxes only need one branch of the min
+    REQUIRE(out[0].second->size() == 1);
+    REQUIRE(out[1].second->size() == 1);
+    REQUIRE(out[2].second == t->tape);
+
+    // Pushed tapes should match those from single-interval evaluation
+    for (unsigned i=0; i < out.size(); ++i)
+    {
+        auto r = e.intervalAndPush(lower[i], upper[i]);
+        REQUIRE(r.second->size() == out[i].second->size());
+        REQUIRE(r.second->root() == out[i].second->root());
+    }
+}
+
+TEST_CASE("IntervalEvaluator: SIMD backend")
+{
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"arithmetic", (x + 2) * (y - 3) - square(z) * x + abs(-y)},
+        {"division", x / y + (z - 1) / (x * 3) + 1 / (y + 0.5)},
+        {"sqrt", sqrt(x) + sqrt(y * z - 1) + sqrt(square(x) + square(z))},
+        {"min / max", max(min(x, y), min(z, x * y))},
+        {"transcendental", sin(x) * cos(y) + exp(z) / (1 + square(y))},
+        {"sphere", sphere(1)},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    // Random boxes, plus boxes with zero and infinite bounds
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<Eigen::Vector3f> lower = {
+        {0, 0, 0}, {-1, 0, -inf}, {0, -2, 0}, {-inf, -inf, -inf}, {1, 2, 3}};
+    std::vector<Eigen::Vector3f> upper = {
+        {0, 0, 0}, {0, 1, 0}, {inf, 0, 1}, {inf, inf, inf}, {1, 2, 3}};
+    for (unsigned i=0; i < 100; ++i)
+    {
+        Eigen::Vector3f a = Eigen::Vector3f::Random() * 3;
+        Eigen::Vector3f b = Eigen::Vector3f::Random() * 3;
+        lower.push_back(a.cwiseMin(b));
+        upper.push_back(a.cwiseMax(b));
+    }
+
+    for (auto& s : shapes)
+    {
+        CAPTURE(s.first);
+        auto deck = std::make_shared<Deck>(s.second);
+        IntervalEvaluator boost(deck);
+        IntervalEvaluator simd(deck);
+        simd.setBackend(IntervalEvaluator::SIMD);
+        REQUIRE(simd.getBackend() == IntervalEvaluator::SIMD);
+
+        for (unsigned i=0; i < lower.size(); ++i)
+        {
+            CAPTURE(lower[i].transpose());
+            CAPTURE(upper[i].transpose());
+            auto r = boost.intervalAndPush(lower[i], upper[i]);
+            auto q = simd.intervalAndPush(lower[i], upper[i]);
+            CAPTURE(r.first.lower());
+            CAPTURE(r.first.upper());
+            CAPTURE(q.first.lower());
+            CAPTURE(q.first.upper());
+
+            // SIMD results must contain the boost results (which may be
+            // empty, i.e. NaN), and must flag the same possible NaNs
+            REQUIRE(!(q.first.lower() > r.first.lower()));
+            REQUIRE(!(q.first.upper() < r.first.upper()));
+            REQUIRE(q.first.isSafe() == r.first.isSafe());
+
+            // They should also be nearly as tight, for finite boxes
+            if (std::isfinite(r.first.lower()) && i > 4)
+            {
+                REQUIRE(q.first.lower() ==
+                        Approx(r.first.lower()).margin(1e-5));
+            }
+            if (std::isfinite(r.first.upper()) && i > 4)
+            {
+                REQUIRE(q.first.upper() ==
+                        Approx(r.first.upper()).margin(1e-5));
+            }
+
+            // Pushing picks the same branches, unless the wider bounds
+            // made a min or max ambiguous (which is still safe)
+            REQUIRE(q.second->size() >= r.second->size());
+        }
+    }
+}
+
+TEST_CASE("IntervalEvaluator::evalBatch (performance)", "[!benchmark]")
+{
+    Region<3> r({-2, -2, -2}, {2, 2, 2});
+    std::vector<Eigen::Vector3f> lower, upper;
+    for (auto& c : r.subdivide())
+    {
+        lower.push_back(c.lower3().template cast<float>());
+        upper.push_back(c.upper3().template cast<float>());
+    }
+
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+    for (auto& s : shapes)
+    {
+        IntervalEvaluator e(s.second);
+        float sum = 0;
+        BENCHMARK(s.first + " (one box at a time)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                for (unsigned j=0; j < lower.size(); ++j)
+                {
+                    sum += e.eval(lower[j], upper[j]).upper();
+                }
+            }
+        }
+        BENCHMARK(s.first + " (batched)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                sum += e.evalBatch(lower, upper)[0].upper();
+            }
+        }
+        e.setBackend(IntervalEvaluator::SIMD);
+        BENCHMARK(s.first + " (one box at a time, SIMD backend)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                for (unsigned j=0; j < lower.size(); ++j)
+                {
+                    sum += e.eval(lower[j], upper[j]).upper();
+                }
+            }
+        }
+        CAPTURE(sum);
+    }
+}
+
+TEST_CASE("IntervalEvaluator::intervalAndPush (performance)", "[!benchmark]")
+{
+    // A large model (a union of many spheres), so that the Deck has many
+    // more clauses than the tape of any small cell
+    Tree t = sphere(0.1, {-2, -2, -2});
+    for (int i=0; i < 16; ++i)
+    {
+        for (int j=0; j < 16; ++j)
+        {
+            for (int k=0; k < 16; ++k)
+            {
+                t = min(t, sphere(0.1, {i / 4.0f - 2, j / 4.0f - 2,
+                                        k / 4.0f - 2}));
+            }
+        }
+    }
+    auto deck = std::make_shared<Deck>(t);
+    IntervalEvaluator e(deck);
+
+    // Push into cells on the surface of one sphere at increasing octree
+    // depths (of a 4-unit region), with each cell pushing from its parent's
+    // tape, as in WorkerPool.  Pushing should cost time proportional to the
+    // incoming tape, rather than to the number of clauses in the Deck.
+    float sum = 0;
+    auto tape = deck->tape;
+    for (int depth : {4, 8, 12})
+    {
+        const float size = 4.0f / (1 << depth);
+        const Eigen::Vector3f lower(0.1f - size / 2, -size / 2, -size / 2);
+        const Eigen::Vector3f upper = lower.array() + size;
+
+        auto parent = tape;
+        BENCHMARK("depth " + std::to_string(depth) + " (" +
+                  std::to_string(parent->size()) + " clauses)")
+        {
+            for (unsigned i=0; i < 1000; ++i)
+            {
+                sum += e.intervalAndPush(lower, upper, parent).second->size();
+            }
+        }
+        tape = e.intervalAndPush(lower, upper, parent).second;
+    }
+    CAPTURE(sum);
+}
@@ -8,14 +8,23 @@ License, v. 2.0. If a copy of the MPL was not distributed with this file,
 You can obtain one at http://mozilla.org/MPL/2.0/.
 */
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
 
 #include "catch.hpp"
 
+#include "libfive/eval/evaluator.hpp"
+#include "libfive/eval/deck.hpp"
+
 #include "libfive/render/brep/dc/dc_mesher.hpp"
 #include "libfive/render/brep/dc/dc_worker_pool.hpp"
 #include "libfive/render/brep/dual.hpp"
 #include "libfive/render/brep/region.hpp"
 #include "libfive/render/brep/mesh.hpp"
+#include "libfive/render/brep/incremental_mesher.hpp"
+#include "libfive/render/thread_pool.hpp"
 
 #include "util/shapes.hpp"
 #include "util/mesh_checks.hpp"
@@ -315,3 +324,226 @@ TEST_CASE("Mesh::render (edge pairing)")
     auto m = Mesh::render(c, r, settings);
     CHECK_EDGE_PAIRS(*m);
 }
+
+TEST_CASE("Mesh::render (leaf batching)")
+{
+    auto s = sphereGyroid();
+    Region<3> r({-5, -5, -5}, {5, 5, 5});
+
+    BRepSettings settings;
+    settings.min_feature = 0.25;
+    settings.workers = 1;
+
+    settings.leaf_batching = false;
+    auto a = Mesh::render(s, r, settings);
+
+    settings.leaf_batching = true;
+    auto b = Mesh::render(s, r, settings);
+
+    REQUIRE(a->verts.size() == b->verts.size());
+    REQUIRE(a->branes.size() == b->branes.size());
+    CHECK_EDGE_PAIRS(*b);
+}
+
+TEST_CASE("Mesh::render (shared thread pool)")
+{
+    auto s = sphereGyroid();
+    Region<3> r({-5, -5, -5}, {5, 5, 5});
+
+    BRepSettings settings;
+    settings.min_feature = 0.25;
+    settings.workers = 8;
+    auto a = Mesh::render(s, r, settings);
+
+    // The pool is deliberately smaller than the number of workers, and
+    // is reused across several renders.
+    ThreadPool pool(2);
+    settings.pool = &pool;
+    for (unsigned i=0; i < 3; ++i)
+    {
+        auto b = Mesh::render(s, r, settings);
+        REQUIRE(b.get() != nullptr);
+        REQUIRE(a->verts.size() == b->verts.size());
+        REQUIRE(a->branes.size() == b->branes.size());
+        CHECK_EDGE_PAIRS(*b);
+    }
+}
+
+TEST_CASE("Mesh::renderToFile")
+{
+    auto s = sphere(1);
+    Region<3> r({-2, -2, -2}, {2, 2, 2});
+
+    BRepSettings settings;
+    settings.min_feature = 0.1;
+    auto m = Mesh::render(s, r, settings);
+
+    SECTION("STL")
+    {
+        REQUIRE(Mesh::renderToFile(".libfive_mesh.stl", s, r, settings));
+
+        std::ifstream file(".libfive_mesh.stl", std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+        REQUIRE(data.size() == 84 + 50 * m->branes.size());
+
+        uint32_t num;
+        memcpy(&num, &data[80], sizeof(num));
+        REQUIRE(num == m->branes.size());
+
+        file.close();
+        std::remove(".libfive_mesh.stl");
+    }
+
+    SECTION("PLY")
+    {
+        REQUIRE(Mesh::renderToFile(".libfive_mesh.ply", s, r, settings));
+
+        std::ifstream file(".libfive_mesh.ply", std::ios::binary);
+        std::string line;
+        size_t num_verts = 0;
+        size_t num_faces = 0;
+        while (std::getline(file, line) && line != "end_header")
+        {
+            sscanf(line.c_str(), "element vertex %zu", &num_verts);
+            sscanf(line.c_str(), "element face %zu", &num_faces);
+        }
+        REQUIRE(num_verts == m->verts.size() - 1);
+        REQUIRE(num_faces == m->branes.size());
+
+        // Check that the body is exactly the right size, and that every
+        // face refers to a valid vertex.
+        const auto start = file.tellg();
+        file.seekg(0, std::ios::end);
+        REQUIRE(file.tellg() - start == 12 * num_verts + 13 * num_faces);
+
+        file.seekg(start + std::streamoff(12 * num_verts));
+        for (size_t i=0; i < num_faces; ++i)
+        {
+            uint8_t n;
+            uint32_t vs[3];
+            file.read(reinterpret_cast<char*>(&n), 1);
+            file.read(reinterpret_cast<char*>(vs), sizeof(vs));
+            REQUIRE(n == 3);
+            for (auto v : vs)
+            {
+                REQUIRE(v < num_verts);
+            }
+        }
+
+        file.close();
+        std::remove(".libfive_mesh.ply");
+    }
+
+    SECTION("Tiled")
+    {
+        // Mesh in 4x4x4 bricks, then check that the seams between bricks
+        // are stitched together, i.e. that every edge is shared by
+        // exactly two triangles.
+        settings.tile_depth = 2;
+        REQUIRE(Mesh::renderToFile(".libfive_mesh.ply", s, r, settings));
+
+        std::ifstream file(".libfive_mesh.ply", std::ios::binary);
+        std::string line;
+        size_t num_verts = 0;
+        size_t num_faces = 0;
+        while (std::getline(file, line) && line != "end_header")
+        {
+            sscanf(line.c_str(), "element vertex %zu", &num_verts);
+            sscanf(line.c_str(), "element face %zu", &num_faces);
+        }
+        REQUIRE(num_faces > 0);
+        file.seekg(file.tellg() + std::streamoff(12 * num_verts));
+
+        std::map<std::pair<uint32_t, uint32_t>, int> edges;
+        for (size_t i=0; i < num_faces; ++i)
+        {
+            uint8_t n;
+            uint32_t vs[3];
+            file.read(reinterpret_cast<char*>(&n), 1);
+            file.read(reinterpret_cast<char*>(vs), sizeof(vs));
+            REQUIRE(n == 3);
+            for (unsigned j=0; j < 3; ++j)
+            {
+                auto a = vs[j];
+                auto b = vs[(j + 1) % 3];
+                REQUIRE(a < num_verts);
+                edges[{std::min(a, b), std::max(a, b)}]++;
+            }
+        }
+        REQUIRE(std::all_of(edges.begin(), edges.end(),
+                    [](const std::pair<const std::pair<uint32_t, uint32_t>,
+                                       int>& e) { return e.second == 2; }));
+
+        file.close();
+        std::remove(".libfive_mesh.ply");
+    }
+
+    SECTION("Invalid extension")
+    {
+        REQUIRE(!Mesh::renderToFile(".libfive_mesh.obj", s, r, settings));
+    }
+}
+
+TEST_CASE("IncrementalMesher")
+{
+    // A fixed sphere, plus a sphere that is moved by a variable
+    auto v = Tree::var();
+    auto s = min(sphere(0.5, {-1, 0, 0}),
+                 sphere(0.5).remap(Tree::X() - v, Tree::Y(), Tree::Z()));
+    Region<3> r({-2, -2, -2}, {2, 2, 2});
+
+    BRepSettings settings;
+    settings.min_feature = 0.1;
+
+    std::map<Tree::Id, float> vars = {{v.id(), 1}};
+    // Evaluators share one Deck::Shared (as in Mesh::render), so that
+    // every worker evaluates exactly the same tape
+    auto deck = std::make_shared<const Deck::Shared>(s);
+    auto evaluators = [&]() {
+        std::vector<Evaluator, Eigen::aligned_allocator<Evaluator>> es;
+        for (unsigned i=0; i < settings.workers; ++i) {
+            es.emplace_back(Evaluator(std::make_shared<Deck>(deck), vars));
+        }
+        return es;
+    };
+    auto es = evaluators();
+
+    IncrementalMesher mesher(es.data(), r, vars);
+    auto a = mesher.render(vars, settings);
+    REQUIRE(a.get() != nullptr);
+    REQUIRE(mesher.rebuilt() == 1);
+
+    SECTION("Unchanged variables")
+    {
+        auto b = mesher.render(vars, settings);
+        REQUIRE(b.get() != nullptr);
+        REQUIRE(mesher.rebuilt() == 0);
+        REQUIRE(b->verts.size() == a->verts.size());
+        REQUIRE(b->branes.size() == a->branes.size());
+    }
+
+    SECTION("Moved sphere")
+    {
+        for (float x : {1.1, 1.25, 0.9})
+        {
+            vars[v.id()] = x;
+            auto b = mesher.render(vars, settings);
+            REQUIRE(b.get() != nullptr);
+            CHECK_EDGE_PAIRS(*b);
+
+            // Only cells around the moving sphere should be rebuilt (out
+            // of 16^3 cells at the level where rebuilding happens)
+            auto count = mesher.rebuilt();
+            CAPTURE(count);
+            REQUIRE(count > 0);
+            REQUIRE(count < 256);
+
+            // Compare against a mesh rendered from scratch
+            auto fresh = evaluators();
+            auto c = Mesh::render(fresh.data(), r, settings);
+            REQUIRE(b->verts.size() == c->verts.size());
+            REQUIRE(b->branes.size() == c->branes.size());
+        }
+    }
+}
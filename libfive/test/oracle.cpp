@@ -171,15 +171,14 @@ public:
     void evalInterval(Interval&) override {}
     void evalPoint(float&, size_t) override {}
     void checkAmbiguous(
-            Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
                          1, Eigen::Dynamic>) override {}
     void evalFeatures(
             boost::container::small_vector<Feature, 4>&) override {}
 
     void evalArray(
             Eigen::Block<Eigen::Array<float, Eigen::Dynamic,
-                                      LIBFIVE_EVAL_ARRAY_SIZE,
-                                      Eigen::RowMajor>,
+                                      Eigen::Dynamic, Eigen::RowMajor>,
                          1, Eigen::Dynamic> out) override
     {
         REQUIRE(out.cols() == expected_eval_size);
@@ -187,7 +186,7 @@ public:
     }
 
     void evalDerivArray(
-            Eigen::Block<Eigen::Array<float, 3, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<float, 3, Eigen::Dynamic>,
                          3, Eigen::Dynamic, true> out) override
     {
         REQUIRE(out.cols() == expected_eval_size);
@@ -0,0 +1,358 @@
+/*
+libfive: a CAD kernel for modeling with implicit functions
+
+Copyright (C) 2020  Matt Keeter
+
+This Source Code Form is subject to the terms of the Mozilla Public
+License, v. 2.0. If a copy of the MPL was not distributed with this file,
+You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "catch.hpp"
+
+#include "libfive/tree/tree.hpp"
+#include "libfive/eval/simd.hpp"
+#include "libfive/eval/eval_array.hpp"
+#include "libfive/eval/eval_deriv_array.hpp"
+#include "libfive/eval/eval_interval.hpp"
+
+#include "util/shapes.hpp"
+
+using namespace libfive;
+
+/*  Restores the original SIMD level when it goes out of scope  */
+struct LevelGuard
+{
+    LevelGuard() : prev(Simd::level()) {}
+    ~LevelGuard() { Simd::setLevel(prev); }
+    const Simd::Level prev;
+};
+
+static std::vector<Simd::Level> supportedLevels()
+{
+    std::vector<Simd::Level> out;
+    for (auto l : {Simd::BASELINE, Simd::AVX2, Simd::AVX512})
+    {
+        if (l <= Simd::detected())
+        {
+            out.push_back(l);
+        }
+    }
+    return out;
+}
+
+TEST_CASE("Simd::setLevel")
+{
+    LevelGuard g;
+    REQUIRE(Simd::level() <= Simd::detected());
+
+    for (auto l : supportedLevels())
+    {
+        REQUIRE(Simd::setLevel(l));
+        REQUIRE(Simd::level() == l);
+    }
+    if (Simd::detected() != Simd::AVX512)
+    {
+        REQUIRE(!Simd::setLevel(Simd::AVX512));
+        REQUIRE(Simd::level() != Simd::AVX512);
+    }
+}
+
+TEST_CASE("Simd::fromName")
+{
+    for (auto l : {Simd::BASELINE, Simd::AVX2, Simd::AVX512})
+    {
+        Simd::Level out;
+        REQUIRE(Simd::fromName(Simd::name(l), out));
+        REQUIRE(out == l);
+    }
+    Simd::Level out = Simd::AVX2;
+    REQUIRE(!Simd::fromName("sse9", out));
+    REQUIRE(out == Simd::AVX2);
+}
+
+TEST_CASE("Simd: kernels match across levels")
+{
+    LevelGuard g;
+
+    // This shape uses every opcode that has a SIMD kernel, including
+    // ones with immediates and fused clauses
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    auto z = Tree::Z();
+    auto t = max(abs(x) / (y * y + 1) - sqrt(x * x + y * y),
+                 min(1 / (z + 3), -y * 2.5)) +
+             max(min(x, 0.5), z - 0.25) + sphereGyroid();
+    auto deck = std::make_shared<Deck>(t);
+
+    const size_t count = 37;
+    std::vector<Eigen::Vector3f> pts;
+    std::vector<Eigen::Vector3f> lower, upper;
+    for (unsigned i=0; i < count; ++i)
+    {
+        pts.push_back(Eigen::Vector3f::Random() * 2);
+        lower.push_back(pts.back());
+        upper.push_back(pts.back() + Eigen::Vector3f::Random().cwiseAbs());
+    }
+
+    // Results are compared bitwise (so NaNs must match as well), since
+    // every level is compiled without floating-point contraction.
+    auto same = [](float a, float b) {
+        return !memcmp(&a, &b, sizeof(float));
+    };
+
+    Eigen::Array<float, 1, Eigen::Dynamic> values;
+    Eigen::Array<float, 4, Eigen::Dynamic> derivs;
+    std::vector<Interval> intervals;
+    for (auto l : supportedLevels())
+    {
+        CAPTURE(Simd::name(l));
+        REQUIRE(Simd::setLevel(l));
+
+        ArrayEvaluator a(deck);
+        DerivArrayEvaluator d(deck);
+        IntervalEvaluator i(deck);
+        for (unsigned k=0; k < count; ++k)
+        {
+            a.set(pts[k], k);
+            d.set(pts[k], k);
+        }
+        Eigen::Array<float, 1, Eigen::Dynamic> vs = a.values(count);
+        Eigen::Array<float, 4, Eigen::Dynamic> ds = d.derivs(count);
+        auto is = i.evalBatch(lower, upper, deck->tape);
+
+        if (l == Simd::BASELINE)
+        {
+            values = vs;
+            derivs = ds;
+            intervals = is;
+            continue;
+        }
+        for (unsigned k=0; k < count; ++k)
+        {
+            CAPTURE(k);
+            REQUIRE(same(vs(k), values(k)));
+            for (unsigned j=0; j < 4; ++j)
+            {
+                CAPTURE(j);
+                REQUIRE(same(ds(j, k), derivs(j, k)));
+            }
+            REQUIRE(same(is[k].lower(), intervals[k].lower()));
+            REQUIRE(same(is[k].upper(), intervals[k].upper()));
+            REQUIRE(is[k].isSafe() == intervals[k].isSafe());
+        }
+    }
+}
+
+/*  Returns the distance between two floats in ulp, treating +0 and -0 as
+ *  equal and NaNs as equal to each other (and infinitely far from any
+ *  number).  */
+static int64_t ulps(float a, float b)
+{
+    if (a == b || (std::isnan(a) && std::isnan(b)))
+    {
+        return 0;
+    }
+    else if (std::isnan(a) || std::isnan(b))
+    {
+        return INT64_MAX;
+    }
+    auto ordered = [](float f) {
+        int32_t i;
+        memcpy(&i, &f, sizeof(i));
+        return (i < 0) ? int64_t(INT32_MIN) - i : int64_t(i);
+    };
+    return std::abs(ordered(a) - ordered(b));
+}
+
+TEST_CASE("Simd: transcendental accuracy")
+{
+    LevelGuard g;
+
+    struct Unary {
+        Tree (*tree)(const Tree&);
+        float (*libm)(float);
+        float lower, upper;
+        int64_t max_ulps;
+    };
+    // Bounds are one ulp looser than those in math.inl, since libm is only
+    // faithfully rounded as well
+    const std::vector<std::pair<std::string, Unary>> unary = {
+        {"sin",  {sin,  sinf,  -20000, 20000, 3}},
+        {"cos",  {cos,  cosf,  -20000, 20000, 3}},
+        {"tan",  {tan,  tanf,  -10, 10, 5}},
+        {"asin", {asin, asinf, -1.5, 1.5, 4}},
+        {"acos", {acos, acosf, -1.5, 1.5, 4}},
+        {"atan", {atan, atanf, -100, 100, 5}},
+        {"exp",  {exp,  expf,  -110, 100, 2}},
+        {"log",  {log,  logf,  -1, 1000, 2}}};
+
+    // Special values, which are tacked onto the end of every range
+    const std::vector<float> special = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1e-40f, -1e-40f, 1e30f,
+        std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN()};
+
+    const unsigned count = 1000;
+    for (auto l : supportedLevels())
+    {
+        CAPTURE(Simd::name(l));
+        REQUIRE(Simd::setLevel(l));
+
+        for (auto& u : unary)
+        {
+            CAPTURE(u.first);
+            auto deck = std::make_shared<Deck>(u.second.tree(Tree::X()));
+            ArrayEvaluator e(deck);
+
+            std::vector<float> xs = special;
+            for (unsigned i=0; i < count; ++i)
+            {
+                xs.push_back(u.second.lower +
+                    (u.second.upper - u.second.lower) * i / (count - 1));
+            }
+            for (unsigned i=0; i < xs.size(); i += ArrayEvaluator::N)
+            {
+                const unsigned n = std::min<unsigned>(
+                        ArrayEvaluator::N, xs.size() - i);
+                for (unsigned j=0; j < n; ++j)
+                {
+                    e.set({xs[i + j], 0, 0}, j);
+                }
+                auto out = e.values(n);
+                for (unsigned j=0; j < n; ++j)
+                {
+                    CAPTURE(xs[i + j]);
+                    CAPTURE(out(j));
+                    REQUIRE(ulps(out(j), u.second.libm(xs[i + j])) <=
+                            u.second.max_ulps);
+                }
+            }
+        }
+
+        // Binary functions are checked on a grid
+        std::vector<std::pair<float, float>> pts;
+        for (float x : special)
+        {
+            for (float y : special)
+            {
+                pts.push_back({x, y});
+            }
+        }
+        for (int i=-20; i <= 20; ++i)
+        {
+            for (int j=-20; j <= 20; ++j)
+            {
+                pts.push_back({i * 0.37f, j * 0.5f});
+            }
+        }
+        auto x = Tree::X();
+        auto y = Tree::Y();
+        ArrayEvaluator ea(std::make_shared<Deck>(atan2(x, y)));
+        ArrayEvaluator ep(std::make_shared<Deck>(pow(x, y)));
+        for (unsigned i=0; i < pts.size(); i += ArrayEvaluator::N)
+        {
+            const unsigned n = std::min<unsigned>(
+                    ArrayEvaluator::N, pts.size() - i);
+            for (unsigned j=0; j < n; ++j)
+            {
+                ea.set({pts[i + j].first, pts[i + j].second, 0}, j);
+                ep.set({pts[i + j].first, pts[i + j].second, 0}, j);
+            }
+            auto as = ea.values(n);
+            auto ps = ep.values(n);
+            for (unsigned j=0; j < n; ++j)
+            {
+                const float x = pts[i + j].first;
+                const float y = pts[i + j].second;
+                CAPTURE(x);
+                CAPTURE(y);
+                CAPTURE(as(j));
+                CAPTURE(ps(j));
+                REQUIRE(ulps(as(j), atan2f(x, y)) <= 5);
+
+                // pow loses accuracy in proportion to |y * log2(x)|
+                const float p = powf(x, y);
+                const float e = std::abs(y * std::log2(std::abs(x)));
+                const int64_t slop = !std::isfinite(p) ? 0
+                    : std::isfinite(e) ? 2 + 2 * int64_t(std::ceil(e)) : 2;
+                REQUIRE(ulps(ps(j), p) <= slop);
+            }
+        }
+    }
+}
+
+TEST_CASE("Simd: kernel performance", "[!benchmark]")
+{
+    LevelGuard g;
+
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"sphere", sphere(1)},
+        {"menger", menger(2)},
+        {"sphereGyroid", sphereGyroid()}};
+
+    for (auto& s : shapes)
+    {
+        auto deck = std::make_shared<Deck>(s.second);
+        for (auto l : supportedLevels())
+        {
+            Simd::setLevel(l);
+            ArrayEvaluator e(deck);
+            for (unsigned i=0; i < ArrayEvaluator::N; ++i)
+            {
+                e.set(Eigen::Vector3f::Random(), i);
+            }
+
+            float sum = 0;
+            BENCHMARK(s.first + " (" + Simd::name(l) + ")")
+            {
+                for (unsigned i=0; i < 100; ++i)
+                {
+                    sum += e.values(ArrayEvaluator::N)(0);
+                }
+            }
+            CAPTURE(sum);
+        }
+    }
+}
+
+TEST_CASE("Simd: transcendental performance", "[!benchmark]")
+{
+    LevelGuard g;
+
+    auto x = Tree::X();
+    auto y = Tree::Y();
+    std::vector<std::pair<std::string, Tree>> shapes = {
+        {"sin", sin(x)}, {"cos", cos(x)}, {"tan", tan(x)},
+        {"asin", asin(x)}, {"acos", acos(x)}, {"atan", atan(x)},
+        {"exp", exp(x)}, {"log", log(x)}, {"atan2", atan2(x, y)},
+        {"pow", pow(x, y)}, {"mod", mod(x, y)}};
+
+    for (auto& s : shapes)
+    {
+        auto deck = std::make_shared<Deck>(s.second);
+        for (auto l : supportedLevels())
+        {
+            Simd::setLevel(l);
+            ArrayEvaluator e(deck);
+            for (unsigned i=0; i < ArrayEvaluator::N; ++i)
+            {
+                e.set(Eigen::Vector3f::Random().cwiseAbs() * 0.9, i);
+            }
+
+            float sum = 0;
+            BENCHMARK(s.first + " (" + Simd::name(l) + ")")
+            {
+                for (unsigned i=0; i < 1000; ++i)
+                {
+                    sum += e.values(ArrayEvaluator::N)(0);
+                }
+            }
+            CAPTURE(sum);
+        }
+    }
+}
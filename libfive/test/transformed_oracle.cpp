@@ -274,3 +274,32 @@ TEST_CASE("Jacobian-0 transform and abs applied to Oracle: "
         { -1., 1.5, -1. },{ 1., -1., -1. },{ 0., 0., 0. } });
     //  None of these correspond to corners
 }
+
+TEST_CASE("TransformedOracle: wide evaluators")
+{
+    // The evaluator is wider than the oracle's default storage, so the
+    // oracle (and its own evaluators) need to grow to keep up.
+    auto s = sphere(1);
+    auto t = rotate2d(s, 10);
+    auto o = rotate2d(convertToOracleAxes(s), 10);
+
+    const size_t width = 3 * ArrayEvaluator::N + 5;
+    DerivArrayEvaluator e(std::make_shared<Deck>(o), {}, width);
+    DerivArrayEvaluator ref(t);
+
+    std::vector<Eigen::Vector3f> pts;
+    for (unsigned i=0; i < width; ++i)
+    {
+        pts.push_back(Eigen::Vector3f::Random() * 2);
+        e.set(pts.back(), i);
+    }
+    auto ds = e.derivs(width).eval();
+    for (unsigned i=0; i < width; ++i)
+    {
+        CAPTURE(i);
+        auto r = ref.deriv(pts[i]);
+        REQUIRE(ds(3, i) == Approx(r.w()).margin(1e-5));
+        REQUIRE(ds(0, i) == Approx(r.x()).margin(1e-5));
+        REQUIRE(ds(1, i) == Approx(r.y()).margin(1e-5));
+    }
+}
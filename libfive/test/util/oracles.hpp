@@ -30,7 +30,7 @@ class AxisOracle : public OracleStorage<>
     }
 
     void checkAmbiguous(
-            Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
                          1, Eigen::Dynamic> /* out */) override
     {
         // Nothing to do here
@@ -100,7 +100,7 @@ class CubeOracle : public OracleStorage<>
     }
 
     void checkAmbiguous(
-            Eigen::Block<Eigen::Array<bool, 1, LIBFIVE_EVAL_ARRAY_SIZE>,
+            Eigen::Block<Eigen::Array<bool, 1, Eigen::Dynamic>,
             1, Eigen::Dynamic> out) override
     {
         out = out ||
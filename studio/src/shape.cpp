@@ -35,11 +35,14 @@ Shape::Shape(const libfive::Tree& t,
       vert_vbo(QOpenGLBuffer::VertexBuffer),
       tri_vbo(QOpenGLBuffer::IndexBuffer)
 {
-    // Construct evaluators to run meshing (in parallel)
+    // Construct evaluators to run meshing (in parallel), sharing
+    // a single flattened copy of the tree between them
     es.reserve(8);
+    const auto deck = std::make_shared<const libfive::Deck::Shared>(tree);
     for (unsigned i=0; i < es.capacity(); ++i)
     {
-        es.emplace_back(libfive::Evaluator(tree, vars));
+        es.emplace_back(libfive::Evaluator(
+                    std::make_shared<libfive::Deck>(deck), vars));
     }
 
     connect(this, &Shape::gotMesh, this, &Shape::redraw);